@@ -0,0 +1,181 @@
+/*
+ * Copyright (C) 2020 Daniel Igaz
+ *
+ * This file is part of the eINK-click project.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "displaylist.hpp"
+#include <string.h>
+
+DisplayList::DisplayList(Item* items, size_t maxItems, char* text, size_t textSize)
+: _items(items)
+, _maxItems(maxItems)
+, _count(0)
+, _text(text)
+, _textSize(textSize)
+, _textUsed(0)
+, _stats()
+{
+	osalDbgCheck(items != NULL && text != NULL);
+}
+
+bool DisplayList::addRect(uint16_t x, uint16_t y, uint16_t width, uint16_t height,
+		uint8_t color, uint8_t bkgColor)
+{
+	if (_count == _maxItems)
+		return false;
+
+	Item& it = _items[_count++];
+
+	it.x = x;
+	it.y = y;
+	it.width = width;
+	it.height = height;
+	it.top = y;
+	it.bottom = y + height;
+	it.type = ITEM_RECT;
+	it.color = color;
+	it.bkgColor = bkgColor;
+	it.text = 0;
+	it.font = NULL;
+	it.compiled = false;
+
+	_stats.recorded++;
+
+	return true;
+}
+
+bool DisplayList::addText(uint16_t x, uint16_t y, uint16_t width, uint16_t height,
+		uint8_t color, uint8_t bkgColor, const void* font, bool compiled,
+		const char* str, size_t n)
+{
+	if (_count == _maxItems || _textUsed + n + 1 > _textSize || _textUsed > UINT16_MAX)
+		return false;
+
+	Item& it = _items[_count++];
+
+	it.x = x;
+	it.y = y;
+	it.width = width;
+	it.height = height;
+	it.top = y;
+	it.bottom = y + height;
+	it.type = ITEM_TEXT;
+	it.color = color;
+	it.bkgColor = bkgColor;
+	it.text = _textUsed;
+	it.font = font;
+	it.compiled = compiled;
+
+	memcpy(_text + _textUsed, str, n);
+	_text[_textUsed + n] = 0;
+	_textUsed += n + 1;
+
+	_stats.recorded++;
+
+	return true;
+}
+
+bool DisplayList::merge(Item& a, const Item& b)
+{
+	if (a.type != ITEM_RECT || b.type != ITEM_RECT ||
+			a.color != b.color || a.bkgColor != b.bkgColor)
+		return false;
+
+	// side by side
+	if (a.y == b.y && a.height == b.height &&
+			(a.x + a.width == b.x || b.x + b.width == a.x)) {
+		a.x = (a.x < b.x) ? a.x : b.x;
+		a.width += b.width;
+		return true;
+	}
+
+	// on top of each other, the painted rows must not overlap either
+	if (a.x == b.x && a.width == b.width &&
+			((a.y + a.height == b.y && a.bottom == b.top) ||
+			(b.y + b.height == a.y && b.bottom == a.top))) {
+		a.y = (a.y < b.y) ? a.y : b.y;
+		a.height += b.height;
+		a.top = (a.top < b.top) ? a.top : b.top;
+		a.bottom = (a.bottom > b.bottom) ? a.bottom : b.bottom;
+		return true;
+	}
+
+	return false;
+}
+
+void DisplayList::optimize(bool wholeBytes)
+{
+	// drawing to the RAM pads partial bytes with the background color
+	for (size_t i = 0; i < _count; i++) {
+		Item& it = _items[i];
+
+		it.top = wholeBytes ? (it.y & ~0x03) : it.y;
+		it.bottom = wholeBytes ? ((it.y + it.height + 3) & ~0x03) : it.y + it.height;
+	}
+
+	// merge into a later rectangle, stop at the first call drawn over,
+	// merged calls are left without width
+	for (size_t i = 0; i < _count; i++) {
+		for (size_t j = i + 1; j < _count && _items[i].width > 0; j++) {
+			if (_items[j].width == 0)
+				continue;
+			if (overlaps(_items[i], _items[j]))
+				break;
+			if (merge(_items[j], _items[i])) {
+				_items[i].width = 0;
+				_stats.merged++;
+				break;
+			}
+		}
+	}
+
+	// drop calls painted over by a later one
+	size_t n = 0;
+
+	for (size_t i = 0; i < _count; i++) {
+		bool keep = _items[i].width > 0;
+
+		for (size_t j = i + 1; j < _count && keep; j++) {
+			if (contains(_items[j], _items[i])) {
+				keep = false;
+				_stats.culled++;
+			}
+		}
+
+		if (keep)
+			_items[n++] = _items[i];
+	}
+
+	_count = n;
+
+	// sort by RAM x then y address, moving only independent calls
+	for (size_t i = 1; i < _count; i++) {
+		for (size_t j = i; j > 0; j--) {
+			Item& a = _items[j - 1];
+			Item& b = _items[j];
+
+			if ((a.top >> 2) < (b.top >> 2) || ((a.top >> 2) == (b.top >> 2) && a.x <= b.x))
+				break;
+			if (overlaps(a, b))
+				break;
+
+			Item t = a;
+			a = b;
+			b = t;
+		}
+	}
+}
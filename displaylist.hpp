@@ -0,0 +1,171 @@
+/*
+ * Copyright (C) 2020 Daniel Igaz
+ *
+ * This file is part of the eINK-click project.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef EINK_CLICK_DISPLAYLIST_HPP_
+#define EINK_CLICK_DISPLAYLIST_HPP_
+
+#include "hal.h"
+
+/**
+ * @brief	Recorded drawing calls.
+ * @details	Each recorded call paints an opaque display area, text
+ * 			included since glyphs are drawn with their background. The
+ * 			painted rows may exceed the drawn area, drawing straight to
+ * 			the RAM fills whole RAM bytes. Before
+ * 			replaying, the list is optimized: draws covered by a later one
+ * 			are dropped, adjacent rectangles of the same color are merged
+ * 			and independent draws are sorted by RAM address so
+ * 			consecutive draws share RAM address windows. Items and text
+ * 			live in caller provided memory.
+ */
+class DisplayList {
+public:
+	/**
+	 * @brief	Recorded drawing call type.
+	 */
+	typedef enum : uint8_t {
+		ITEM_RECT = 0,			///< Filled rectangle.
+		ITEM_TEXT = 1,			///< Glyph run.
+	} ItemType;
+
+	/**
+	 * @brief	Recorded drawing call.
+	 */
+	typedef struct {
+		uint16_t x;				///< Horizontal start location.
+		uint16_t y;				///< Vertical start location.
+		uint16_t width;			///< Area width.
+		uint16_t height;		///< Area height.
+		uint16_t top;			///< First painted row, set by optimize().
+		uint16_t bottom;		///< Row after the last painted one, set by optimize().
+		ItemType type;			///< Drawing call type.
+		uint8_t color;			///< Drawing color.
+		uint8_t bkgColor;		///< Background color.
+		uint16_t text;			///< Offset of the text in the text pool.
+		const void* font;		///< Font of the text.
+		bool compiled;			///< Font is a @p CompiledFont.
+	} Item;
+
+	/**
+	 * @brief	Optimization statistics.
+	 */
+	typedef struct {
+		uint32_t recorded;		///< Recorded drawing calls.
+		uint32_t culled;		///< Calls dropped as covered by later ones.
+		uint32_t merged;		///< Rectangles merged into others.
+		uint32_t replayed;		///< Calls executed.
+	} Stats;
+
+private:
+	Item* _items;				///< Recorded calls.
+	size_t _maxItems;			///< Capacity of @p _items.
+	size_t _count;				///< Number of recorded calls.
+	char* _text;				///< Text pool.
+	size_t _textSize;			///< Capacity of the text pool.
+	size_t _textUsed;			///< Used bytes of the text pool.
+	Stats _stats;				///< Statistics.
+
+	static bool overlaps(const Item& a, const Item& b) {
+		return a.x < b.x + b.width && b.x < a.x + a.width &&
+				a.top < b.bottom && b.top < a.bottom;
+	}
+
+	static bool contains(const Item& a, const Item& b) {
+		return a.x <= b.x && b.x + b.width <= a.x + a.width &&
+				a.top <= b.top && b.bottom <= a.bottom;
+	}
+
+	/**
+	 * @brief	Merge rectangle @p b into rectangle @p a if their union is
+	 * 			a rectangle.
+	 */
+	static bool merge(Item& a, const Item& b);
+
+public:
+	/**
+	 * @param[in] items		pointer to the item memory
+	 * @param[in] maxItems	number of items
+	 * @param[in] text		pointer to the text pool memory
+	 * @param[in] textSize	size of the text pool in bytes
+	 */
+	DisplayList(Item* items, size_t maxItems, char* text, size_t textSize);
+
+	/** @brief	Get the number of recorded calls. */
+	size_t count() const { return _count; }
+
+	/** @brief	Get recorded call @p i. */
+	const Item& item(size_t i) const { return _items[i]; }
+
+	/** @brief	Get the text of a recorded call. */
+	const char* text(const Item& item) const { return _text + item.text; }
+
+	/**
+	 * @brief	Record a filled rectangle.
+	 *
+	 * @param[in] x, y, width, height	drawn area
+	 * @param[in] color		drawing color
+	 * @param[in] bkgColor	color of the painted rows outside the area
+	 *
+	 * @returns	@p false if the list is full.
+	 */
+	bool addRect(uint16_t x, uint16_t y, uint16_t width, uint16_t height,
+			uint8_t color, uint8_t bkgColor);
+
+	/**
+	 * @brief	Record a glyph run.
+	 *
+	 * @param[in] x, y, width, height	drawn area
+	 * @param[in] color		drawing color
+	 * @param[in] bkgColor	background color
+	 * @param[in] font		font
+	 * @param[in] compiled	@p font is a @p CompiledFont
+	 * @param[in] str		first glyph of the run
+	 * @param[in] n			number of characters in the run
+	 *
+	 * @returns	@p false if the list is full.
+	 */
+	bool addText(uint16_t x, uint16_t y, uint16_t width, uint16_t height,
+			uint8_t color, uint8_t bkgColor, const void* font, bool compiled,
+			const char* str, size_t n);
+
+	/**
+	 * @brief	Drop covered calls, merge rectangles and sort the calls by
+	 * 			RAM address.
+	 *
+	 * @param[in] wholeBytes	calls paint whole RAM bytes
+	 */
+	void optimize(bool wholeBytes);
+
+	/** @brief	Drop all recorded calls. */
+	void clear() {
+		_count = 0;
+		_textUsed = 0;
+	}
+
+	/** @brief	Get the statistics. */
+	const Stats& stats() const { return _stats; }
+
+	/** @brief	Count replayed calls. */
+	void countReplayed(size_t n) { _stats.replayed += n; }
+
+	/** @brief	Reset the statistics. */
+	void resetStats() { _stats = Stats(); }
+};
+
+#endif /* EINK_CLICK_DISPLAYLIST_HPP_ */
@@ -0,0 +1,173 @@
+/*
+ * Copyright (C) 2020 Daniel Igaz
+ *
+ * This file is part of the eINK-click project.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "dither.hpp"
+#include <string.h>
+
+/**
+ * @brief	4x4 Bayer matrix.
+ */
+static const uint8_t bayer[4][4] = {
+	{  0,  8,  2, 10 },
+	{ 12,  4, 14,  6 },
+	{  3, 11,  1,  9 },
+	{ 15,  7, 13,  5 },
+};
+
+/**
+ * @brief	Gray distance between two display colors.
+ */
+static const uint16_t LEVEL_STEP = 85;
+
+/**
+ * @brief	Compare 8 unsigned byte lanes.
+ *
+ * @returns	The most significant bit of each lane set where @p x >= @p y.
+ */
+static inline uint64_t greaterEqual(uint64_t x, uint64_t y)
+{
+	const uint64_t h = 0x8080808080808080ULL;
+
+	// the top bit of each lane keeps the borrow from crossing lanes
+	uint64_t d = (x | h) - (y & ~h);
+
+	return ((x & ~y) | (~(x ^ y) & d)) & h;
+}
+
+Dither::Dither(Mode mode, uint16_t width, int16_t* errors)
+: _mode(mode)
+, _width(width)
+, _cur(errors)
+, _next(errors != NULL ? errors + width + 2 : NULL)
+{
+	osalDbgAssert(mode != DITHER_DIFFUSION || errors != NULL, "Dither(), no error buffer");
+
+	// color k starts at the fraction (2 * b + 1) / 32 of the step from
+	// color k - 1, the midpoint for b = 7.5 without dithering, rounded up
+	for (uint8_t r = 0; r < 4; r++) {
+		for (uint8_t k = 1; k <= 3; k++) {
+			for (uint8_t i = 0; i < 8; i++) {
+				uint16_t b2 = (mode == DITHER_ORDERED) ? 2 * bayer[r][i & 0x03] + 1 : 16;
+				_th[r][k - 1][i] = (LEVEL_STEP * (32 * (k - 1) + b2) + 31) / 32;
+			}
+		}
+	}
+
+	reset();
+}
+
+void Dither::reset()
+{
+	if (_cur != NULL) {
+		memset(_cur, 0, (_width + 2) * sizeof(int16_t));
+		memset(_next, 0, (_width + 2) * sizeof(int16_t));
+	}
+}
+
+void Dither::row(const uint8_t* gray, uint16_t y, uint8_t* bp, size_t step)
+{
+	osalDbgCheck(gray != NULL && bp != NULL && step > 0);
+
+	uint8_t shift = (3 - (y & 0x03)) << 1;
+
+	if (_mode == DITHER_DIFFUSION)
+		diffuse(gray, shift, bp, step);
+	else
+		compare(gray, shift, _th[y & 0x03], bp, step);
+}
+
+void Dither::compare(const uint8_t* gray, uint8_t shift, const uint8_t (*th)[8], uint8_t* bp, size_t step) const
+{
+	uint64_t t1, t2, t3;
+	uint16_t x = 0;
+
+	memcpy(&t1, th[0], 8);
+	memcpy(&t2, th[1], 8);
+	memcpy(&t3, th[2], 8);
+
+	const uint64_t field = 0x0303030303030303ULL << shift;
+
+	// 8 pixels per step, the matrix repeats every 4 columns
+	for (; x + 8 <= _width; x += 8) {
+		uint64_t g;
+		memcpy(&g, gray + x, 8);
+
+		uint64_t level = (greaterEqual(g, t1) >> 7) + (greaterEqual(g, t2) >> 7) +
+				(greaterEqual(g, t3) >> 7);
+
+		if (step == 1) {
+			uint64_t b;
+			memcpy(&b, bp + x, 8);
+			b = (b & ~field) | (level << shift);
+			memcpy(bp + x, &b, 8);
+			continue;
+		}
+
+		uint8_t lanes[8];
+		memcpy(lanes, &level, 8);
+		for (uint8_t i = 0; i < 8; i++) {
+			uint8_t* cp = bp + (x + i) * step;
+			*cp = (*cp & ~(0x03 << shift)) | (lanes[i] << shift);
+		}
+	}
+
+	for (; x < _width; x++) {
+		uint8_t i = x & 0x07;
+		uint8_t level = (gray[x] >= th[0][i]) + (gray[x] >= th[1][i]) + (gray[x] >= th[2][i]);
+		uint8_t* cp = bp + x * step;
+		*cp = (*cp & ~(0x03 << shift)) | (level << shift);
+	}
+}
+
+void Dither::diffuse(const uint8_t* gray, uint8_t shift, uint8_t* bp, size_t step)
+{
+	// one entry of padding on both sides
+	int16_t* cur = _cur + 1;
+	int16_t* next = _next + 1;
+
+	memset(_next, 0, (_width + 2) * sizeof(int16_t));
+
+	for (uint16_t x = 0; x < _width; x++) {
+		int16_t v = gray[x] + cur[x];
+		int16_t level = (v + LEVEL_STEP / 2) / LEVEL_STEP;
+
+		if (level < 0)
+			level = 0;
+		else if (level > 3)
+			level = 3;
+
+		// Floyd-Steinberg weights, the rounding rest goes down right
+		int16_t e = v - level * LEVEL_STEP;
+		int16_t e7 = (e * 7) / 16;
+		int16_t e3 = (e * 3) / 16;
+		int16_t e5 = (e * 5) / 16;
+
+		cur[x + 1] += e7;
+		next[x - 1] += e3;
+		next[x] += e5;
+		next[x + 1] += e - e7 - e3 - e5;
+
+		uint8_t* cp = bp + x * step;
+		*cp = (*cp & ~(0x03 << shift)) | (level << shift);
+	}
+
+	int16_t* swap = _cur;
+	_cur = _next;
+	_next = swap;
+}
@@ -0,0 +1,111 @@
+/*
+ * Copyright (C) 2020 Daniel Igaz
+ *
+ * This file is part of the eINK-click project.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef EINK_CLICK_DITHER_HPP_
+#define EINK_CLICK_DITHER_HPP_
+
+#include "hal.h"
+
+/**
+ * @brief	8 bit grayscale to 2bpp quantizer.
+ * @details	Converts one row of 8 bit gray levels at a time to the 4
+ * 			display colors, black being 0 and white 3, and stores them
+ * 			straight into the RAM layout: the 2 bit field of row @p y in
+ * 			one byte per column. Rows are streamed from top to bottom, no
+ * 			8 bit frame is needed. A strip of 4 rows fills one RAM byte
+ * 			per column and is sent as a native image, e.g.
+ * @code
+ * 	for (uint16_t y = 0; y < height; y++) {
+ * 		dither.row(readRow(y), y, strip);
+ * 		if ((y & 0x03) == 0x03)
+ * 			epd.drawImage(0, y & ~0x03, width, 4, strip);
+ * 	}
+ * @endcode
+ * 			or into a frame buffer with
+ * 			@p dither.row(gray, y, fb.column(0) + (y >> 2), fb.stride()).
+ *
+ * 			Threshold and ordered modes compare 8 pixels at a time in the
+ * 			byte lanes of a 64 bit word. Error diffusion spreads the
+ * 			quantization error with the Floyd-Steinberg weights and keeps
+ * 			the error of the next row in a caller provided buffer.
+ */
+class Dither {
+public:
+	/**
+	 * @brief	Quantization method.
+	 */
+	typedef enum {
+		DITHER_THRESHOLD = 0,	///< Nearest color, no dithering.
+		DITHER_ORDERED = 1,		///< 4x4 Bayer matrix.
+		DITHER_DIFFUSION = 2,	///< Floyd-Steinberg error diffusion.
+	} Mode;
+
+private:
+	Mode _mode;					///< Quantization method.
+	uint16_t _width;			///< Row width in pixels.
+	int16_t* _cur;				///< Errors carried into the current row.
+	int16_t* _next;				///< Errors carried into the next row.
+	uint8_t _th[4][3][8];		///< Color thresholds per matrix row, 8 lanes.
+
+	/**
+	 * @brief	Quantize a row by comparing with the thresholds.
+	 */
+	void compare(const uint8_t* gray, uint8_t shift, const uint8_t (*th)[8], uint8_t* bp, size_t step) const;
+
+	/**
+	 * @brief	Quantize a row with error diffusion.
+	 */
+	void diffuse(const uint8_t* gray, uint8_t shift, uint8_t* bp, size_t step);
+
+public:
+	/**
+	 * @param[in] mode		quantization method
+	 * @param[in] width		row width in pixels
+	 * @param[in] errors	errorBufferSize() entries for @p DITHER_DIFFUSION,
+	 * 						@p NULL otherwise
+	 */
+	Dither(Mode mode, uint16_t width, int16_t* errors = NULL);
+
+	/**
+	 * @brief	Get the error buffer size in entries.
+	 *
+	 * @param[in] width		row width in pixels
+	 */
+	static constexpr size_t errorBufferSize(uint16_t width) { return 2 * (size_t(width) + 2); }
+
+	/**
+	 * @brief	Forget the errors carried from the previous rows.
+	 * @details	Call before the first row of a new image.
+	 */
+	void reset();
+
+	/**
+	 * @brief	Quantize a row into the RAM layout.
+	 * @details	Only the 2 bit field of row @p y is changed in each byte.
+	 *
+	 * @param[in] gray		8 bit gray levels, @p width bytes
+	 * @param[in] y			row number, selects the bit field and the
+	 * 						matrix row
+	 * @param[out] bp		pointer to the byte of the first column
+	 * @param[in] step		distance between the bytes of two columns
+	 */
+	void row(const uint8_t* gray, uint16_t y, uint8_t* bp, size_t step = 1);
+};
+
+#endif /* EINK_CLICK_DITHER_HPP_ */
@@ -0,0 +1,10 @@
+# List of the host simulator files, use together with eINK-click.mk
+# to build the driver on a host without ChibiOS.
+EINKCLICKSIMSRCPP = eINK-click/sim/hal_sim.cpp
+
+# Required include directories
+EINKCLICKSIMINC = eINK-click/sim
+
+# Shared variables
+ALLCPPSRC += $(EINKCLICKSIMSRCPP)
+ALLINC    += $(EINKCLICKSIMINC)
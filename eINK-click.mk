@@ -1,6 +1,14 @@
 # List of all the eINK-click related files.
 EINKCLICKSRCPP = eINK-click/ssd16xx/ssd16xx.cpp \
-                 eINK-click/epd.cpp
+                 eINK-click/framebuffer.cpp \
+                 eINK-click/epd.cpp \
+                 eINK-click/glyphcache.cpp \
+                 eINK-click/displaylist.cpp \
+                 eINK-click/rle.cpp \
+                 eINK-click/dither.cpp \
+                 eINK-click/renderqueue.cpp \
+                 eINK-click/updatescheduler.cpp \
+                 eINK-click/panelmanager.cpp
 
 # Required include directories
 EINKCLICKINC = eINK-click \
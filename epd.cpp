@@ -18,14 +18,34 @@
  */
 
 #include "epd.hpp"
+#include <string.h>
 
-EPD::EPD(SSD16xx& ssd, uint16_t width, uint16_t height, const uint8_t* fntp)
+EPD::EPD(SSD16xx& ssd, uint16_t width, uint16_t height, const uint8_t* fntp,
+		Orientation orientation)
 : _ssd(ssd)
 , _width(width)
 , _height(height)
+, _orientation(orientation)
+, _fb(NULL, width, height)
+, _prev(NULL, width, height)
+, _prevValid(false)
+, _stats()
+, _dirty()
+, _other(NULL, width, height)
+, _pendingDirty()
+, _pendingMode(SSD16xx::UPDATE_FULL)
+, _pending(false)
+, _glyphs(NULL)
+, _list(NULL)
+, _bandY(0)
+, _banding(false)
 {
 	osalDbgAssert(width <= ssd.gates() && height <= ssd.sources(),
 			"EPD::EPD, invalid size");
+	osalDbgAssert(!(orientation & ORIENTATION_MIRROR_Y) || (height & 0x03) == 0,
+			"EPD::EPD, invalid height");
+
+	ssd.setDataEntryMode(dataEntryMode(orientation));
 
 	setFont(fntp);
 	setBkgColor(COLOR_WHITE);
@@ -45,23 +65,309 @@ void EPD::stop()
 	_ssd.stop();
 }
 
-void EPD::updateDisplay()
+msg_t EPD::updateDisplay(SSD16xx::UpdateMode mode)
+{
+	flush();
+	return _ssd.update(mode);
+}
+
+msg_t EPD::startUpdateDisplay(SSD16xx::UpdateMode mode)
+{
+	flush();
+	return _ssd.startUpdate(mode);
+}
+
+void EPD::setFrameBuffer(uint8_t* bp)
+{
+	commitDisplayList();
+	syncPresent(TIME_INFINITE);
+
+	_other = FrameBuffer(NULL, _width, _height);
+	_fb = FrameBuffer(bp, _width, _height);
+	_dirty.count = 0;
+	_prevValid = false;
+
+	if (bp != NULL) {
+		_fb.fill(colorByte(_bkgColor));
+		markDirty(0, 0, _width, _height);
+	}
+}
+
+void EPD::setFrameBuffers(uint8_t* bp0, uint8_t* bp1)
+{
+	osalDbgCheck(bp0 != NULL && bp1 != NULL);
+
+	setFrameBuffer(bp0);
+	_other = FrameBuffer(bp1, _width, _height);
+}
+
+void EPD::swapBuffers()
+{
+	FrameBuffer fb = _fb;
+	_fb = _other;
+	_other = fb;
+
+	DirtyList dirty = _dirty;
+	_dirty = _pendingDirty;
+	_pendingDirty = dirty;
+}
+
+void EPD::present(SSD16xx::UpdateMode mode)
+{
+	osalDbgAssert(buffered(), "EPD::present(), no frame buffer");
+
+	commitDisplayList();
+
+	// the pipeline is full, wait for the display
+	syncPresent(TIME_INFINITE);
+
+	if (_other.data() == NULL || !_ssd.updating()) {
+		flushBuffer();
+		_ssd.startUpdate(mode);
+		return;
+	}
+
+	// hand the frame over and continue drawing on a copy of it
+	swapBuffers();
+	memcpy(_fb.data(), _other.data(), frameBufferSize());
+	_dirty.count = 0;
+	_pendingMode = mode;
+	_pending = true;
+}
+
+msg_t EPD::syncPresent(sysinterval_t timeout)
+{
+	if (!_pending)
+		return MSG_OK;
+
+	msg_t msg = _ssd.waitUpdate(timeout);
+	if (msg != MSG_OK)
+		return msg;
+
+	swapBuffers();
+	flushBuffer();
+	swapBuffers();
+
+	_pending = false;
+
+	return _ssd.startUpdate(_pendingMode);
+}
+
+void EPD::setPrevFrameBuffer(uint8_t* bp)
 {
-	_ssd.update();
+	osalDbgAssert(bp == NULL || buffered(), "EPD::setPrevFrameBuffer(), no frame buffer");
+
+	_prev = FrameBuffer(bp, _width, _height);
+	_prevValid = false;
+
+	if (bp != NULL)
+		markDirty(0, 0, _width, _height);
+}
+
+void EPD::markDirty(uint16_t x, uint16_t y, uint16_t width, uint16_t height)
+{
+	// bands are sent whole
+	if (width == 0 || height == 0 || _banding)
+		return;
+
+	// extend to whole RAM bytes
+	Rect r = { x, uint16_t(y & ~0x03), width, 0 };
+	uint16_t ye = (y + height + 3) & ~0x03;
+	if (ye > (_fb.stride() << 2))
+		ye = _fb.stride() << 2;
+	r.height = ye - r.y;
+
+	// merge with the tracked areas as long as it pays off
+	for (size_t i = 0; i < _dirty.count; ) {
+		const Rect& d = _dirty.rects[i];
+		uint16_t x0 = (r.x < d.x) ? r.x : d.x;
+		uint16_t y0 = (r.y < d.y) ? r.y : d.y;
+		uint16_t x1 = (r.x + r.width > d.x + d.width) ? r.x + r.width : d.x + d.width;
+		uint16_t y1 = (r.y + r.height > d.y + d.height) ? r.y + r.height : d.y + d.height;
+		Rect u = { x0, y0, uint16_t(x1 - x0), uint16_t(y1 - y0) };
+
+		if (cost(u) <= cost(r) + cost(d)) {
+			r = u;
+			_dirty.rects[i] = _dirty.rects[--_dirty.count];
+			i = 0;
+		}
+		else
+			i++;
+	}
+
+	if (_dirty.count < EPD_DIRTY_RECTS) {
+		_dirty.rects[_dirty.count++] = r;
+		return;
+	}
+
+	// no free slot, grow the area needing the least extra bytes
+	size_t best = 0;
+	size_t bestCost = SIZE_MAX;
+	Rect bestRect = r;
+
+	for (size_t i = 0; i < _dirty.count; i++) {
+		const Rect& d = _dirty.rects[i];
+		uint16_t x0 = (r.x < d.x) ? r.x : d.x;
+		uint16_t y0 = (r.y < d.y) ? r.y : d.y;
+		uint16_t x1 = (r.x + r.width > d.x + d.width) ? r.x + r.width : d.x + d.width;
+		uint16_t y1 = (r.y + r.height > d.y + d.height) ? r.y + r.height : d.y + d.height;
+		Rect u = { x0, y0, uint16_t(x1 - x0), uint16_t(y1 - y0) };
+
+		if (cost(u) - cost(d) < bestCost) {
+			best = i;
+			bestCost = cost(u) - cost(d);
+			bestRect = u;
+		}
+	}
+
+	_dirty.rects[best] = bestRect;
+}
+
+void EPD::sendArea(const Rect& r)
+{
+	uint16_t ys = r.y >> 2;
+	uint16_t n = r.height >> 2;
+
+	setWindow(r.x, r.y, r.width, r.height);
+
+	_stats.windows++;
+	_stats.sentBytes += uint32_t(r.width) * n;
+
+	// whole columns are contiguous in the frame buffer
+	if (n == _fb.stride()) {
+		_ssd.sendData(_fb.column(r.x), size_t(r.width) * n);
+		return;
+	}
+
+	// gather the column parts into bigger transfers
+	uint8_t buf[EPD_TX_BUFFER_SIZE];
+	size_t len = 0;
+
+	for (uint16_t x = r.x; x < r.x + r.width; x++) {
+		const uint8_t* bp = _fb.column(x) + ys;
+		for (uint16_t j = 0; j < n; j++) {
+			buf[len++] = bp[j];
+			if (len == sizeof(buf)) {
+				_ssd.sendData(buf, len);
+				len = 0;
+			}
+		}
+	}
+
+	if (len > 0)
+		_ssd.sendData(buf, len);
+}
+
+void EPD::sendChanges(const Rect& r)
+{
+	uint16_t ys = r.y >> 2;
+	uint16_t ye = ys + (r.height >> 2);
+	Rect win = { 0, 0, 0, 0 };
+
+	for (uint16_t x = r.x; x < r.x + r.width; x++) {
+		const uint8_t* np = _fb.column(x);
+		const uint8_t* pp = _prev.column(x);
+		uint16_t first = ys;
+		uint16_t last = ye;
+
+		// find the changed span of the column
+		while (first < ye && np[first] == pp[first])
+			first++;
+		if (first == ye)
+			continue;
+		while (np[last - 1] == pp[last - 1])
+			last--;
+
+		Rect col = { x, uint16_t(first << 2), 1, uint16_t((last - first) << 2) };
+
+		if (win.width == 0) {
+			win = col;
+			continue;
+		}
+
+		// extend the window as long as it is cheaper than a new one
+		uint16_t y0 = (win.y < col.y) ? win.y : col.y;
+		uint16_t y1 = (win.y + win.height > col.y + col.height) ? win.y + win.height : col.y + col.height;
+		Rect u = { win.x, y0, uint16_t(x + 1 - win.x), uint16_t(y1 - y0) };
+
+		if (cost(u) <= cost(win) + cost(col))
+			win = u;
+		else {
+			sendArea(win);
+			win = col;
+		}
+	}
+
+	if (win.width != 0)
+		sendArea(win);
+}
+
+void EPD::flush()
+{
+	commitDisplayList();
+	syncPresent(TIME_INFINITE);
+	flushBuffer();
+}
+
+void EPD::flushBuffer()
+{
+	if (!buffered() || _dirty.count == 0)
+		return;
+
+	uint32_t sent = _stats.sentBytes;
+	uint32_t dirty = 0;
+	bool diff = _prev.data() != NULL && _prevValid;
+
+	_ssd.select();
+
+	for (size_t i = 0; i < _dirty.count; i++) {
+		const Rect& r = _dirty.rects[i];
+
+		dirty += uint32_t(r.width) * (r.height >> 2);
+
+		if (diff)
+			sendChanges(r);
+		else
+			sendArea(r);
+
+		// remember what the RAM holds now
+		if (_prev.data() != NULL) {
+			for (uint16_t x = r.x; x < r.x + r.width; x++)
+				memcpy(_prev.column(x) + (r.y >> 2), _fb.column(x) + (r.y >> 2), r.height >> 2);
+		}
+	}
+
+	_ssd.unselect();
+
+	_dirty.count = 0;
+	_prevValid = _prev.data() != NULL;
+
+	_stats.flushes++;
+	_stats.dirtyBytes += dirty;
+	_stats.lastSaved = dirty - (_stats.sentBytes - sent);
 }
 
 void EPD::fillDisplay(Color color)
 {
-	uint8_t b = (color << 6) | (color << 4) | (color << 2) | (color << 0);
+	if (_list != NULL && recordRect(color, 0, 0, _width, _height))
+		return;
+
+	uint8_t b = colorByte(color);
+
+	if (buffered()) {
+		_fb.fill(b);
+		_dirty.count = 0;
+		markDirty(0, 0, _width, _height);
+		return;
+	}
 
 	_ssd.select();
 
 	// set address window
-	_ssd.setAddress(0, (_height >> 2) - 1, _width - 1, 0);
+	setWindow(0, 0, _width, _height);
 
 	// fill with color
-	for (uint32_t i = 0; i < uint32_t(_width * (_height >> 2)); i++)
-		_ssd.sendData(b);
+	_ssd.fillData(b, FrameBuffer::size(_width, _height));
 
 	_ssd.unselect();
 }
@@ -77,67 +383,262 @@ void EPD::setFont(const uint8_t* bp)
 			"ssd1606SetFont(), invalid font");
 
 	_fntp = bp;
+	_cfntp = NULL;
 }
 
-void EPD::drawBitmap(Color color, uint16_t x, uint16_t y, uint16_t width, uint16_t height, BmpFnc bmpFnc)
+void EPD::setFont(const CompiledFont& font)
 {
-	uint8_t xsa = y >> 2;
-	uint8_t xea = ((y + height + 3) >> 2) - 1;
-	uint16_t ysa = _width - 1 - x;
-	uint16_t yea = _width - 1 - (x - 1 + width);
+	osalDbgAssert(font.first_char <= font.last_char &&
+			font.height <= _height,
+			"EPD::setFont(), invalid font");
 
-	// set background color
-	uint8_t b = (_bkgColor << 6) | (_bkgColor << 4) | (_bkgColor << 2) | (_bkgColor << 0);
+	_cfntp = &font;
+}
 
-	_ssd.select();
+EPD::ColumnWriter::ColumnWriter(SSD16xx& ssd, uint16_t y, uint16_t height, Color bkgColor)
+: _ssd(ssd)
+, _y(y)
+, _bkg(colorByte(bkgColor))
+, _n(0)
+{
+	_head = (4 - (y & 0x03)) & 0x03;
+	if (_head > height)
+		_head = height;
+	_body = (height - _head) >> 2;
+	_tail = (height - _head) & 0x03;
+}
 
-	// set address window
-	_ssd.setAddress(xsa, xea, ysa, yea);
+template<typename Source, typename Out>
+void EPD::ColumnWriter::column(const Source& src, uint16_t w, Out out) const
+{
+	uint16_t h = 0;
 
-	// draw the character bitmap
-	for (uint16_t w = 0; w < width; w++) {
-		for (uint16_t h = 0; h < height; h++) {
-			if (bmpFnc(width, height, w, h)) {
-				// mask out background color
-				b &= ~(0x03 << ((3 - ((h + y) & 0x03)) << 1));
-				// set new color
-				b |= (color << ((3 - ((h + y) & 0x03)) << 1));
-			}
+	if (_head) {
+		uint8_t b = _bkg;
+		for (; h < _head; h++) {
+			uint8_t shift = (3 - ((h + _y) & 0x03)) << 1;
+			b = (b & ~(0x03 << shift)) | (src.color(w, h) << shift);
+		}
+		out(b);
+	}
 
-			// send data byte to RAM after each 4 pixels or at the last pixel
-			if (((h + y) & 0x03) == 0x03 || (h == (height - 1))) {
-				_ssd.sendData(b);
+	for (uint16_t i = 0; i < _body; i++, h += 4)
+		out(src.byte(w, h));
 
-				// set background color
-				b = (_bkgColor << 6) | (_bkgColor << 4) | (_bkgColor << 2) | (_bkgColor << 0);
-			}
+	if (_tail) {
+		uint8_t b = _bkg;
+		for (uint16_t i = 0; i < _tail; i++, h++) {
+			uint8_t shift = (3 - i) << 1;
+			b = (b & ~(0x03 << shift)) | (src.color(w, h) << shift);
 		}
+		out(b);
+	}
+}
+
+template<typename Source>
+void EPD::ColumnWriter::write(const Source& src, uint16_t w)
+{
+	column(src, w, [this](uint8_t b) { put(b); });
+}
+
+template<typename Source>
+uint8_t* EPD::ColumnWriter::pack(const Source& src, uint16_t w, uint8_t* bp) const
+{
+	column(src, w, [&bp](uint8_t b) { *bp++ = b; });
+	return bp;
+}
+
+void EPD::ColumnWriter::write(const uint8_t* bp, size_t n)
+{
+	// top up the transmit buffer first
+	if (_n > 0) {
+		size_t k = (n < sizeof(_buf) - _n) ? n : sizeof(_buf) - _n;
+
+		memcpy(_buf + _n, bp, k);
+		_n += k;
+		bp += k;
+		n -= k;
+		if (_n == sizeof(_buf))
+			flush();
+	}
+
+	// too big to buffer, send as is
+	if (n >= sizeof(_buf)) {
+		_ssd.sendData(bp, n);
+		return;
+	}
+
+	memcpy(_buf + _n, bp, n);
+	_n += n;
+}
+
+void EPD::ColumnWriter::fill(uint8_t b, size_t n)
+{
+	if (_n + n > sizeof(_buf)) {
+		flush();
+
+		// too big to buffer, send as a bulk fill
+		if (n >= sizeof(_buf)) {
+			_ssd.fillData(b, n);
+			return;
+		}
+	}
+
+	memset(_buf + _n, b, n);
+	_n += n;
+	if (_n == sizeof(_buf))
+		flush();
+}
+
+void EPD::ColumnWriter::flush()
+{
+	if (_n > 0) {
+		_ssd.sendData(_buf, _n);
+		_n = 0;
+	}
+}
+
+void EPD::setWindow(uint16_t x, uint16_t y, uint16_t width, uint16_t height)
+{
+	uint8_t xsa, xea;
+	uint16_t ysa, yea;
+
+	ramWindow(x, y, width, height, &xsa, &xea, &ysa, &yea);
+	_ssd.setAddress(xsa, xea, ysa, yea);
+}
+
+void EPD::ramWindow(uint16_t x, uint16_t y, uint16_t width, uint16_t height,
+		uint8_t* xsa, uint8_t* xea, uint16_t* ysa, uint16_t* yea) const
+{
+	// RAM x addresses hold 4 rows, RAM y addresses the columns
+	uint8_t first = y >> 2;
+	uint8_t last = ((y + height + 3) >> 2) - 1;
+
+	if (_orientation & ORIENTATION_MIRROR_Y) {
+		*xsa = (_height >> 2) - 1 - first;
+		*xea = (_height >> 2) - 1 - last;
+	}
+	else {
+		*xsa = first;
+		*xea = last;
+	}
+
+	if (_orientation & ORIENTATION_MIRROR_X) {
+		*ysa = x;
+		*yea = x - 1 + width;
 	}
+	else {
+		*ysa = _width - 1 - x;
+		*yea = _width - 1 - (x - 1 + width);
+	}
+}
+
+void EPD::startUpload(uint16_t x, uint16_t y, uint16_t width, uint16_t height, const uint8_t* bp,
+		bool update, SSD16xx::UpdateMode mode)
+{
+	osalDbgCheck(bp != NULL && width > 0 && height > 0 && (y & 0x03) == 0);
+	osalDbgAssert(x + width <= _width && y + height <= _height, "EPD::startUpload(), invalid area");
+	osalDbgAssert(!buffered(), "EPD::startUpload(), frame buffer in use");
+	osalDbgAssert(!(_orientation & ORIENTATION_MIRROR_Y), "EPD::startUpload(), mirrored vertically");
+
+	// recorded calls go first
+	commitDisplayList();
+
+	uint8_t xsa, xea;
+	uint16_t ysa, yea;
+
+	ramWindow(x, y, width, height, &xsa, &xea, &ysa, &yea);
+	_ssd.startUpload(xsa, xea, ysa, yea, bp, FrameBuffer::size(width, height), update, mode);
+}
+
+template<typename Source>
+void EPD::bufferBitmap(uint16_t x, uint16_t y, uint16_t width, uint16_t height, const Source& src)
+{
+	uint16_t ys = (y > _bandY) ? y : _bandY;
+	uint16_t ye = (y + height < _bandY + _fb.height()) ? y + height : _bandY + _fb.height();
+
+	if (ys >= ye)
+		return;
+
+	if (ys == y)
+		_fb.drawBitmap(x, y - _bandY, width, ye - ys, src);
+	else
+		_fb.drawBitmap(x, 0, width, ye - ys, OffsetSource<Source>{src, uint16_t(ys - y)});
+}
+
+void EPD::bufferRect(uint16_t x, uint16_t y, uint16_t width, uint16_t height, Color color)
+{
+	uint16_t ys = (y > _bandY) ? y : _bandY;
+	uint16_t ye = (y + height < _bandY + _fb.height()) ? y + height : _bandY + _fb.height();
+
+	if (ys < ye)
+		_fb.fillRect(x, ys - _bandY, width, ye - ys, color);
+}
+
+template<typename Source>
+void EPD::drawBitmap(uint16_t x, uint16_t y, uint16_t width, uint16_t height, const Source& src)
+{
+	if (buffered()) {
+		bufferBitmap(x, y, width, height, src);
+		markDirty(x, y, width, height);
+		return;
+	}
+
+	ColumnWriter cw(_ssd, y, height, _bkgColor);
+
+	_ssd.select();
+
+	// set address window
+	setWindow(x, y, width, height);
+
+	// draw the bitmap column by column
+	for (uint16_t w = 0; w < width; w++)
+		cw.write(src, w);
+
+	cw.flush();
 
 	_ssd.unselect();
 }
 
-size_t EPD::getTextWidth(const Font* fntp, const char* str)
+template<typename FontView>
+size_t EPD::textWidth(const FontView& font, const char* str)
 {
 	size_t width = 0;
 
 	while (*str != 0) {
-		if (fntp->header.first_char <= *str && *str <= fntp->header.last_char)
-			width += fntp->char_table[*str - fntp->header.first_char].width;
+		if (font.contains(*str))
+			width += font.width(*str);
 		str++;
 	}
 
 	return width;
 }
 
+size_t EPD::getTextWidth(const Font* fntp, const char* str)
+{
+	return textWidth(ImageFontView{fntp}, str);
+}
+
+size_t EPD::getTextWidth(const CompiledFont* fntp, const char* str)
+{
+	return textWidth(CompiledFontView{fntp}, str);
+}
+
 void EPD::drawText(Color color, uint16_t x, uint16_t y, const char* str, Align align)
 {
 	osalDbgCheck(str != NULL);
 
-	const Font* fntp = (const Font*)_fntp;
-	uint16_t height = fntp->header.height;
+	if (_cfntp != NULL)
+		drawText(CompiledFontView{_cfntp}, color, x, y, str, align);
+	else
+		drawText(ImageFontView{(const Font*)_fntp}, color, x, y, str, align);
+}
+
+template<typename FontView>
+void EPD::drawText(const FontView& font, Color color, uint16_t x, uint16_t y, const char* str, Align align)
+{
+	uint16_t height = font.height();
 	uint16_t width;
-	const uint8_t* bp;
 
 	// return if outside vertical display area
 	if (y + height > _height)
@@ -146,49 +647,612 @@ void EPD::drawText(Color color, uint16_t x, uint16_t y, const char* str, Align a
 	// adjust horizontal position based on alignment
 	switch (align) {
 	case ALIGN_CENTER: {
-		size_t textHalfWidth = (getTextWidth(fntp, str) >> 1);
+		size_t textHalfWidth = (textWidth(font, str) >> 1);
 		x -= (x < textHalfWidth) ? x : textHalfWidth;
 		break;
 	}
 	case ALIGN_RIGHT: {
-		size_t textWidth = getTextWidth(fntp, str);
-		x -= (x < textWidth) ? x : textWidth;
+		size_t fullWidth = textWidth(font, str);
+		x -= (x < fullWidth) ? x : fullWidth;
 		break;
 	}
 	default:
 		break;
 	}
 
-	while (*str != 0) {
-		if (fntp->header.first_char <= *str && *str <= fntp->header.last_char) {
-			width = fntp->char_table[*str - fntp->header.first_char].width;
-			bp = _fntp + fntp->char_table[*str - fntp->header.first_char].offset;
+	// find the glyphs fitting inside the horizontal display area
+	const char* end = str;
+	uint16_t runWidth = 0;
 
-			// return if outside horizontal display area
-			if (x + width > _width)
-				return;
+	for (; *end != 0; end++) {
+		if (font.contains(*end)) {
+			width = font.width(*end);
+			if (x + runWidth + width > _width)
+				break;
+			runWidth += width;
+		}
+	}
 
-			BmpFnc bmpFnc = [bp](uint16_t width, uint16_t height, uint16_t w, uint16_t h) -> bool {
-				(void) height;
-				return bool((bp[(h * ((width + 7) & 0xF8) + (w & 0xF8)) >> 3] >> (w & 0x07)) & 0x01);
-			};
+	if (runWidth == 0)
+		return;
+
+	if (_list != NULL && recordText(color, x, y, runWidth, height,
+			font.key(), FontView::compiled, str, end - str))
+		return;
 
-			drawBitmap(color, x, y, width, height, bmpFnc);
-			x += width;
+	if (buffered()) {
+		for (; str < end; str++) {
+			if (font.contains(*str)) {
+				width = font.width(*str);
+
+				bufferBitmap(x, y, width, height, font.glyph(*str, color, _bkgColor));
+				x += width;
+			}
 		}
-		str++;
+		markDirty(x - runWidth, y, runWidth, height);
+		return;
 	}
+
+	ColumnWriter cw(_ssd, y, height, _bkgColor);
+
+	_ssd.select();
+
+	// set address window of the whole run
+	setWindow(x, y, runWidth, height);
+
+	// stream the glyph columns
+	for (; str < end; str++) {
+		if (font.contains(*str)) {
+			width = font.width(*str);
+
+			auto src = font.glyph(*str, color, _bkgColor);
+
+			if (_glyphs == NULL) {
+				for (uint16_t w = 0; w < width; w++)
+					cw.write(src, w);
+				continue;
+			}
+
+			// send the packed glyph from the cache, pack it on a miss
+			size_t n = width * cw.columnBytes();
+			const uint8_t* cp = _glyphs->find(font.key(), *str, color, _bkgColor, y & 0x03);
+
+			if (cp == NULL) {
+				uint8_t* gp = _glyphs->insert(font.key(), *str, color, _bkgColor, y & 0x03, n);
+
+				if (gp == NULL) {
+					for (uint16_t w = 0; w < width; w++)
+						cw.write(src, w);
+					continue;
+				}
+
+				cp = gp;
+				for (uint16_t w = 0; w < width; w++)
+					gp = cw.pack(src, w, gp);
+			}
+
+			cw.write(cp, n);
+		}
+	}
+
+	cw.flush();
+
+	_ssd.unselect();
 }
 
 void EPD::drawFilledRect(Color color, uint16_t x, uint16_t y, uint16_t width, uint16_t height)
 {
-	BmpFnc bmpFnc = [](uint16_t width, uint16_t height, uint16_t w, uint16_t h) -> bool {
-		(void) width;
-		(void) height;
-		(void) w;
-		(void) h;
+	if (_list != NULL && recordRect(color, x, y, width, height))
+		return;
+
+	if (buffered()) {
+		bufferRect(x, y, width, height, color);
+		markDirty(x, y, width, height);
+		return;
+	}
+
+	drawBitmap(x, y, width, height, SolidSource(color));
+}
+
+template<typename Shape>
+void EPD::drawShape(Color color, Rect bounds, Shape shape)
+{
+	auto clip = [](int16_t& x, int16_t& y, int16_t& width, int16_t& height,
+			int16_t left, int16_t top, int16_t right, int16_t bottom) {
+		if (x < left) {
+			width -= left - x;
+			x = left;
+		}
+		if (y < top) {
+			height -= top - y;
+			y = top;
+		}
+		if (x + width > right)
+			width = right - x;
+		if (y + height > bottom)
+			height = bottom - y;
+		return width > 0 && height > 0;
+	};
+
+	if (bounds.width == 0 || bounds.height == 0)
+		return;
+
+	// shapes are not recorded, keep the drawing order
+	commitDisplayList();
+
+	if (buffered()) {
+		shape([&](int16_t x, int16_t y, int16_t width, int16_t height) {
+			if (clip(x, y, width, height, 0, 0, _width, _height))
+				bufferRect(x, y, width, height, color);
+		});
+
+		markDirty(bounds.x, bounds.y, bounds.width, bounds.height);
+		return;
+	}
+
+	// rasterize column strips of the byte aligned bounds over the
+	// background, only the RAM bytes touched by the shape are sent
+	uint8_t buf[EPD_SHAPE_BUFFER_SIZE];
+	uint8_t touched[(EPD_SHAPE_BUFFER_SIZE + 7) >> 3];
+	uint16_t top = bounds.y & ~0x03;
+	uint16_t rows = bounds.y + bounds.height - top;
+	size_t stride = FrameBuffer::size(1, rows);
+	uint16_t cols = sizeof(buf) / stride;
+	uint16_t right = bounds.x + bounds.width;
+
+	osalDbgAssert(cols > 0, "EPD::drawShape(), shape buffer too small");
+
+	_ssd.select();
+
+	for (uint16_t left = bounds.x; left < right; left += cols) {
+		uint16_t width = (right - left < cols) ? right - left : cols;
+		FrameBuffer strip(buf, width, rows);
+
+		strip.fill(colorByte(_bkgColor));
+		memset(touched, 0, sizeof(touched));
+
+		shape([&](int16_t x, int16_t y, int16_t w, int16_t h) {
+			if (!clip(x, y, w, h, left, top, left + width, top + rows))
+				return;
+
+			strip.fillRect(x - left, y - top, w, h, color);
+
+			for (int16_t i = x - left; i < x - left + w; i++) {
+				for (int16_t b = (y - top) >> 2; b <= (y - top + h - 1) >> 2; b++) {
+					size_t n = i * stride + b;
+					touched[n >> 3] |= 1 << (n & 0x07);
+				}
+			}
+		});
+
+		sendShapeStrip(strip, touched, left, top);
+	}
+
+	_ssd.unselect();
+}
+
+void EPD::sendShapeStrip(const FrameBuffer& strip, const uint8_t* touched, uint16_t left, uint16_t top)
+{
+	uint16_t stride = strip.stride();
+	uint8_t tx[EPD_TX_BUFFER_SIZE];
+
+	auto bit = [&](uint16_t i, uint16_t b) {
+		size_t n = size_t(i) * stride + b;
+		return (touched[n >> 3] >> (n & 0x07)) & 0x01;
+	};
+	auto same = [&](uint16_t i, uint16_t j) {
+		for (uint16_t b = 0; b < stride; b++) {
+			if (bit(i, b) != bit(j, b))
+				return false;
+		}
 		return true;
 	};
 
-	drawBitmap(color, x, y, width, height, bmpFnc);
+	uint16_t first = 0;
+
+	for (uint16_t i = 1; i <= strip.width(); i++) {
+		// columns first..i-1 touch the same bytes
+		if (i < strip.width() && same(first, i))
+			continue;
+
+		for (uint16_t b = 0; b < stride; b++) {
+			if (!bit(first, b))
+				continue;
+
+			uint16_t e = b;
+			while (e + 1 < stride && bit(first, e + 1))
+				e++;
+
+			uint16_t height = (e + 1 - b) << 2;
+			if (height > strip.height() - (b << 2))
+				height = strip.height() - (b << 2);
+
+			setWindow(left + first, top + (b << 2), i - first, height);
+
+			size_t n = 0;
+			for (uint16_t c = first; c < i; c++) {
+				for (uint16_t k = b; k <= e; k++) {
+					tx[n++] = strip.column(c)[k];
+					if (n == sizeof(tx)) {
+						_ssd.sendData(tx, n);
+						n = 0;
+					}
+				}
+			}
+			if (n > 0)
+				_ssd.sendData(tx, n);
+
+			b = e;
+		}
+
+		first = i;
+	}
+}
+
+/**
+ * @brief	Bounding box of a shape clipped to the display.
+ */
+static EPD::Rect shapeBounds(int32_t xs, int32_t ys, int32_t xe, int32_t ye, uint16_t width, uint16_t height)
+{
+	xs = (xs < 0) ? 0 : xs;
+	ys = (ys < 0) ? 0 : ys;
+	xe = (xe >= width) ? width - 1 : xe;
+	ye = (ye >= height) ? height - 1 : ye;
+
+	if (xs > xe || ys > ye)
+		return EPD::Rect{ 0, 0, 0, 0 };
+
+	return EPD::Rect{ uint16_t(xs), uint16_t(ys), uint16_t(xe - xs + 1), uint16_t(ye - ys + 1) };
+}
+
+/**
+ * @brief	Sine of 0 to 90 degrees, 1.0 = 16384.
+ */
+static const int16_t sine[91] = {
+	    0,   286,   572,   857,  1143,  1428,  1713,  1997,  2280,  2563,
+	 2845,  3126,  3406,  3686,  3964,  4240,  4516,  4790,  5063,  5334,
+	 5604,  5872,  6138,  6402,  6664,  6924,  7182,  7438,  7692,  7943,
+	 8192,  8438,  8682,  8923,  9162,  9397,  9630,  9860, 10087, 10311,
+	10531, 10749, 10963, 11174, 11381, 11585, 11786, 11982, 12176, 12365,
+	12551, 12733, 12911, 13085, 13255, 13421, 13583, 13741, 13894, 14044,
+	14189, 14330, 14466, 14598, 14726, 14849, 14968, 15082, 15191, 15296,
+	15396, 15491, 15582, 15668, 15749, 15826, 15897, 15964, 16026, 16083,
+	16135, 16182, 16225, 16262, 16294, 16322, 16344, 16362, 16374, 16382,
+	16384,
+};
+
+/**
+ * @brief	Get the screen direction of an angle, y pointing down.
+ */
+static void direction(uint16_t angle, int32_t* x, int32_t* y)
+{
+	angle %= 360;
+
+	uint16_t q = angle % 90;
+	int32_t c = sine[90 - q];
+	int32_t s = sine[q];
+
+	switch (angle / 90) {
+	case 0:
+		*x = c;
+		*y = -s;
+		break;
+	case 1:
+		*x = -s;
+		*y = -c;
+		break;
+	case 2:
+		*x = -c;
+		*y = s;
+		break;
+	default:
+		*x = s;
+		*y = c;
+		break;
+	}
+}
+
+/**
+ * @name	Shape rasterizers passed to EPD::drawShape()
+ * @{
+ */
+struct LineShape {
+	int16_t x0, y0, x1, y1;
+
+	template<typename R>
+	void operator()(R rect) const { shapeLine(x0, y0, x1, y1, rect); }
+};
+
+struct OutlineShape {
+	int16_t x, y, width, height;
+
+	template<typename R>
+	void operator()(R rect) const {
+		rect(x, y, width, 1);
+		rect(x, y + height - 1, width, 1);
+		rect(x, y + 1, 1, height - 2);
+		rect(x + width - 1, y + 1, 1, height - 2);
+	}
+};
+
+struct CircleShape {
+	int16_t x, y, r;
+
+	template<typename R>
+	void operator()(R rect) const { shapeCircle(x, y, r, rect); }
+};
+
+struct ArcShape {
+	int16_t x, y, r;
+	int32_t sx, sy, ex, ey;
+
+	template<typename R>
+	void operator()(R rect) const { shapeArc(x, y, r, sx, sy, ex, ey, rect); }
+};
+/** @} */
+
+void EPD::drawLine(Color color, uint16_t x0, uint16_t y0, uint16_t x1, uint16_t y1)
+{
+	LineShape line{ int16_t(x0), int16_t(y0), int16_t(x1), int16_t(y1) };
+	Rect bounds = shapeBounds((line.x0 < line.x1) ? line.x0 : line.x1, (line.y0 < line.y1) ? line.y0 : line.y1,
+			(line.x0 < line.x1) ? line.x1 : line.x0, (line.y0 < line.y1) ? line.y1 : line.y0, _width, _height);
+
+	drawShape(color, bounds, line);
+}
+
+void EPD::drawRect(Color color, uint16_t x, uint16_t y, uint16_t width, uint16_t height)
+{
+	if (width == 0 || height == 0)
+		return;
+
+	Rect bounds = shapeBounds(int16_t(x), int16_t(y), int16_t(x) + width - 1, int16_t(y) + height - 1,
+			_width, _height);
+
+	drawShape(color, bounds, OutlineShape{ int16_t(x), int16_t(y), int16_t(width), int16_t(height) });
+}
+
+void EPD::drawCircle(Color color, uint16_t x, uint16_t y, uint16_t r)
+{
+	Rect bounds = shapeBounds(int16_t(x) - r, int16_t(y) - r, int16_t(x) + r, int16_t(y) + r,
+			_width, _height);
+
+	drawShape(color, bounds, CircleShape{ int16_t(x), int16_t(y), int16_t(r) });
+}
+
+void EPD::drawArc(Color color, uint16_t x, uint16_t y, uint16_t r, uint16_t start, uint16_t end)
+{
+	Rect bounds = shapeBounds(int16_t(x) - r, int16_t(y) - r, int16_t(x) + r, int16_t(y) + r,
+			_width, _height);
+	int32_t sx, sy, ex, ey;
+
+	direction(start, &sx, &sy);
+	direction(end, &ex, &ey);
+
+	drawShape(color, bounds, ArcShape{ int16_t(x), int16_t(y), int16_t(r), sx, sy, ex, ey });
+}
+
+void EPD::drawImage(uint16_t x, uint16_t y, uint16_t width, uint16_t height, const uint8_t* bp)
+{
+	osalDbgCheck(bp != NULL);
+	osalDbgAssert(x + width <= _width && y + height <= _height, "EPD::drawImage(), invalid area");
+
+	if (width == 0 || height == 0)
+		return;
+
+	// images are not recorded, keep the drawing order
+	commitDisplayList();
+
+	ImageSource src(bp, height);
+
+	if (buffered() || (y & 0x03) != 0 || ((height & 0x03) != 0 && y + height < _height)) {
+		drawBitmap(x, y, width, height, src);
+		return;
+	}
+
+	// already in the RAM layout, send in place
+	_ssd.select();
+
+	setWindow(x, y, width, height);
+
+	_ssd.sendData(bp, FrameBuffer::size(width, height));
+
+	_ssd.unselect();
+}
+
+void EPD::drawImage(uint16_t x, uint16_t y, const RleImage& image)
+{
+	osalDbgCheck(image.data != NULL);
+	osalDbgAssert(x + image.width <= _width && y + image.height <= _height,
+			"EPD::drawImage(), invalid area");
+
+	if (image.width == 0 || image.height == 0)
+		return;
+
+	// images are not recorded, keep the drawing order
+	commitDisplayList();
+
+	if (buffered() || (y & 0x03) != 0 || ((image.height & 0x03) != 0 && y + image.height < _height)) {
+		drawBitmap(x, y, image.width, image.height, RleSource(image));
+		return;
+	}
+
+	ColumnWriter cw(_ssd, y, image.height, _bkgColor);
+	RleDecoder dec(image.data, image.size, (image.height + 3) >> 2);
+	size_t n = FrameBuffer::size(image.width, image.height);
+	const uint8_t* lit;
+	uint8_t value;
+	size_t len;
+
+	_ssd.select();
+
+	setWindow(x, y, image.width, image.height);
+
+	// decode run by run into the transmit buffer
+	while (n > 0 && (len = dec.next(&lit, &value, n)) > 0) {
+		if (lit != NULL)
+			cw.write(lit, len);
+		else
+			cw.fill(value, len);
+		n -= len;
+	}
+
+	// a malformed stream leaves background, the RAM window stays consistent
+	if (n > 0)
+		cw.fill(colorByte(_bkgColor), n);
+
+	cw.flush();
+
+	_ssd.unselect();
+}
+
+void EPD::setDisplayList(DisplayList* list)
+{
+	commitDisplayList();
+	_list = list;
+}
+
+bool EPD::recordRect(Color color, uint16_t x, uint16_t y, uint16_t width, uint16_t height)
+{
+	if (_list->addRect(x, y, width, height, color, _bkgColor))
+		return true;
+
+	commitDisplayList();
+
+	return _list->addRect(x, y, width, height, color, _bkgColor);
+}
+
+bool EPD::recordText(Color color, uint16_t x, uint16_t y, uint16_t width, uint16_t height,
+		const void* font, bool compiled, const char* str, size_t n)
+{
+	if (_list->addText(x, y, width, height, color, _bkgColor, font, compiled, str, n))
+		return true;
+
+	commitDisplayList();
+
+	return _list->addText(x, y, width, height, color, _bkgColor, font, compiled, str, n);
+}
+
+void EPD::replayDisplayList(const DisplayList& list)
+{
+	for (size_t i = 0; i < list.count(); i++) {
+		const DisplayList::Item& it = list.item(i);
+
+		// skip calls outside the band
+		if (_banding && (it.y >= _bandY + _fb.height() || it.y + it.height <= _bandY))
+			continue;
+
+		_bkgColor = Color(it.bkgColor);
+
+		if (it.type == DisplayList::ITEM_RECT) {
+			drawFilledRect(Color(it.color), it.x, it.y, it.width, it.height);
+			continue;
+		}
+
+		if (it.compiled)
+			drawText(CompiledFontView{(const CompiledFont*)it.font}, Color(it.color),
+					it.x, it.y, list.text(it), ALIGN_LEFT);
+		else
+			drawText(ImageFontView{(const Font*)it.font}, Color(it.color),
+					it.x, it.y, list.text(it), ALIGN_LEFT);
+	}
+}
+
+void EPD::commitDisplayList()
+{
+	if (_list == NULL || _list->count() == 0)
+		return;
+
+	// draw the recorded calls for real
+	DisplayList* list = _list;
+	Color bkgColor = _bkgColor;
+	_list = NULL;
+
+	list->optimize(!buffered());
+
+	if (!buffered())
+		_ssd.acquireBus();
+
+	replayDisplayList(*list);
+
+	if (!buffered())
+		_ssd.releaseBus();
+
+	list->countReplayed(list->count());
+	list->clear();
+
+	_bkgColor = bkgColor;
+	_list = list;
+}
+
+void EPD::renderBands(uint8_t* bp0, uint8_t* bp1, uint16_t rows, RenderCallback cb, void* arg)
+{
+	osalDbgCheck(bp0 != NULL && bp0 != bp1 && cb != NULL && rows > 0 && (rows & 0x03) == 0);
+	osalDbgAssert(!buffered(), "EPD::renderBands(), frame buffer in use");
+
+	commitDisplayList();
+
+	// draw for real into the bands
+	DisplayList* list = _list;
+	Color bkgColor = _bkgColor;
+	_list = NULL;
+	_banding = true;
+
+	_ssd.acquireBus();
+
+	for (_bandY = 0; _bandY < _height; _bandY += rows) {
+		uint16_t height = (_height - _bandY < rows) ? _height - _bandY : rows;
+
+		// the previous band may still be on the wire from the other buffer
+		uint8_t* bp = (bp1 != NULL && ((_bandY / rows) & 1)) ? bp1 : bp0;
+
+		_fb = FrameBuffer(bp, _width, height);
+		_fb.fill(colorByte(bkgColor));
+		_bkgColor = bkgColor;
+
+		cb(this, arg);
+
+		// uploads send the band as is, vertical mirroring needs it reversed
+		if (bp1 != NULL && !(_orientation & ORIENTATION_MIRROR_Y)) {
+			uint8_t xsa, xea;
+			uint16_t ysa, yea;
+
+			ramWindow(0, _bandY, _width, height, &xsa, &xea, &ysa, &yea);
+			_ssd.startUpload(xsa, xea, ysa, yea, bp, _fb.size(_width, height));
+			continue;
+		}
+
+		_ssd.select();
+		setWindow(0, _bandY, _width, height);
+		_ssd.sendData(bp, _fb.size(_width, height));
+		_ssd.unselect();
+	}
+
+	_ssd.releaseBus();
+
+	_fb = FrameBuffer(NULL, _width, _height);
+	_dirty.count = 0;
+	_bandY = 0;
+	_banding = false;
+	_bkgColor = bkgColor;
+	_list = list;
+}
+
+void EPD::replayBand(EPD* epd, void* arg)
+{
+	epd->replayDisplayList(*(const DisplayList*)arg);
+}
+
+void EPD::renderBands(uint8_t* bp0, uint8_t* bp1, uint16_t rows, DisplayList& list)
+{
+	// the list may be the one recording
+	DisplayList* recording = _list;
+	if (recording == &list)
+		_list = NULL;
+
+	list.optimize(false);
+	renderBands(bp0, bp1, rows, replayBand, &list);
+	list.countReplayed(list.count());
+	list.clear();
+
+	_list = recording;
 }
@@ -21,7 +21,44 @@
 #define EINK_CLICK_EPD_HPP_
 
 #include "ssd16xx.hpp"
-#include <functional>
+#include "framebuffer.hpp"
+#include "glyphcache.hpp"
+#include "fontcompiler.hpp"
+#include "displaylist.hpp"
+#include "rle.hpp"
+#include "shapes.hpp"
+
+/**
+ * @brief	Size of the buffer used to pack RAM data before sending.
+ * @details	Bigger buffers need less SPI transfers per drawing.
+ */
+#if !defined(EPD_TX_BUFFER_SIZE)
+#define EPD_TX_BUFFER_SIZE		64
+#endif
+
+/**
+ * @brief	Size of the buffer used to rasterize shapes in direct mode.
+ * @details	Must hold at least one display column of RAM data.
+ */
+#if !defined(EPD_SHAPE_BUFFER_SIZE)
+#define EPD_SHAPE_BUFFER_SIZE	256
+#endif
+
+/**
+ * @brief	Maximum number of dirty rectangles tracked in buffered mode.
+ */
+#if !defined(EPD_DIRTY_RECTS)
+#define EPD_DIRTY_RECTS			8
+#endif
+
+/**
+ * @brief	Cost of setting a RAM address window in bytes.
+ * @details	Dirty rectangles are merged when sending their union costs
+ * 			less than sending both with a window each.
+ */
+#if !defined(EPD_WINDOW_COST)
+#define EPD_WINDOW_COST			16
+#endif
 
 class EPD {
 public:
@@ -44,6 +81,27 @@ public:
 		ALIGN_RIGHT = 2		///< Right horizontal alignment.
 	} Align;
 
+	/**
+	 * @brief	Display orientation.
+	 * @details	Mirroring both axis rotates the display by 180 degrees.
+	 * 			Each orientation is a RAM scan direction, the pixels keep
+	 * 			being sent column by column.
+	 *
+	 * 			Mirroring horizontally only changes the RAM windows, it
+	 * 			costs nothing per pixel. Mirroring vertically makes the x
+	 * 			address decrement, so SSD16xx::sendData() and fillData()
+	 * 			reverse the 4 pixels of every RAM byte they send, through
+	 * 			a copy for buffers. The DMA path of startUpload() needs
+	 * 			an incrementing x address and is not available, band
+	 * 			rendering then sends each band blocking.
+	 */
+	typedef enum {
+		ORIENTATION_NORMAL = 0,		///< Display x runs along decrementing gates.
+		ORIENTATION_MIRROR_X = 1,	///< Mirrored horizontally.
+		ORIENTATION_MIRROR_Y = 2,	///< Mirrored vertically, the height must be a multiple of 4.
+		ORIENTATION_ROTATE_180 = 3,	///< Rotated by 180 degrees.
+	} Orientation;
+
 	/**
 	 * @brief	Defines the font character range, height etc...
 	 */
@@ -73,44 +131,533 @@ public:
 		CharTable char_table[];	///< Font character table.
 	} Font;
 
+	/**
+	 * @brief	Display area.
+	 */
+	typedef struct {
+		uint16_t x;				///< Horizontal start location.
+		uint16_t y;				///< Vertical start location.
+		uint16_t width;			///< Area width.
+		uint16_t height;		///< Area height.
+	} Rect;
+
+	/**
+	 * @brief	Native 2bpp image.
+	 * @details	Pixels are stored column by column in the controller RAM
+	 * 			layout, 4 vertical pixels per byte with the topmost pixel
+	 * 			in the most significant bits, see FrameBuffer. The host
+	 * 			tool tools/epdimage.cpp converts PGM files to this format.
+	 */
+	typedef struct {
+		uint16_t width;			///< Image width.
+		uint16_t height;		///< Image height.
+		const uint8_t* data;	///< FrameBuffer::size(width, height) bytes of pixels.
+	} Image;
+
+	/**
+	 * @brief	Run-length encoded native 2bpp image.
+	 * @details	The RAM bytes of an Image encoded as described by
+	 * 			RleDecoder, see tools/epdimage.cpp.
+	 */
+	typedef struct {
+		uint16_t width;			///< Image width.
+		uint16_t height;		///< Image height.
+		size_t size;			///< Encoded size in bytes.
+		const uint8_t* data;	///< Encoded pixels.
+	} RleImage;
+
+	/**
+	 * @brief	Shadow frame buffer upload statistics.
+	 */
+	typedef struct {
+		uint32_t flushes;		///< Number of flushes sending data.
+		uint32_t windows;		///< Number of RAM address windows set.
+		uint32_t dirtyBytes;	///< RAM bytes inside the dirty areas.
+		uint32_t sentBytes;		///< RAM bytes sent.
+		uint32_t lastSaved;		///< RAM bytes saved by the last flush.
+	} FlushStats;
+
 private:
 	/**
-	 * @brief	Defines bitmap function.
+	 * @brief	Solid color pixel source.
+	 */
+	struct SolidSource {
+		uint8_t fill;			///< Color replicated to 4 pixels.
+
+		SolidSource(Color color) : fill(colorByte(color)) {}
+		uint8_t color(uint16_t w, uint16_t h) const { (void) w; (void) h; return fill & 0x03; }
+		uint8_t byte(uint16_t w, uint16_t h) const { (void) w; (void) h; return fill; }
+	};
+
+	/**
+	 * @brief	1bpp row-major glyph pixel source (Microchip AN1182).
+	 * @details	Set bits are drawn with the drawing color, clear bits
+	 * 			with the background color.
+	 */
+	struct GlyphSource {
+		const uint8_t* bp;		///< Glyph image.
+		uint16_t stride;		///< Bytes per glyph row.
+		uint8_t fg;				///< Drawing color replicated to 4 pixels.
+		uint8_t bg;				///< Background color replicated to 4 pixels.
+
+		GlyphSource(const uint8_t* bp, uint16_t width, Color color, Color bkgColor)
+		: bp(bp), stride((width + 7) >> 3), fg(colorByte(color)), bg(colorByte(bkgColor)) {}
+
+		bool bit(uint16_t w, uint16_t h) const {
+			return (bp[h * stride + (w >> 3)] >> (w & 0x07)) & 0x01;
+		}
+		uint8_t color(uint16_t w, uint16_t h) const {
+			return (bit(w, h) ? fg : bg) & 0x03;
+		}
+		uint8_t byte(uint16_t w, uint16_t h) const {
+			uint8_t mask = (bit(w, h) ? 0xC0 : 0) | (bit(w, h + 1) ? 0x30 : 0) |
+					(bit(w, h + 2) ? 0x0C : 0) | (bit(w, h + 3) ? 0x03 : 0);
+			return (fg & mask) | (bg & ~mask);
+		}
+	};
+
+	/**
+	 * @brief	Compiled font glyph pixel source.
+	 * @details	Set pixels are drawn with the drawing color, clear pixels
+	 * 			with the background color.
+	 * @see		CompiledFont
+	 */
+	struct CompiledGlyphSource {
+		const uint8_t* bp;		///< Glyph columns.
+		uint16_t stride;		///< Bytes per glyph column.
+		uint8_t fg;				///< Drawing color replicated to 4 pixels.
+		uint8_t bg;				///< Background color replicated to 4 pixels.
+
+		CompiledGlyphSource(const uint8_t* bp, uint16_t stride, Color color, Color bkgColor)
+		: bp(bp), stride(stride), fg(colorByte(color)), bg(colorByte(bkgColor)) {}
+
+		uint8_t color(uint16_t w, uint16_t h) const {
+			uint8_t mask = bp[w * stride + (h >> 2)] >> ((3 - (h & 0x03)) << 1);
+			return ((fg & mask) | (bg & ~mask)) & 0x03;
+		}
+		uint8_t byte(uint16_t w, uint16_t h) const {
+			const uint8_t* cp = bp + w * stride + (h >> 2);
+			uint8_t s = (h & 0x03) << 1;
+			uint8_t mask = s ? uint8_t((cp[0] << s) | (cp[1] >> (8 - s))) : cp[0];
+			return (fg & mask) | (bg & ~mask);
+		}
+	};
+
+	/**
+	 * @brief	Microchip AN1182 font accessors used by drawText().
 	 */
-	typedef std::function<bool(uint16_t width, uint16_t height, uint16_t w, uint16_t h)> BmpFnc;
+	struct ImageFontView {
+		const Font* fntp;		///< Font image.
+
+		static constexpr bool compiled = false;
+
+		const void* key() const { return fntp; }
+		uint16_t height() const { return fntp->header.height; }
+		bool contains(char c) const { return fntp->header.first_char <= c && c <= fntp->header.last_char; }
+		uint16_t width(char c) const { return fntp->char_table[c - fntp->header.first_char].width; }
+		GlyphSource glyph(char c, Color color, Color bkgColor) const {
+			return GlyphSource((const uint8_t*)fntp + fntp->char_table[c - fntp->header.first_char].offset,
+					width(c), color, bkgColor);
+		}
+	};
+
+	/**
+	 * @brief	Compiled font accessors used by drawText().
+	 */
+	struct CompiledFontView {
+		const CompiledFont* fntp;	///< Compiled font.
+
+		static constexpr bool compiled = true;
+
+		const void* key() const { return fntp; }
+		uint16_t height() const { return fntp->height; }
+		bool contains(char c) const { return fntp->first_char <= c && c <= fntp->last_char; }
+		uint16_t width(char c) const { return fntp->widths[c - fntp->first_char]; }
+		CompiledGlyphSource glyph(char c, Color color, Color bkgColor) const {
+			return CompiledGlyphSource(fntp->data + fntp->columns[c - fntp->first_char] * fntp->stride,
+					fntp->stride, color, bkgColor);
+		}
+	};
+
+	/**
+	 * @brief	Native 2bpp pixel source.
+	 * @details	The image is stored column by column in the controller RAM
+	 * 			layout, 4 vertical pixels per byte with the topmost pixel
+	 * 			in the most significant bits.
+	 */
+	struct ImageSource {
+		const uint8_t* bp;		///< Image data.
+		uint16_t stride;		///< Bytes per image column.
+
+		ImageSource(const uint8_t* bp, uint16_t height)
+		: bp(bp), stride((height + 3) >> 2) {}
+
+		uint8_t color(uint16_t w, uint16_t h) const {
+			return (bp[w * stride + (h >> 2)] >> ((3 - (h & 0x03)) << 1)) & 0x03;
+		}
+		uint8_t byte(uint16_t w, uint16_t h) const {
+			const uint8_t* cp = bp + w * stride + (h >> 2);
+			uint8_t s = (h & 0x03) << 1;
+			return s ? uint8_t((cp[0] << s) | (cp[1] >> (8 - s))) : cp[0];
+		}
+	};
+
+	/**
+	 * @brief	Run-length encoded native 2bpp pixel source.
+	 * @details	Decodes one column at a time, the columns have to be read
+	 * 			in ascending order. Going back restarts the decoder.
+	 */
+	struct RleSource {
+		mutable RleDecoder dec;		///< Image decoder.
+		uint16_t stride;			///< Bytes per image column.
+		mutable uint16_t next;		///< Number of decoded columns.
+
+		RleSource(const RleImage& image)
+		: dec(image.data, image.size, (image.height + 3) >> 2), stride((image.height + 3) >> 2), next(0) {}
+
+		const uint8_t* load(uint16_t w) const {
+			if (w + 1 < next) {
+				dec.reset();
+				next = 0;
+			}
+			for (; next <= w; next++)
+				dec.read(NULL, stride);
+			return dec.column();
+		}
+		uint8_t color(uint16_t w, uint16_t h) const {
+			return (load(w)[h >> 2] >> ((3 - (h & 0x03)) << 1)) & 0x03;
+		}
+		uint8_t byte(uint16_t w, uint16_t h) const {
+			const uint8_t* cp = load(w) + (h >> 2);
+			uint8_t s = (h & 0x03) << 1;
+			return s ? uint8_t((cp[0] << s) | (cp[1] >> (8 - s))) : cp[0];
+		}
+	};
+
+	/**
+	 * @brief	Pixel source shifted down by @p dh rows.
+	 * @details	Draws the lower part of a bitmap clipped at its top.
+	 */
+	template<typename Source>
+	struct OffsetSource {
+		const Source& src;		///< Underlying pixel source.
+		uint16_t dh;			///< Rows clipped at the top.
+
+		uint8_t color(uint16_t w, uint16_t h) const { return src.color(w, h + dh); }
+		uint8_t byte(uint16_t w, uint16_t h) const { return src.byte(w, h + dh); }
+	};
+
+	/**
+	 * @brief	Packs bitmap columns into RAM bytes and streams them to
+	 * 			the SSD16xx.
+	 * @details	Each column is split into a partial top byte, whole bytes
+	 * 			and a partial bottom byte. The pixel source provides the 2
+	 * 			bit color of a single pixel through @p color(w, h) and 4
+	 * 			vertical pixels packed into a RAM byte through
+	 * 			@p byte(w, h). Only the partial bytes are built pixel by
+	 * 			pixel, pixels outside the bitmap get the background color.
+	 */
+	class ColumnWriter {
+		SSD16xx& _ssd;					///< Underlying SSD16xx IC.
+		uint16_t _y;					///< Vertical display start location.
+		uint16_t _head;					///< Pixels in the partial top byte.
+		uint16_t _body;					///< Whole bytes per column.
+		uint16_t _tail;					///< Pixels in the partial bottom byte.
+		uint8_t _bkg;					///< Background color replicated to 4 pixels.
+		uint8_t _buf[EPD_TX_BUFFER_SIZE];	///< Transmit buffer.
+		size_t _n;						///< Bytes in the transmit buffer.
+
+		void put(uint8_t b) {
+			_buf[_n++] = b;
+			if (_n == sizeof(_buf))
+				flush();
+		}
+
+		/**
+		 * @brief	Pack column @p w of the pixel source into RAM bytes
+		 * 			passed one by one to @p out.
+		 */
+		template<typename Source, typename Out>
+		void column(const Source& src, uint16_t w, Out out) const;
+
+	public:
+		ColumnWriter(SSD16xx& ssd, uint16_t y, uint16_t height, Color bkgColor);
+
+		/** @brief	Get the number of RAM bytes per column. */
+		size_t columnBytes() const { return (_head ? 1 : 0) + _body + (_tail ? 1 : 0); }
+
+		/**
+		 * @brief	Write column @p w of the pixel source.
+		 */
+		template<typename Source>
+		void write(const Source& src, uint16_t w);
+
+		/**
+		 * @brief	Write already packed RAM bytes.
+		 */
+		void write(const uint8_t* bp, size_t n);
+
+		/**
+		 * @brief	Write a RAM byte @p n times.
+		 */
+		void fill(uint8_t b, size_t n);
+
+		/**
+		 * @brief	Pack column @p w of the pixel source into memory.
+		 *
+		 * @returns	Pointer past the last packed byte.
+		 */
+		template<typename Source>
+		uint8_t* pack(const Source& src, uint16_t w, uint8_t* bp) const;
+
+		/**
+		 * @brief	Send the buffered RAM bytes.
+		 */
+		void flush();
+	};
+
+	/**
+	 * @brief	Changed areas of a frame buffer.
+	 */
+	typedef struct {
+		Rect rects[EPD_DIRTY_RECTS];	///< Changed areas.
+		size_t count;					///< Number of changed areas.
+	} DirtyList;
 
 	SSD16xx& _ssd;			///< Underlying SSD16xx IC.
 	const uint16_t _width;	///< Display width in pixels.
 	const uint16_t _height;	///< Display height in pixels.
+	const Orientation _orientation;	///< Display orientation.
 	const uint8_t* _fntp;	///< Pointer to current font used.
+	const CompiledFont* _cfntp;	///< Current compiled font, overrides @p _fntp.
 	Color _bkgColor;		///< Current background color.
+	FrameBuffer _fb;		///< Shadow frame buffer, no buffer in direct mode.
+	FrameBuffer _prev;		///< RAM contents at the last flush, optional.
+	bool _prevValid;		///< Previous frame matches the RAM.
+	FlushStats _stats;		///< Upload statistics.
+	DirtyList _dirty;		///< Areas changed since the last flush.
+	FrameBuffer _other;		///< Second frame buffer when double buffering.
+	DirtyList _pendingDirty;	///< Changed areas of the pending frame.
+	SSD16xx::UpdateMode _pendingMode;	///< Waveform requested for the pending frame.
+	bool _pending;			///< Frame in the second buffer waits for the display.
+	GlyphCache* _glyphs;	///< Packed glyph cache, optional.
+	DisplayList* _list;		///< Drawing calls recorded for commitDisplayList().
+	uint16_t _bandY;		///< First display row of the frame buffer.
+	bool _banding;			///< Frame buffer is a band of renderBands().
 
 	/**
-	 * @brief	Draw a bitmap on the display based on the bitmap function.
-	 * @details	The bitmap function return value represents the actual color
-	 * 			used to color a pixel. Logical true stands for the drawing
-	 * 			color whereas logical false for background color.
+	 * @brief	Replicate @p Color color to the 4 pixels of a RAM byte.
+	 */
+	static constexpr uint8_t colorByte(Color color) { return uint8_t(color * 0x55); }
+
+	/** @brief	Check whether drawing goes to the shadow frame buffer. */
+	bool buffered() const { return _fb.data() != NULL; }
+
+	/**
+	 * @brief	Get the bytes needed to send a display area.
+	 * @details	Includes the cost of setting the RAM address window.
+	 */
+	static size_t cost(const Rect& r) {
+		return EPD_WINDOW_COST + size_t(r.width) * (r.height >> 2);
+	}
+
+	/**
+	 * @brief	Mark a display area as changed in the shadow frame buffer.
+	 * @details	The area is extended to whole RAM bytes and merged with
+	 * 			the tracked areas whenever sending the union is cheaper.
+	 */
+	void markDirty(uint16_t x, uint16_t y, uint16_t width, uint16_t height);
+
+	/**
+	 * @brief	Send the changed areas of the shadow frame buffer.
+	 * @details	Does not care about a pending frame.
+	 */
+	void flushBuffer();
+
+	/**
+	 * @brief	Swap the frame buffers and their changed areas.
+	 */
+	void swapBuffers();
+
+	/**
+	 * @brief	Send a display area of the shadow frame buffer.
+	 * @note	Need to call select() before execution.
+	 *
+	 * @param[in] r			area aligned to whole RAM bytes
+	 */
+	void sendArea(const Rect& r);
+
+	/**
+	 * @brief	Send the changed bytes of a display area.
+	 * @details	Compares the shadow frame buffer with the previous frame
+	 * 			column by column and sends the changed spans through as
+	 * 			few RAM address windows as the window cost allows.
+	 * @note	Need to call select() before execution.
+	 *
+	 * @param[in] r			area aligned to whole RAM bytes
+	 */
+	void sendChanges(const Rect& r);
+
+	/**
+	 * @brief	Set the RAM address window of a display area.
+	 * @note	Need to call select() before execution.
+	 *
+	 * @param[in] x			horizontal display start location
+	 * @param[in] y			vertical display start location
+	 * @param[in] width		area width
+	 * @param[in] height	area height
+	 */
+	void setWindow(uint16_t x, uint16_t y, uint16_t width, uint16_t height);
+
+	/**
+	 * @brief	Map a display area to the RAM address window.
+	 *
+	 * @param[in] x			horizontal display start location
+	 * @param[in] y			vertical display start location
+	 * @param[in] width		area width
+	 * @param[in] height	area height
+	 * @param[out] xsa		RAM x start address
+	 * @param[out] xea		RAM x end address
+	 * @param[out] ysa		RAM y start address
+	 * @param[out] yea		RAM y end address
+	 */
+	void ramWindow(uint16_t x, uint16_t y, uint16_t width, uint16_t height,
+			uint8_t* xsa, uint8_t* xea, uint16_t* ysa, uint16_t* yea) const;
+
+	/**
+	 * @brief	Draw a bitmap on the display based on the pixel source.
+	 * @see		ColumnWriter
 	 *
-	 * @param[in] color		drawing @p Color color
 	 * @param[in] x			horizontal display start location
 	 * @param[in] y			vertical display start location
 	 * @param[in] width		bitmap width
 	 * @param[in] height	bitmap height
-	 * @param[in] bmpFnc	bitmap function used to color pixels
+	 * @param[in] src		pixel source
+	 */
+	template<typename Source>
+	void drawBitmap(uint16_t x, uint16_t y, uint16_t width, uint16_t height, const Source& src);
+
+	/**
+	 * @brief	Draw a bitmap to the frame buffer.
+	 * @details	Clips the bitmap to the rows held by the frame buffer.
+	 */
+	template<typename Source>
+	void bufferBitmap(uint16_t x, uint16_t y, uint16_t width, uint16_t height, const Source& src);
+
+	/**
+	 * @brief	Fill a rectangle of the frame buffer.
+	 * @details	Clips the rectangle to the rows held by the frame buffer.
+	 */
+	void bufferRect(uint16_t x, uint16_t y, uint16_t width, uint16_t height, Color color);
+
+	/**
+	 * @brief	Draw the rectangles of a shape rasterizer.
+	 * @details	Rectangles are clipped to the display.
+	 *
+	 * @param[in] color		drawing color
+	 * @param[in] bounds	shape bounding box, clipped to the display
+	 * @param[in] shape		rasterizer taking the rectangle callable
+	 */
+	template<typename Shape>
+	void drawShape(Color color, Rect bounds, Shape shape);
+
+	/**
+	 * @brief	Send the RAM bytes of a shape strip touched by the shape.
+	 * @details	Consecutive columns touching the same bytes share the
+	 * 			RAM windows, one per run of touched bytes.
+	 * @note	Need to call select() before execution.
+	 *
+	 * @param[in] strip		rasterized strip
+	 * @param[in] touched	one bit per strip byte, set where touched
+	 * @param[in] left		display column of the strip
+	 * @param[in] top		display row of the strip, a multiple of 4
+	 */
+	void sendShapeStrip(const FrameBuffer& strip, const uint8_t* touched, uint16_t left, uint16_t top);
+
+	/**
+	 * @brief	Draw the calls of a display list.
+	 */
+	void replayDisplayList(const DisplayList& list);
+
+	/**
+	 * @brief	renderBands() callback replaying a display list.
+	 */
+	static void replayBand(EPD* epd, void* arg);
+
+	/**
+	 * @brief	Record a filled rectangle to the display list.
+	 * @details	A full list is committed first.
+	 *
+	 * @returns	@p false if the call has to be drawn right away.
+	 */
+	bool recordRect(Color color, uint16_t x, uint16_t y, uint16_t width, uint16_t height);
+
+	/**
+	 * @brief	Record a glyph run to the display list.
+	 * @details	A full list is committed first.
+	 *
+	 * @returns	@p false if the call has to be drawn right away.
 	 */
-	void drawBitmap(Color color, uint16_t x, uint16_t y, uint16_t width, uint16_t height, BmpFnc bmpFnc);
+	bool recordText(Color color, uint16_t x, uint16_t y, uint16_t width, uint16_t height,
+			const void* font, bool compiled, const char* str, size_t n);
+
+	/**
+	 * @brief	Get text width based on the font accessors.
+	 */
+	template<typename FontView>
+	static size_t textWidth(const FontView& font, const char* str);
+
+	/**
+	 * @brief	Draw text based on the font accessors.
+	 * @see		drawText()
+	 */
+	template<typename FontView>
+	void drawText(const FontView& font, Color color, uint16_t x, uint16_t y, const char* str, Align align);
 
 public:
 
-	EPD(SSD16xx& ssd, uint16_t width, uint16_t height, const uint8_t* fntp);
+	/**
+	 * @brief	Get the SSD16xx data entry mode of an orientation.
+	 * @details	The RAM x address walks the rows of a column and the RAM y
+	 * 			address the columns, each one decrementing when mirrored.
+	 */
+	static constexpr uint8_t dataEntryMode(Orientation orientation) {
+		return ((orientation & ORIENTATION_MIRROR_Y) ? 0x00 : 0x01) |
+				((orientation & ORIENTATION_MIRROR_X) ? 0x02 : 0x00);
+	}
+
+	/**
+	 * @param[in] ssd			underlying SSD16xx IC
+	 * @param[in] width			display width in pixels
+	 * @param[in] height		display height in pixels
+	 * @param[in] fntp			font
+	 * @param[in] orientation	display orientation, fixed for the
+	 * 							display lifetime
+	 */
+	EPD(SSD16xx& ssd, uint16_t width, uint16_t height, const uint8_t* fntp,
+			Orientation orientation = ORIENTATION_NORMAL);
 	virtual ~EPD();
 
+	/** @brief	Get the display orientation. */
+	Orientation orientation() const { return _orientation; }
+
 	/** @brief	Start the underlying SSD16xx IC. */
 	void start();
 
 	/** @brief	Stop the underlying SSD16xx IC. */
 	void stop();
 
+	/**
+	 * @brief	SPI bus session of the display.
+	 * @details	Keeps the SPI bus acquired and started across the drawing
+	 * 			calls made during the session lifetime.
+	 * @see		SSD16xx::Session
+	 */
+	class Session : public SSD16xx::Session {
+	public:
+		Session(EPD& epd) : SSD16xx::Session(epd._ssd) {}
+	};
+
 	/** @brief	Get display width. */
 	uint16_t width() const { return _width; }
 
@@ -118,9 +665,161 @@ public:
 	uint16_t height() const { return _height; }
 
 	/**
-	 * @brief
+	 * @brief	Flush the shadow frame buffer and update the display.
+	 *
+	 * @param[in] mode		requested waveform
+	 *
+	 * @returns	The operation status, see SSD16xx::update().
+	 */
+	msg_t updateDisplay(SSD16xx::UpdateMode mode = SSD16xx::UPDATE_FULL);
+
+	/**
+	 * @brief	Flush the shadow frame buffer and start a display update
+	 * 			without waiting for its end.
+	 * @see		SSD16xx::startUpdate()
+	 *
+	 * @param[in] mode		requested waveform
+	 *
+	 * @returns	The operation status, see SSD16xx::startUpdate().
+	 */
+	msg_t startUpdateDisplay(SSD16xx::UpdateMode mode = SSD16xx::UPDATE_FULL);
+
+	/**
+	 * @brief	Wait for the display update to end.
+	 * @see		SSD16xx::waitUpdate()
+	 *
+	 * @param[in] timeout	the number of ticks before the operation timeouts
+	 */
+	msg_t waitUpdateDisplay(sysinterval_t timeout) { return _ssd.waitUpdate(timeout); }
+
+	/**
+	 * @brief	Get the time since the last display update started.
+	 */
+	sysinterval_t updateElapsed() const { return chVTTimeElapsedSinceX(_ssd.updateStart()); }
+
+	/**
+	 * @brief	Estimate the time until the running display update ends.
+	 * @details	Based on the duration of the last finished update, zero if
+	 * 			it is overdue or no update has finished yet.
+	 */
+	sysinterval_t updateRemaining() const {
+		sysinterval_t elapsed = updateElapsed();
+		return (_ssd.updateTime() > elapsed) ? _ssd.updateTime() - elapsed : 0;
+	}
+
+	/**
+	 * @brief	Start sending a display area in the RAM layout without
+	 * 			waiting.
+	 * @details	The area is read in place by the SPI DMA, it may come from
+	 * 			flash or from a buffer of the application and must stay
+	 * 			unchanged until the upload ends. The display update may be
+	 * 			queued behind the data. Drawing can go on in the meantime,
+	 * 			the next call reaching the SPI bus waits for the upload.
+	 * @note	Needs direct mode and an orientation not mirrored
+	 * 			vertically.
+	 * @see		SSD16xx::startUpload()
+	 *
+	 * @param[in] x			horizontal display start location
+	 * @param[in] y			vertical display start location, a multiple of 4
+	 * @param[in] width		area width
+	 * @param[in] height	area height
+	 * @param[in] bp		area pixels, column by column, FrameBuffer layout
+	 * @param[in] update	start a display update after the data
+	 * @param[in] mode		requested waveform of the update
+	 */
+	void startUpload(uint16_t x, uint16_t y, uint16_t width, uint16_t height, const uint8_t* bp,
+			bool update = false, SSD16xx::UpdateMode mode = SSD16xx::UPDATE_FULL);
+
+	/**
+	 * @brief	Wait for the upload to end.
+	 * @see		SSD16xx::waitUpload()
+	 *
+	 * @param[in] timeout	the number of ticks before the operation timeouts
+	 */
+	msg_t waitUpload(sysinterval_t timeout) { return _ssd.waitUpload(timeout); }
+
+	/**
+	 * @brief	Get the shadow frame buffer size in bytes.
+	 */
+	size_t frameBufferSize() const { return FrameBuffer::size(_width, _height); }
+
+	/**
+	 * @brief	Set the shadow frame buffer.
+	 * @details	With a frame buffer all drawing goes to MCU memory and the
+	 * 			changed areas are sent to the RAM by flush(). The buffer is
+	 * 			cleared to the background color and the whole display is
+	 * 			marked as changed.
+	 *
+	 * @param[in] bp		pointer to frameBufferSize() bytes or @p NULL
+	 * 						to draw directly to the RAM
+	 */
+	void setFrameBuffer(uint8_t* bp);
+
+	/**
+	 * @brief	Set the previous frame buffer.
+	 * @details	With a previous frame only the RAM bytes differing from the
+	 * 			last flushed frame are sent. Needs a shadow frame buffer and
+	 * 			marks the whole display as changed.
+	 *
+	 * @param[in] bp		pointer to frameBufferSize() bytes or @p NULL
+	 */
+	void setPrevFrameBuffer(uint8_t* bp);
+
+	/**
+	 * @brief	Send the changed areas of the shadow frame buffer.
+	 * @details	All areas are sent within a single SPI session. A pending
+	 * 			frame is presented first.
+	 */
+	void flush();
+
+	/**
+	 * @brief	Set two shadow frame buffers for pipelined rendering.
+	 * @details	Drawing goes to the first buffer as with setFrameBuffer().
+	 * 			The second one takes over drawing while a presented frame
+	 * 			waits for the display, see present().
+	 *
+	 * @param[in] bp0		pointer to frameBufferSize() bytes
+	 * @param[in] bp1		pointer to frameBufferSize() bytes
 	 */
-	void updateDisplay();
+	void setFrameBuffers(uint8_t* bp0, uint8_t* bp1);
+
+	/**
+	 * @brief	Present the drawn frame.
+	 * @details	With the display idle the frame is sent and the display
+	 * 			update started right away. While the display updates the
+	 * 			buffer is handed over to the driver and drawing continues
+	 * 			in the second buffer, which starts as a copy of the
+	 * 			presented frame. The handed over frame is sent as soon as
+	 * 			the BUSY line drops by syncPresent(), by the next present()
+	 * 			or by flush().
+	 * @note	Blocks only while an earlier presented frame still waits
+	 * 			for the display.
+	 *
+	 * @param[in] mode		requested waveform
+	 */
+	void present(SSD16xx::UpdateMode mode = SSD16xx::UPDATE_FULL);
+
+	/**
+	 * @brief	Send the pending frame once the display is idle and start
+	 * 			its update.
+	 *
+	 * @param[in] timeout	the number of ticks to wait for the display
+	 *
+	 * @returns	The operation status.
+	 * @retval MSG_OK		if no frame is pending anymore.
+	 * @retval MSG_TIMEOUT	if the display is still updating or the
+	 * 						update of the sent frame could not start.
+	 */
+	msg_t syncPresent(sysinterval_t timeout);
+
+	/** @brief	Check whether a presented frame waits for the display. */
+	bool presentPending() const { return _pending; }
+
+	/** @brief	Get the upload statistics. */
+	const FlushStats& flushStats() const { return _stats; }
+
+	/** @brief	Reset the upload statistics. */
+	void resetFlushStats() { _stats = FlushStats(); }
 
 	/**
 	 * @brief	Fill display with @p Color color.
@@ -129,6 +828,47 @@ public:
 	 */
 	void fillDisplay(Color color);
 
+	/**
+	 * @brief	Draw a native 2bpp image.
+	 * @details	An image placed on a multiple of 4 rows is sent to the RAM
+	 * 			as is, straight from flash. Other positions are shifted
+	 * 			while streaming, the partial bytes at the top and bottom
+	 * 			being completed with the background color.
+	 * @see		startUpload() for a non-blocking upload
+	 *
+	 * @param[in] x			horizontal start location
+	 * @param[in] y			vertical start location
+	 * @param[in] width		image width
+	 * @param[in] height	image height
+	 * @param[in] bp		image pixels, column by column, FrameBuffer layout
+	 */
+	void drawImage(uint16_t x, uint16_t y, uint16_t width, uint16_t height, const uint8_t* bp);
+
+	/**
+	 * @brief	Draw a native 2bpp image.
+	 *
+	 * @param[in] x			horizontal start location
+	 * @param[in] y			vertical start location
+	 * @param[in] image		image
+	 */
+	void drawImage(uint16_t x, uint16_t y, const Image& image) {
+		drawImage(x, y, image.width, image.height, image.data);
+	}
+
+	/**
+	 * @brief	Draw a run-length encoded native 2bpp image.
+	 * @details	An image placed on a multiple of 4 rows is decoded
+	 * 			straight into the SPI transfers, long literal runs being
+	 * 			sent in place and long repeats through SSD16xx::fillData().
+	 * 			Other positions and the frame buffer decode one column at a
+	 * 			time. The image is never decoded as a whole.
+	 *
+	 * @param[in] x			horizontal start location
+	 * @param[in] y			vertical start location
+	 * @param[in] image		image
+	 */
+	void drawImage(uint16_t x, uint16_t y, const RleImage& image);
+
 	/**
 	 * @brief	Set display background color.
 	 *
@@ -136,6 +876,100 @@ public:
 	 */
 	void setBkgColor(Color color) { _bkgColor = color; }
 
+	/**
+	 * @brief	Set the glyph cache.
+	 * @details	Glyphs drawn directly to the RAM are packed once per font,
+	 * 			character, colors and vertical position modulo 4 and sent
+	 * 			from the cache afterwards. Has no effect in buffered mode.
+	 *
+	 * @param[in] cache		glyph cache or @p NULL
+	 */
+	void setGlyphCache(GlyphCache* cache) { _glyphs = cache; }
+
+	/**
+	 * @brief	Set the display list.
+	 * @details	While a display list is set, text and filled rectangles
+	 * 			are recorded instead of drawn. commitDisplayList(), flush()
+	 * 			and the display updates optimize the recorded calls and
+	 * 			draw them within a single SPI bus session. Calls recorded
+	 * 			to the previous list are committed.
+	 *
+	 * @param[in] list		display list or @p NULL to draw right away
+	 */
+	void setDisplayList(DisplayList* list);
+
+	/**
+	 * @brief	Draw the calls recorded to the display list.
+	 * @see		DisplayList::optimize()
+	 */
+	void commitDisplayList();
+
+	/**
+	 * @brief	Scene drawing callback of renderBands().
+	 */
+	typedef void (*RenderCallback)(EPD* epd, void* arg);
+
+	/**
+	 * @brief	Render the display band by band.
+	 * @details	The display is split into bands of @p rows rows. For each
+	 * 			band the scene is drawn into the band buffer, everything
+	 * 			outside the band being clipped, and the band is sent to
+	 * 			the RAM through one address window before the next band is
+	 * 			drawn. Memory use only depends on the band height, taller
+	 * 			bands need less scene passes and longer SPI bursts.
+	 * @note	Needs direct mode, the frame buffer is used for the bands.
+	 *
+	 * @param[in] bp		pointer to bandBufferSize() bytes
+	 * @param[in] rows		band height, a multiple of 4
+	 * @param[in] cb		scene drawing callback, called once per band
+	 * @param[in] arg		callback argument
+	 */
+	void renderBands(uint8_t* bp, uint16_t rows, RenderCallback cb, void* arg) {
+		renderBands(bp, NULL, rows, cb, arg);
+	}
+
+	/**
+	 * @brief	Render the display band by band with two band buffers.
+	 * @details	Each band is handed to the SPI DMA and the next band is
+	 * 			drawn into the other buffer while it is on the wire. The
+	 * 			last band may still be on the wire on return, see
+	 * 			waitUpload(). Vertically mirrored displays send the bands
+	 * 			blocking.
+	 * @see		renderBands()
+	 *
+	 * @param[in] bp0		pointer to bandBufferSize() bytes
+	 * @param[in] bp1		pointer to bandBufferSize() bytes or @p NULL
+	 * 						for a single buffer and blocking sends
+	 * @param[in] rows		band height, a multiple of 4
+	 * @param[in] cb		scene drawing callback, called once per band
+	 * @param[in] arg		callback argument
+	 */
+	void renderBands(uint8_t* bp0, uint8_t* bp1, uint16_t rows, RenderCallback cb, void* arg);
+
+	/**
+	 * @brief	Render the display band by band from a display list.
+	 * @details	The list is optimized once, replayed for each band and
+	 * 			cleared.
+	 * @see		renderBands()
+	 */
+	void renderBands(uint8_t* bp, uint16_t rows, DisplayList& list) {
+		renderBands(bp, NULL, rows, list);
+	}
+
+	/**
+	 * @brief	Render the display band by band from a display list with
+	 * 			two band buffers.
+	 * @see		renderBands()
+	 */
+	void renderBands(uint8_t* bp0, uint8_t* bp1, uint16_t rows, DisplayList& list);
+
+	/**
+	 * @brief	Get the band buffer size in bytes.
+	 *
+	 * @param[in] rows		band height
+	 */
+	size_t bandBufferSize(uint16_t rows) const { return FrameBuffer::size(_width, rows); }
+
 	/**
 	 * @brief	Set current font used.
 	 *
@@ -143,6 +977,15 @@ public:
 	 */
 	void setFont(const uint8_t* bp);
 
+	/**
+	 * @brief	Set current font used.
+	 * @details	The compiled font needs no conversion while drawing.
+	 * @see		FontCompiler
+	 *
+	 * @param[in] font		font compiled into the RAM layout
+	 */
+	void setFont(const CompiledFont& font);
+
 	/**
 	 * @brief	Gets text width.
 	 *
@@ -151,8 +994,18 @@ public:
 	 */
 	static size_t getTextWidth(const Font* fntp, const char* str);
 
+	/**
+	 * @brief	Gets text width.
+	 *
+	 * @param[in] fntp		pointer to the @CompiledFont font object
+	 * @param[in] str		zero terminated text
+	 */
+	static size_t getTextWidth(const CompiledFont* fntp, const char* str);
+
 	/**
 	 * @brief	Draw text.
+	 * @details	The glyphs fitting horizontally on the display are sent
+	 * 			through a single RAM address window.
 	 *
 	 * @param[in] color		drawing color
 	 * @param[in] x			horizontal start location
@@ -172,6 +1025,87 @@ public:
 	 * @param[in] heigh		rectangle height
 	 */
 	void drawFilledRect(Color color, uint16_t x, uint16_t y, uint16_t width, uint16_t height);
+
+	/**
+	 * @brief	Draw horizontal line.
+	 *
+	 * @param[in] color		drawing color
+	 * @param[in] x			line horizontal start location
+	 * @param[in] y			line vertical location
+	 * @param[in] width		line width
+	 */
+	void drawHLine(Color color, uint16_t x, uint16_t y, uint16_t width) {
+		drawFilledRect(color, x, y, width, 1);
+	}
+
+	/**
+	 * @brief	Draw vertical line.
+	 *
+	 * @param[in] color		drawing color
+	 * @param[in] x			line horizontal location
+	 * @param[in] y			line vertical start location
+	 * @param[in] height	line height
+	 */
+	void drawVLine(Color color, uint16_t x, uint16_t y, uint16_t height) {
+		drawFilledRect(color, x, y, 1, height);
+	}
+
+	/**
+	 * @brief	Draw line.
+	 * @details	Shapes are rasterized into the frame buffer as vertical
+	 * 			runs and sent with the next flush. In direct mode they are
+	 * 			rasterized in column strips of EPD_SHAPE_BUFFER_SIZE bytes
+	 * 			and only the RAM bytes the shape touches are written, the
+	 * 			other pixels of those bytes get the background color.
+	 * 			Coordinates are taken as signed, so shapes may start left
+	 * 			of or above the display.
+	 *
+	 * @param[in] color		drawing color
+	 * @param[in] x0		start horizontal location
+	 * @param[in] y0		start vertical location
+	 * @param[in] x1		end horizontal location
+	 * @param[in] y1		end vertical location
+	 */
+	void drawLine(Color color, uint16_t x0, uint16_t y0, uint16_t x1, uint16_t y1);
+
+	/**
+	 * @brief	Draw rectangle outline.
+	 *
+	 * @param[in] color		drawing color
+	 * @param[in] x			rectangle horizontal start location
+	 * @param[in] y			rectangle vertical start location
+	 * @param[in] width		rectangle width
+	 * @param[in] height	rectangle height
+	 */
+	void drawRect(Color color, uint16_t x, uint16_t y, uint16_t width, uint16_t height);
+
+	/**
+	 * @brief	Draw circle outline.
+	 * @details	Parts outside the display are clipped.
+	 * @see		drawLine()
+	 *
+	 * @param[in] color		drawing color
+	 * @param[in] x			center horizontal location
+	 * @param[in] y			center vertical location
+	 * @param[in] r			radius
+	 */
+	void drawCircle(Color color, uint16_t x, uint16_t y, uint16_t r);
+
+	/**
+	 * @brief	Draw circle arc.
+	 * @details	The arc runs counterclockwise from @p start to @p end,
+	 * 			angles in degrees from the 3 o'clock direction. Equal
+	 * 			angles draw the full circle.
+	 * @see		drawCircle()
+	 *
+	 * @param[in] color		drawing color
+	 * @param[in] x			center horizontal location
+	 * @param[in] y			center vertical location
+	 * @param[in] r			radius
+	 * @param[in] start		start angle
+	 * @param[in] end		end angle
+	 */
+	void drawArc(Color color, uint16_t x, uint16_t y, uint16_t r, uint16_t start, uint16_t end);
 };
 
 #endif /* EINK_CLICK_EPD_HPP_ */
@@ -0,0 +1,137 @@
+/*
+ * Copyright (C) 2020 Daniel Igaz
+ *
+ * This file is part of the eINK-click project.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef EINK_CLICK_FONTCOMPILER_HPP_
+#define EINK_CLICK_FONTCOMPILER_HPP_
+
+#include "hal.h"
+
+/**
+ * @brief	Font in the SSD16xx RAM layout.
+ * @details	Glyphs are stored column by column, 4 vertical pixels per byte
+ * 			with the topmost pixel in the most significant bits. Set pixels
+ * 			are 0b11, clear pixels 0b00, so a RAM byte is obtained by
+ * 			masking the drawing and background colors.
+ */
+typedef struct {
+	uint16_t first_char;		///< Character code of the first font character.
+	uint16_t last_char;			///< Character code of the last font character.
+	uint8_t height;				///< Character height in pixels.
+	uint8_t stride;				///< Bytes per glyph column.
+	const uint8_t* widths;		///< Character widths in pixels.
+	const uint16_t* columns;	///< Index of the first column of each character.
+	const uint8_t* data;		///< Glyph columns.
+} CompiledFont;
+
+/**
+ * @name	Microchip AN1182 font image accessors
+ * @{
+ */
+static constexpr uint16_t an1182FirstChar(const unsigned char* fp) { return uint16_t(fp[2] | (fp[3] << 8)); }
+static constexpr uint16_t an1182LastChar(const unsigned char* fp) { return uint16_t(fp[4] | (fp[5] << 8)); }
+static constexpr uint8_t an1182Height(const unsigned char* fp) { return fp[6]; }
+static constexpr uint8_t an1182Width(const unsigned char* fp, size_t i) { return fp[8 + (i << 2)]; }
+static constexpr uint32_t an1182Offset(const unsigned char* fp, size_t i) {
+	return fp[9 + (i << 2)] | (fp[10 + (i << 2)] << 8) | (uint32_t(fp[11 + (i << 2)]) << 16);
+}
+static constexpr size_t an1182Columns(const unsigned char* fp) {
+	size_t n = 0;
+	for (size_t i = 0; i <= size_t(an1182LastChar(fp) - an1182FirstChar(fp)); i++)
+		n += an1182Width(fp, i);
+	return n;
+}
+/** @} */
+
+/**
+ * @brief	Tables of a compiled font.
+ * @details	Built from a Microchip AN1182 font image by a constant
+ * 			expression.
+ */
+template<size_t Count, size_t Bytes>
+struct CompiledFontTables {
+	uint8_t widths[Count];		///< Character widths in pixels.
+	uint16_t columns[Count];	///< Index of the first column of each character.
+	uint8_t data[Bytes];		///< Glyph columns.
+
+	constexpr CompiledFontTables(const unsigned char* fp)
+	: widths()
+	, columns()
+	, data()
+	{
+		uint8_t height = an1182Height(fp);
+		uint8_t stride = (height + 3) >> 2;
+		uint16_t column = 0;
+
+		for (size_t i = 0; i < Count; i++) {
+			uint8_t width = an1182Width(fp, i);
+			const unsigned char* gp = fp + an1182Offset(fp, i);
+			uint8_t rowBytes = (width + 7) >> 3;
+
+			widths[i] = width;
+			columns[i] = column;
+
+			// transpose the 1bpp rows into 2bpp columns
+			for (uint16_t w = 0; w < width; w++) {
+				for (uint16_t h = 0; h < height; h++) {
+					if ((gp[h * rowBytes + (w >> 3)] >> (w & 0x07)) & 0x01)
+						data[(column + w) * stride + (h >> 2)] |= 0xC0 >> ((h & 0x03) << 1);
+				}
+			}
+
+			column += width;
+		}
+	}
+};
+
+/**
+ * @brief	Compile a Microchip AN1182 font image into the RAM layout.
+ * @details	The conversion runs at compile time, the tables are placed in
+ * 			flash, e.g.
+ * @code
+ * 	epd.setFont(FontCompiler<Cambria_Bold_12x12>::font);
+ * @endcode
+ *
+ * @tparam	Font	AN1182 font image
+ */
+template<const unsigned char* Font>
+struct FontCompiler {
+	static constexpr size_t count = an1182LastChar(Font) - an1182FirstChar(Font) + 1;
+	static constexpr uint8_t stride = (an1182Height(Font) + 3) >> 2;
+
+	typedef CompiledFontTables<count, an1182Columns(Font) * stride> Tables;
+
+	static constexpr Tables tables = Tables(Font);		///< Compiled tables.
+	static constexpr CompiledFont font = {				///< Compiled font.
+		an1182FirstChar(Font),
+		an1182LastChar(Font),
+		an1182Height(Font),
+		stride,
+		tables.widths,
+		tables.columns,
+		tables.data
+	};
+};
+
+template<const unsigned char* Font>
+constexpr typename FontCompiler<Font>::Tables FontCompiler<Font>::tables;
+
+template<const unsigned char* Font>
+constexpr CompiledFont FontCompiler<Font>::font;
+
+#endif /* EINK_CLICK_FONTCOMPILER_HPP_ */
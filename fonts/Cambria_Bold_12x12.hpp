@@ -24,7 +24,7 @@
 #define EINK_CLICK_CAMBRIA_BOLD_12X12_HPP_
 
 
-const unsigned char Cambria_Bold_12x12[] = {
+constexpr unsigned char Cambria_Bold_12x12[] = {
     0x00,
     0x00,
     0x20,0x00,
@@ -0,0 +1,183 @@
+/*
+ * Copyright (C) 2020 Daniel Igaz
+ *
+ * This file is part of the eINK-click project.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "framebuffer.hpp"
+#include <string.h>
+
+void FrameBuffer::fill(uint8_t b)
+{
+	memset(_bp, b, size(_width, _height));
+}
+
+void FrameBuffer::fillRect(uint16_t x, uint16_t y, uint16_t width, uint16_t height, uint8_t color)
+{
+	osalDbgAssert(x + width <= _width && y + height <= _height,
+			"FrameBuffer::fillRect(), invalid area");
+
+	if (width == 0 || height == 0)
+		return;
+
+	uint8_t b = (color & 0x03) * 0x55;
+	uint16_t ys = y >> 2;
+	uint16_t ye = (y + height - 1) >> 2;
+
+	// masks of the first and last byte of each column
+	uint8_t hm = 0xFF >> ((y & 0x03) << 1);
+	uint8_t tm = 0xFF << ((3 - ((y + height - 1) & 0x03)) << 1);
+
+	if (ys == ye)
+		hm &= tm;
+
+	for (uint16_t w = 0; w < width; w++) {
+		uint8_t* bp = column(x + w);
+
+		bp[ys] = (bp[ys] & ~hm) | (b & hm);
+		if (ys != ye) {
+			memset(bp + ys + 1, b, ye - ys - 1);
+			bp[ye] = (bp[ye] & ~tm) | (b & tm);
+		}
+	}
+}
+
+void FrameBuffer::fillRect(uint16_t x, uint16_t y, uint16_t width, uint16_t height, uint8_t color, RasterOp op)
+{
+	if (op == ROP_COPY)
+		fillRect(x, y, width, height, color);
+	else
+		raster(x, y, width, height, NULL, 0, 0, 0, (color & 0x03) * 0x55, op, -1);
+}
+
+/**
+ * @brief	Load @p n bytes as the most significant bytes of a word.
+ */
+static inline uint64_t loadBits(const uint8_t* bp, size_t n)
+{
+	uint64_t v = 0;
+
+	if (n == 8) {
+		for (size_t i = 0; i < 8; i++)
+			v = (v << 8) | bp[i];
+		return v;
+	}
+
+	for (size_t i = 0; i < n; i++)
+		v |= uint64_t(bp[i]) << (56 - 8 * i);
+	return v;
+}
+
+/**
+ * @brief	Store the @p n most significant bytes of a word.
+ */
+static inline void storeBits(uint8_t* bp, size_t n, uint64_t v)
+{
+	for (size_t i = 0; i < n; i++)
+		bp[i] = uint8_t(v >> (56 - 8 * i));
+}
+
+/**
+ * @brief	Get the 32 pixels of a column starting at row @p row.
+ * @details	Rows outside the column read as 0.
+ */
+static inline uint64_t sourceBits(const uint8_t* col, uint16_t stride, int32_t row)
+{
+	int32_t bi = (row < 0) ? -((3 - row) >> 2) : (row >> 2);
+	uint8_t shift = (row - bi * 4) << 1;
+
+	if (bi >= 0 && bi + 9 <= stride) {
+		uint64_t v = loadBits(col + bi, 8);
+		return shift ? (v << shift) | (col[bi + 8] >> (8 - shift)) : v;
+	}
+
+	// column edges
+	uint64_t v = 0;
+	for (int32_t i = 0; i < 9; i++) {
+		uint64_t b = (bi + i >= 0 && bi + i < stride) ? col[bi + i] : 0;
+		v |= (i < 8) ? (b << (56 - 8 * i)) << shift : b >> (8 - shift);
+	}
+	return v;
+}
+
+void FrameBuffer::raster(uint16_t x, uint16_t y, uint16_t width, uint16_t height,
+		const uint8_t* src, uint16_t srcStride, uint16_t sx, uint16_t sy,
+		uint8_t fill, RasterOp op, int16_t transparent)
+{
+	osalDbgAssert(x + width <= _width && y + height <= _height,
+			"FrameBuffer::raster(), invalid area");
+
+	if (width == 0 || height == 0)
+		return;
+
+	const uint64_t lo = 0x5555555555555555ULL;
+	uint64_t s = fill * 0x0101010101010101ULL;
+	uint64_t tp = (transparent >= 0) ? transparent * lo : 0;
+	uint16_t bs = y >> 2;
+	uint16_t be = ((y + height - 1) >> 2) + 1;
+	uint16_t chunks = (be - bs + 7) >> 3;
+
+	// move overlapping areas of the same buffer like memmove()
+	bool same = src == _bp;
+	bool left = same && x > sx;
+	bool up = same && y > sy;
+
+	for (uint16_t i = 0; i < width; i++) {
+		uint16_t w = left ? width - 1 - i : i;
+		uint8_t* col = column(x + w);
+		const uint8_t* scol = (src != NULL) ? src + (sx + w) * srcStride : NULL;
+
+		for (uint16_t j = 0; j < chunks; j++) {
+			uint16_t b = bs + ((up ? chunks - 1 - j : j) << 3);
+			size_t n = (be - b < 8) ? be - b : 8;
+
+			// rows of the rectangle within the 32 rows of the chunk
+			int32_t r = b << 2;
+			int32_t ra = (y > r) ? y - r : 0;
+			int32_t rb = (y + height < r + 32) ? y + height - r : 32;
+			uint64_t m = (ra ? ~0ULL >> (ra << 1) : ~0ULL) & (rb < 32 ? ~(~0ULL >> (rb << 1)) : ~0ULL);
+
+			if (scol != NULL)
+				s = sourceBits(scol, srcStride, r - y + sy);
+
+			if (transparent >= 0) {
+				uint64_t e = ~(s ^ tp);
+				e &= (e >> 1) & lo;
+				m &= ~(e | (e << 1));
+			}
+
+			uint64_t d = loadBits(col + b, n);
+			uint64_t v;
+
+			switch (op) {
+			case ROP_AND:
+				v = d & s;
+				break;
+			case ROP_OR:
+				v = d | s;
+				break;
+			case ROP_XOR:
+				v = d ^ s;
+				break;
+			default:
+				v = s;
+				break;
+			}
+
+			storeBits(col + b, n, (d & ~m) | (v & m));
+		}
+	}
+}
@@ -0,0 +1,226 @@
+/*
+ * Copyright (C) 2020 Daniel Igaz
+ *
+ * This file is part of the eINK-click project.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef EINK_CLICK_FRAMEBUFFER_HPP_
+#define EINK_CLICK_FRAMEBUFFER_HPP_
+
+#include "hal.h"
+
+/**
+ * @brief	2bpp frame buffer in the SSD16xx RAM layout.
+ * @details	Pixels are stored column by column, 4 vertical pixels per
+ * 			byte with the topmost pixel in the most significant bits. A
+ * 			display area is therefore sent to the RAM in buffer order
+ * 			with the RAM X address incremented first.
+ */
+class FrameBuffer {
+public:
+	/**
+	 * @brief	Raster operation combining source and destination pixels.
+	 */
+	typedef enum {
+		ROP_COPY = 0,			///< Source replaces destination.
+		ROP_AND = 1,			///< Source AND destination.
+		ROP_OR = 2,				///< Source OR destination.
+		ROP_XOR = 3,			///< Source XOR destination.
+	} RasterOp;
+
+private:
+	uint8_t* _bp;			///< Pointer to the buffer memory.
+	uint16_t _width;		///< Width in pixels.
+	uint16_t _height;		///< Height in pixels.
+	uint16_t _stride;		///< Bytes per column.
+
+	/**
+	 * @brief	Combine a source with a rectangle, 64 bits at a time.
+	 * @details	Each column is handled as a bit string, the source bits
+	 * 			are shifted to the destination rows and merged through a
+	 * 			mask covering the rectangle rows.
+	 *
+	 * @param[in] src		source pixels or @p NULL to use @p fill
+	 * @param[in] srcStride	bytes per source column
+	 * @param[in] fill		color replicated to 4 pixels
+	 * @param[in] transparent	source color to skip or -1
+	 */
+	void raster(uint16_t x, uint16_t y, uint16_t width, uint16_t height,
+			const uint8_t* src, uint16_t srcStride, uint16_t sx, uint16_t sy,
+			uint8_t fill, RasterOp op, int16_t transparent);
+
+public:
+	FrameBuffer(uint8_t* bp, uint16_t width, uint16_t height)
+	: _bp(bp)
+	, _width(width)
+	, _height(height)
+	, _stride((height + 3) >> 2)
+	{}
+
+	/**
+	 * @brief	Get the buffer size in bytes.
+	 *
+	 * @param[in] width		width in pixels
+	 * @param[in] height	height in pixels
+	 */
+	static constexpr size_t size(uint16_t width, uint16_t height) {
+		return size_t(width) * ((height + 3) >> 2);
+	}
+
+	/** @brief	Get pointer to the buffer memory. */
+	uint8_t* data() const { return _bp; }
+
+	/** @brief	Get width in pixels. */
+	uint16_t width() const { return _width; }
+
+	/** @brief	Get height in pixels. */
+	uint16_t height() const { return _height; }
+
+	/** @brief	Get bytes per column. */
+	uint16_t stride() const { return _stride; }
+
+	/** @brief	Get pointer to the first byte of column @p x. */
+	uint8_t* column(uint16_t x) const { return _bp + x * _stride; }
+
+	/**
+	 * @brief	Get the 2 bit color of a pixel.
+	 */
+	uint8_t pixel(uint16_t x, uint16_t y) const {
+		return (column(x)[y >> 2] >> ((3 - (y & 0x03)) << 1)) & 0x03;
+	}
+
+	/**
+	 * @brief	Set the 2 bit color of a pixel.
+	 */
+	void setPixel(uint16_t x, uint16_t y, uint8_t color) {
+		uint8_t shift = (3 - (y & 0x03)) << 1;
+		uint8_t* bp = column(x) + (y >> 2);
+		*bp = (*bp & ~(0x03 << shift)) | ((color & 0x03) << shift);
+	}
+
+	/**
+	 * @brief	Fill the whole buffer with a RAM byte.
+	 *
+	 * @param[in] b		byte holding 4 pixels
+	 */
+	void fill(uint8_t b);
+
+	/**
+	 * @brief	Fill a rectangle with a 2 bit color.
+	 *
+	 * @param[in] x			horizontal start location
+	 * @param[in] y			vertical start location
+	 * @param[in] width		rectangle width
+	 * @param[in] height	rectangle height
+	 * @param[in] color		2 bit color
+	 */
+	void fillRect(uint16_t x, uint16_t y, uint16_t width, uint16_t height, uint8_t color);
+
+	/**
+	 * @brief	Combine a rectangle with a 2 bit color.
+	 *
+	 * @param[in] x			horizontal start location
+	 * @param[in] y			vertical start location
+	 * @param[in] width		rectangle width
+	 * @param[in] height	rectangle height
+	 * @param[in] color		2 bit color
+	 * @param[in] op		raster operation
+	 */
+	void fillRect(uint16_t x, uint16_t y, uint16_t width, uint16_t height, uint8_t color, RasterOp op);
+
+	/**
+	 * @brief	Combine a rectangle with pixels in the RAM layout.
+	 * @details	Source and destination may start on any row, overlapping
+	 * 			areas of the same buffer are handled.
+	 *
+	 * @param[in] x			horizontal destination location
+	 * @param[in] y			vertical destination location
+	 * @param[in] width		rectangle width
+	 * @param[in] height	rectangle height
+	 * @param[in] src		source pixels, column by column
+	 * @param[in] srcHeight	source height in pixels
+	 * @param[in] sx		horizontal source location
+	 * @param[in] sy		vertical source location
+	 * @param[in] op		raster operation
+	 */
+	void blit(uint16_t x, uint16_t y, uint16_t width, uint16_t height,
+			const uint8_t* src, uint16_t srcHeight, uint16_t sx, uint16_t sy, RasterOp op = ROP_COPY) {
+		raster(x, y, width, height, src, (srcHeight + 3) >> 2, sx, sy, 0, op, -1);
+	}
+
+	/**
+	 * @brief	Combine a rectangle with another frame buffer.
+	 * @see		blit()
+	 */
+	void blit(uint16_t x, uint16_t y, uint16_t width, uint16_t height,
+			const FrameBuffer& src, uint16_t sx, uint16_t sy, RasterOp op = ROP_COPY) {
+		osalDbgAssert(sx + width <= src._width && sy + height <= src._height,
+				"FrameBuffer::blit(), invalid source area");
+		raster(x, y, width, height, src._bp, src._stride, sx, sy, 0, op, -1);
+	}
+
+	/**
+	 * @brief	Copy pixels in the RAM layout except a transparent color.
+	 * @see		blit()
+	 *
+	 * @param[in] transparent	2 bit source color left out
+	 */
+	void blitMasked(uint16_t x, uint16_t y, uint16_t width, uint16_t height,
+			const uint8_t* src, uint16_t srcHeight, uint16_t sx, uint16_t sy, uint8_t transparent) {
+		raster(x, y, width, height, src, (srcHeight + 3) >> 2, sx, sy, 0, ROP_COPY, transparent & 0x03);
+	}
+
+	/**
+	 * @brief	Draw a bitmap based on a pixel source.
+	 * @details	The pixel source provides the 2 bit color of a single pixel
+	 * 			through @p color(w, h) and 4 vertical pixels packed into a
+	 * 			RAM byte through @p byte(w, h). Pixels outside the bitmap
+	 * 			keep their color.
+	 *
+	 * @param[in] x			horizontal start location
+	 * @param[in] y			vertical start location
+	 * @param[in] width		bitmap width
+	 * @param[in] height	bitmap height
+	 * @param[in] src		pixel source
+	 */
+	template<typename Source>
+	void drawBitmap(uint16_t x, uint16_t y, uint16_t width, uint16_t height, const Source& src) {
+		uint16_t head = (4 - (y & 0x03)) & 0x03;
+		if (head > height)
+			head = height;
+		uint16_t body = (height - head) >> 2;
+		uint16_t tail = (height - head) & 0x03;
+
+		for (uint16_t w = 0; w < width; w++) {
+			uint8_t* bp = column(x + w) + (y >> 2);
+			uint16_t h = 0;
+
+			for (; h < head; h++)
+				setPixel(x + w, y + h, src.color(w, h));
+
+			if (head)
+				bp++;
+
+			for (uint16_t i = 0; i < body; i++, h += 4)
+				*bp++ = src.byte(w, h);
+
+			for (uint16_t i = 0; i < tail; i++, h++)
+				setPixel(x + w, y + h, src.color(w, h));
+		}
+	}
+};
+
+#endif /* EINK_CLICK_FRAMEBUFFER_HPP_ */
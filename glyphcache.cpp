@@ -0,0 +1,94 @@
+/*
+ * Copyright (C) 2020 Daniel Igaz
+ *
+ * This file is part of the eINK-click project.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "glyphcache.hpp"
+
+GlyphCache::GlyphCache(uint8_t* arena, size_t size)
+: _clock(0)
+, _stats()
+{
+	osalDbgCheck(arena != NULL);
+
+	// align the slot headers
+	size_t pad = (sizeof(void*) - (uintptr_t(arena) & (sizeof(void*) - 1))) & (sizeof(void*) - 1);
+	size = (size > pad) ? size - pad : 0;
+
+	_entries = (Entry*)(arena + pad);
+	_count = size / (sizeof(Entry) + GLYPH_CACHE_SLOT_SIZE);
+	_slots = arena + pad + _count * sizeof(Entry);
+
+	clear();
+}
+
+void GlyphCache::clear()
+{
+	for (size_t i = 0; i < _count; i++)
+		_entries[i].font = NULL;
+}
+
+const uint8_t* GlyphCache::find(const void* font, uint16_t c, uint8_t color, uint8_t bkgColor, uint8_t phase)
+{
+	for (size_t i = 0; i < _count; i++) {
+		Entry& e = _entries[i];
+
+		if (e.font == font && e.c == c && e.color == color &&
+				e.bkgColor == bkgColor && e.phase == phase) {
+			e.stamp = ++_clock;
+			_stats.hits++;
+			return _slots + i * GLYPH_CACHE_SLOT_SIZE;
+		}
+	}
+
+	_stats.misses++;
+
+	return NULL;
+}
+
+uint8_t* GlyphCache::insert(const void* font, uint16_t c, uint8_t color, uint8_t bkgColor, uint8_t phase, size_t n)
+{
+	if (n > GLYPH_CACHE_SLOT_SIZE || _count == 0)
+		return NULL;
+
+	// take an empty slot or the least recently used one
+	size_t lru = 0;
+
+	for (size_t i = 0; i < _count; i++) {
+		if (_entries[i].font == NULL) {
+			lru = i;
+			break;
+		}
+		// the oldest use, safe across clock wrap-around
+		if (_clock - _entries[i].stamp > _clock - _entries[lru].stamp)
+			lru = i;
+	}
+
+	Entry& e = _entries[lru];
+
+	if (e.font != NULL)
+		_stats.evictions++;
+
+	e.font = font;
+	e.stamp = ++_clock;
+	e.c = c;
+	e.color = color;
+	e.bkgColor = bkgColor;
+	e.phase = phase;
+
+	return _slots + lru * GLYPH_CACHE_SLOT_SIZE;
+}
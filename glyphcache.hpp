@@ -0,0 +1,111 @@
+/*
+ * Copyright (C) 2020 Daniel Igaz
+ *
+ * This file is part of the eINK-click project.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef EINK_CLICK_GLYPHCACHE_HPP_
+#define EINK_CLICK_GLYPHCACHE_HPP_
+
+#include "hal.h"
+
+/**
+ * @brief	Size of a glyph cache slot in bytes.
+ * @details	Glyphs needing more RAM bytes are not cached.
+ */
+#if !defined(GLYPH_CACHE_SLOT_SIZE)
+#define GLYPH_CACHE_SLOT_SIZE	64
+#endif
+
+/**
+ * @brief	LRU cache of glyphs packed into RAM bytes.
+ * @details	A glyph is stored as the RAM bytes of its columns for a given
+ * 			font, character, drawing and background color and vertical
+ * 			position modulo 4, ready to be sent through a single RAM
+ * 			address window. Slots of @p GLYPH_CACHE_SLOT_SIZE bytes are
+ * 			carved from a caller provided arena, the least recently used
+ * 			slot is replaced on a miss.
+ */
+class GlyphCache {
+public:
+	/**
+	 * @brief	Cache statistics.
+	 */
+	typedef struct {
+		uint32_t hits;			///< Lookups finding the glyph.
+		uint32_t misses;		///< Lookups not finding the glyph.
+		uint32_t evictions;		///< Glyphs replaced by others.
+	} Stats;
+
+private:
+	/**
+	 * @brief	Cache slot header.
+	 */
+	typedef struct {
+		const void* font;		///< Font, @p NULL for an empty slot.
+		uint32_t stamp;			///< Last use.
+		uint16_t c;				///< Character code.
+		uint8_t color;			///< Drawing color.
+		uint8_t bkgColor;		///< Background color.
+		uint8_t phase;			///< Vertical position modulo 4.
+	} Entry;
+
+	Entry* _entries;			///< Slot headers.
+	uint8_t* _slots;			///< Slot data.
+	size_t _count;				///< Number of slots.
+	uint32_t _clock;			///< Use counter.
+	Stats _stats;				///< Statistics.
+
+public:
+	/**
+	 * @param[in] arena		pointer to the cache memory
+	 * @param[in] size		size of the cache memory in bytes
+	 */
+	GlyphCache(uint8_t* arena, size_t size);
+
+	/** @brief	Get the number of slots. */
+	size_t slots() const { return _count; }
+
+	/**
+	 * @brief	Find a glyph.
+	 *
+	 * @returns	Pointer to the glyph RAM bytes or @p NULL on a miss.
+	 */
+	const uint8_t* find(const void* font, uint16_t c, uint8_t color, uint8_t bkgColor, uint8_t phase);
+
+	/**
+	 * @brief	Allocate a slot for a glyph.
+	 * @details	Replaces the least recently used glyph, the caller fills
+	 * 			in the RAM bytes.
+	 *
+	 * @param[in] n		number of glyph RAM bytes
+	 *
+	 * @returns	Pointer to the slot data or @p NULL if the glyph does not
+	 * 			fit a slot.
+	 */
+	uint8_t* insert(const void* font, uint16_t c, uint8_t color, uint8_t bkgColor, uint8_t phase, size_t n);
+
+	/** @brief	Drop all glyphs. */
+	void clear();
+
+	/** @brief	Get the statistics. */
+	const Stats& stats() const { return _stats; }
+
+	/** @brief	Reset the statistics. */
+	void resetStats() { _stats = Stats(); }
+};
+
+#endif /* EINK_CLICK_GLYPHCACHE_HPP_ */
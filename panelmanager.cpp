@@ -0,0 +1,99 @@
+/*
+ * Copyright (C) 2020 Daniel Igaz
+ *
+ * This file is part of the eINK-click project.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "panelmanager.hpp"
+
+PanelManager::PanelManager(EPD* const* panels, size_t count)
+: _panels(panels)
+, _count(count)
+, _stats()
+{
+	osalDbgCheck(panels != NULL && count > 0 && count <= 32);
+}
+
+void PanelManager::refresh(RenderCallback cb, void* arg, SSD16xx::UpdateMode mode)
+{
+	uint32_t remaining = (_count == 32) ? UINT32_MAX : (1UL << _count) - 1;
+
+	while (remaining != 0) {
+		size_t next = _count;
+		size_t first = _count;
+		sysinterval_t firstEta = 0;
+		sysinterval_t firstElapsed = 0;
+		bool refreshing = false;
+
+		// serve an idle panel first, the one ending first otherwise
+		for (size_t i = 0; i < _count; i++) {
+			EPD* epd = _panels[i];
+
+			if (busy(epd)) {
+				refreshing = true;
+
+				// without an estimate the earliest start wins
+				sysinterval_t eta = epd->updateRemaining();
+				sysinterval_t elapsed = epd->updateElapsed();
+				if ((remaining & (1UL << i)) && (first == _count || eta < firstEta
+						|| (eta == firstEta && elapsed > firstElapsed))) {
+					first = i;
+					firstEta = eta;
+					firstElapsed = elapsed;
+				}
+				continue;
+			}
+			if ((remaining & (1UL << i)) && next == _count)
+				next = i;
+		}
+
+		if (next == _count) {
+			next = first;
+			_stats.stalls++;
+		}
+		else if (refreshing) {
+			_stats.overlapped++;
+		}
+
+		// a pending upload of another panel holds the shared bus
+		for (size_t i = 0; i < _count; i++) {
+			if (i != next)
+				_panels[i]->waitUpload(TIME_INFINITE);
+		}
+
+		EPD* epd = _panels[next];
+
+		if (cb != NULL)
+			cb(epd, next, arg);
+
+		epd->startUpdateDisplay(mode);
+
+		_stats.updates++;
+		remaining &= ~(1UL << next);
+	}
+
+	_stats.rounds++;
+}
+
+msg_t PanelManager::waitAll(sysinterval_t timeout)
+{
+	for (size_t i = 0; i < _count; i++) {
+		if (_panels[i]->waitUpdateDisplay(timeout) != MSG_OK)
+			return MSG_TIMEOUT;
+	}
+
+	return MSG_OK;
+}
@@ -0,0 +1,125 @@
+/*
+ * Copyright (C) 2020 Daniel Igaz
+ *
+ * This file is part of the eINK-click project.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef EINK_CLICK_PANELMANAGER_HPP_
+#define EINK_CLICK_PANELMANAGER_HPP_
+
+#include "epd.hpp"
+
+/**
+ * @brief	Several displays sharing one SPI bus.
+ * @details	Display updates are started without waiting, the BUSY line of
+ * 			each panel ends its own update. While a panel refreshes, the
+ * 			next panel is drawn and its RAM uploaded, so the refreshes
+ * 			overlap and a round over all panels takes about one refresh
+ * 			plus the uploads instead of the sum of the refreshes. Panels
+ * 			whose previous update has ended are served first, then the
+ * 			one expected to end first.
+ * @note	Each SSD16xx needs its own SPI configuration with its chip
+ * 			select line and its own BUSY line.
+ * @note	A pending SSD16xx::startUpload() holds the shared bus, the
+ * 			uploads of the other panels are finished before a panel is
+ * 			drawn.
+ */
+class PanelManager {
+public:
+	/**
+	 * @brief	Panel drawing callback.
+	 *
+	 * @param[in] epd		panel to draw
+	 * @param[in] index		panel index
+	 * @param[in] arg		callback argument
+	 */
+	typedef void (*RenderCallback)(EPD* epd, size_t index, void* arg);
+
+	/**
+	 * @brief	Manager statistics.
+	 */
+	typedef struct {
+		uint32_t rounds;		///< Rounds over all panels.
+		uint32_t updates;		///< Display updates started.
+		uint32_t overlapped;	///< Panels drawn while another one refreshed.
+		uint32_t stalls;		///< Panels drawn while still refreshing.
+	} Stats;
+
+private:
+	EPD* const* _panels;		///< Managed displays.
+	size_t _count;				///< Number of displays.
+	Stats _stats;				///< Statistics.
+
+	/**
+	 * @brief	Check whether a panel refreshes.
+	 */
+	static bool busy(EPD* epd) { return epd->waitUpdateDisplay(TIME_IMMEDIATE) != MSG_OK; }
+
+public:
+	/**
+	 * @param[in] panels	pointer to the managed displays
+	 * @param[in] count		number of displays, 32 at most
+	 */
+	PanelManager(EPD* const* panels, size_t count);
+
+	/** @brief	Get the number of displays. */
+	size_t count() const { return _count; }
+
+	/** @brief	Get display @p i. */
+	EPD& panel(size_t i) const { return *_panels[i]; }
+
+	/**
+	 * @brief	Draw and update all displays.
+	 * @details	Each display is drawn by the callback and its update is
+	 * 			started right after, idle displays first, then the one
+	 * 			whose update is expected to end first. Returns once the
+	 * 			last update is started, see waitAll().
+	 *
+	 * @param[in] cb		drawing callback or @p NULL to send what was
+	 * 						drawn already
+	 * @param[in] arg		callback argument
+	 * @param[in] mode		requested waveform
+	 */
+	void refresh(RenderCallback cb, void* arg, SSD16xx::UpdateMode mode = SSD16xx::UPDATE_FULL);
+
+	/**
+	 * @brief	Update all displays with what was drawn already.
+	 * @see		refresh()
+	 *
+	 * @param[in] mode		requested waveform
+	 */
+	void updateAll(SSD16xx::UpdateMode mode = SSD16xx::UPDATE_FULL) { refresh(NULL, NULL, mode); }
+
+	/**
+	 * @brief	Wait for the updates of all displays to end.
+	 *
+	 * @param[in] timeout	the number of ticks before the operation
+	 * 						timeouts, for each display
+	 *
+	 * @returns	The operation status.
+	 * @retval MSG_OK		if all updates ended.
+	 * @retval MSG_TIMEOUT	if an update is still in progress.
+	 */
+	msg_t waitAll(sysinterval_t timeout);
+
+	/** @brief	Get the statistics. */
+	const Stats& stats() const { return _stats; }
+
+	/** @brief	Reset the statistics. */
+	void resetStats() { _stats = Stats(); }
+};
+
+#endif /* EINK_CLICK_PANELMANAGER_HPP_ */
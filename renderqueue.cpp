@@ -0,0 +1,306 @@
+/*
+ * Copyright (C) 2020 Daniel Igaz
+ *
+ * This file is part of the eINK-click project.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "renderqueue.hpp"
+#include <string.h>
+
+RenderQueue::RenderQueue(EPD& epd, Command* cmds, uint16_t maxCmds, char* pool, uint16_t poolSize)
+: _epd(epd)
+, _cmds(cmds)
+, _maxCmds(maxCmds)
+, _head(0)
+, _tail(0)
+, _pool(pool)
+, _poolSize(poolSize)
+, _poolHead(0)
+, _poolTail(0)
+, _poolUsed(0)
+, _worker(NULL)
+, _scheduler(NULL)
+, _wakeup(false)
+, _stats()
+{
+	osalDbgCheck(cmds != NULL && maxCmds > 0 && (pool != NULL || poolSize == 0));
+}
+
+RenderQueue::Command* RenderQueue::reserveS(uint16_t textSize)
+{
+	uint16_t text = 0;
+
+	if (_stats.depth == _maxCmds)
+		return NULL;
+
+	if (textSize > 0) {
+		if (_poolUsed == 0) {
+			_poolHead = 0;
+			_poolTail = 0;
+		}
+
+		if (_poolUsed == _poolSize || textSize > _poolSize)
+			return NULL;
+
+		if (_poolHead >= _poolTail && _poolSize - _poolHead >= textSize) {
+			text = _poolHead;
+			_poolUsed += textSize;
+		}
+		else if (_poolHead >= _poolTail && _poolTail >= textSize) {
+			// skip the pool end, the text must be contiguous
+			text = 0;
+			_poolUsed += _poolSize - _poolHead + textSize;
+		}
+		else if (_poolHead < _poolTail && _poolTail - _poolHead >= textSize) {
+			text = _poolHead;
+			_poolUsed += textSize;
+		}
+		else {
+			return NULL;
+		}
+
+		_poolHead = text + textSize;
+	}
+
+	Command* cmd = &_cmds[_head];
+	_head = (_head + 1 == _maxCmds) ? 0 : _head + 1;
+
+	if (++_stats.depth > _stats.maxDepth)
+		_stats.maxDepth = _stats.depth;
+
+	cmd->ready = false;
+	cmd->text = text;
+	cmd->textSize = textSize;
+
+	return cmd;
+}
+
+bool RenderQueue::post(Command* cmd)
+{
+	cmd->time = chVTGetSystemTimeX();
+
+	osalSysLock();
+	cmd->ready = true;
+	_stats.posted++;
+	osalThreadResumeS(&_worker, MSG_OK);
+	osalSysUnlock();
+
+	return true;
+}
+
+bool RenderQueue::post(CommandType type, uint8_t color, uint16_t x, uint16_t y,
+		uint16_t width, uint16_t height, uint8_t arg, const void* ptr)
+{
+	osalSysLock();
+	Command* cmd = reserveS(0);
+	if (cmd == NULL)
+		_stats.rejected++;
+	osalSysUnlock();
+
+	if (cmd == NULL)
+		return false;
+
+	cmd->type = type;
+	cmd->color = color;
+	cmd->arg = arg;
+	cmd->x = x;
+	cmd->y = y;
+	cmd->width = width;
+	cmd->height = height;
+	cmd->ptr = ptr;
+
+	return post(cmd);
+}
+
+bool RenderQueue::drawText(EPD::Color color, uint16_t x, uint16_t y, const char* str, EPD::Align align)
+{
+	osalDbgCheck(str != NULL);
+
+	size_t n = strlen(str) + 1;
+
+	osalSysLock();
+	Command* cmd = (n <= UINT16_MAX) ? reserveS(n) : NULL;
+	if (cmd == NULL)
+		_stats.rejected++;
+	osalSysUnlock();
+
+	if (cmd == NULL)
+		return false;
+
+	// the slot is not published yet, copy outside the lock
+	memcpy(_pool + cmd->text, str, n);
+
+	cmd->type = CMD_TEXT;
+	cmd->color = color;
+	cmd->arg = align;
+	cmd->x = x;
+	cmd->y = y;
+	cmd->width = 0;
+	cmd->height = 0;
+	cmd->ptr = NULL;
+
+	return post(cmd);
+}
+
+void RenderQueue::releaseS()
+{
+	const Command& cmd = _cmds[_tail];
+
+	if (cmd.textSize > 0) {
+		// texts are released in order, a wrapped one frees the skipped end
+		if (cmd.text >= _poolTail)
+			_poolUsed -= cmd.text + cmd.textSize - _poolTail;
+		else
+			_poolUsed -= _poolSize - _poolTail + cmd.text + cmd.textSize;
+		_poolTail = cmd.text + cmd.textSize;
+	}
+
+	_tail = (_tail + 1 == _maxCmds) ? 0 : _tail + 1;
+	_stats.depth--;
+}
+
+void RenderQueue::execute(const Command& cmd)
+{
+	EPD::Color color = EPD::Color(cmd.color);
+
+	switch (cmd.type) {
+	case CMD_FILL:
+		_epd.fillDisplay(color);
+		break;
+	case CMD_BKG_COLOR:
+		_epd.setBkgColor(color);
+		break;
+	case CMD_FONT:
+		_epd.setFont((const uint8_t*)cmd.ptr);
+		break;
+	case CMD_RECT:
+		_epd.drawFilledRect(color, cmd.x, cmd.y, cmd.width, cmd.height);
+		break;
+	case CMD_TEXT:
+		_epd.drawText(color, cmd.x, cmd.y, _pool + cmd.text, EPD::Align(cmd.arg));
+		break;
+	case CMD_LINE:
+		_epd.drawLine(color, cmd.x, cmd.y, cmd.width, cmd.height);
+		break;
+	case CMD_OUTLINE:
+		_epd.drawRect(color, cmd.x, cmd.y, cmd.width, cmd.height);
+		break;
+	case CMD_CIRCLE:
+		_epd.drawCircle(color, cmd.x, cmd.y, cmd.width);
+		break;
+	case CMD_IMAGE:
+		_epd.drawImage(cmd.x, cmd.y, *(const EPD::Image*)cmd.ptr);
+		break;
+	case CMD_UPDATE:
+		if (_scheduler != NULL)
+			_scheduler->request(SSD16xx::UpdateMode(cmd.arg), UpdateScheduler::Priority(cmd.color));
+		else
+			_epd.startUpdateDisplay(SSD16xx::UpdateMode(cmd.arg));
+		break;
+	}
+}
+
+size_t RenderQueue::process(sysinterval_t timeout)
+{
+	size_t n = 0;
+
+	osalSysLock();
+	while (_stats.depth == 0 || !_cmds[_tail].ready) {
+		// let the caller run the scheduler, also for requests made
+		// before the worker got here
+		if (_wakeup) {
+			_wakeup = false;
+			osalSysUnlock();
+			return 0;
+		}
+		if (osalThreadSuspendTimeoutS(&_worker, timeout) == MSG_TIMEOUT) {
+			osalSysUnlock();
+			return 0;
+		}
+	}
+	osalSysUnlock();
+
+	// keep the bus free for other devices while the display refreshes
+	_epd.waitUpdateDisplay(TIME_INFINITE);
+
+	EPD::Session session(_epd);
+	bool more = true;
+
+	while (more) {
+		const Command& cmd = _cmds[_tail];
+		CommandType type = cmd.type;
+
+		execute(cmd);
+		n++;
+
+		osalSysLock();
+		sysinterval_t latency = chVTTimeElapsedSinceX(cmd.time);
+		if (latency > _stats.maxLatency)
+			_stats.maxLatency = latency;
+		_stats.totalLatency += latency;
+		_stats.executed++;
+		releaseS();
+		more = type != CMD_UPDATE && _stats.depth > 0 && _cmds[_tail].ready;
+		osalSysUnlock();
+	}
+
+	_stats.batches++;
+
+	return n;
+}
+
+void RenderQueue::wakeupS(void* arg)
+{
+	RenderQueue* queue = (RenderQueue*)arg;
+
+	queue->_wakeup = true;
+	osalThreadResumeS(&queue->_worker, MSG_OK);
+}
+
+void RenderQueue::setScheduler(UpdateScheduler* scheduler)
+{
+	if (_scheduler != NULL)
+		_scheduler->setRequestCallback(NULL, NULL);
+
+	_scheduler = scheduler;
+
+	if (scheduler != NULL)
+		scheduler->setRequestCallback(wakeupS, this);
+}
+
+void RenderQueue::thread(void* arg)
+{
+	RenderQueue* queue = (RenderQueue*)arg;
+
+	for (;;) {
+		// sleep until the next command or the pending update is due
+		sysinterval_t timeout = TIME_INFINITE;
+		if (queue->_scheduler != NULL)
+			timeout = queue->_scheduler->process();
+
+		queue->process(timeout);
+	}
+}
+
+void RenderQueue::resetStats()
+{
+	osalSysLock();
+	uint16_t depth = _stats.depth;
+	_stats = Stats();
+	_stats.depth = depth;
+	_stats.maxDepth = depth;
+	osalSysUnlock();
+}
@@ -0,0 +1,239 @@
+/*
+ * Copyright (C) 2020 Daniel Igaz
+ *
+ * This file is part of the eINK-click project.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef EINK_CLICK_RENDERQUEUE_HPP_
+#define EINK_CLICK_RENDERQUEUE_HPP_
+
+#include "epd.hpp"
+#include "updatescheduler.hpp"
+
+/**
+ * @brief	Drawing command queue of an EPD rendering thread.
+ * @details	Application threads post drawing commands and return at once,
+ * 			a single worker thread running thread() executes them and is
+ * 			the only one touching the EPD and its SPI bus. The queue is
+ * 			bounded, posting to a full queue fails. Texts are copied to a
+ * 			fixed ring pool released in queue order. Commands and text
+ * 			live in caller provided memory.
+ *
+ * 			Producers only hold the system lock to reserve and to publish
+ * 			a slot, the command and its text are written in between, so
+ * 			any number of threads may post. Posting uses the thread
+ * 			lock, it must not be done from ISRs. The worker drains the
+ * 			published commands in batches, each one within a single
+ * 			bus session ended by a display update.
+ *
+ * @code
+ * static THD_WORKING_AREA(waEpd, 512);
+ * chThdCreateStatic(waEpd, sizeof(waEpd), NORMALPRIO, RenderQueue::thread, &queue);
+ * @endcode
+ */
+class RenderQueue {
+public:
+	/**
+	 * @brief	Drawing command type.
+	 */
+	typedef enum : uint8_t {
+		CMD_FILL = 0,			///< EPD::fillDisplay().
+		CMD_BKG_COLOR = 1,		///< EPD::setBkgColor().
+		CMD_FONT = 2,			///< EPD::setFont().
+		CMD_RECT = 3,			///< EPD::drawFilledRect().
+		CMD_TEXT = 4,			///< EPD::drawText().
+		CMD_LINE = 5,			///< EPD::drawLine().
+		CMD_OUTLINE = 6,		///< EPD::drawRect().
+		CMD_CIRCLE = 7,			///< EPD::drawCircle().
+		CMD_IMAGE = 8,			///< EPD::drawImage().
+		CMD_UPDATE = 9,			///< Display update or request, ends a batch.
+	} CommandType;
+
+	/**
+	 * @brief	Queued drawing command.
+	 */
+	typedef struct {
+		CommandType type;		///< Command type.
+		uint8_t color;			///< Drawing color or update priority.
+		uint8_t arg;			///< Text alignment or update mode.
+		volatile bool ready;	///< Written by the producer.
+		uint16_t x;				///< Horizontal location.
+		uint16_t y;				///< Vertical location.
+		uint16_t width;			///< Width, line end x or radius.
+		uint16_t height;		///< Height or line end y.
+		uint16_t text;			///< Offset of the text in the pool.
+		uint16_t textSize;		///< Pool bytes of the text.
+		const void* ptr;		///< Font or image.
+		systime_t time;			///< Posting time.
+	} Command;
+
+	/**
+	 * @brief	Queue statistics.
+	 */
+	typedef struct {
+		uint32_t posted;		///< Commands posted.
+		uint32_t rejected;		///< Commands rejected, queue or pool full.
+		uint32_t executed;		///< Commands executed.
+		uint32_t batches;		///< Batches executed.
+		uint16_t depth;			///< Commands in the queue.
+		uint16_t maxDepth;		///< Highest number of commands in the queue.
+		sysinterval_t maxLatency;	///< Longest time from posting to execution end.
+		uint64_t totalLatency;	///< Sum of the times from posting to execution end.
+	} Stats;
+
+private:
+	EPD& _epd;					///< Display drawn by the worker.
+	Command* _cmds;				///< Command ring.
+	uint16_t _maxCmds;			///< Capacity of @p _cmds.
+	uint16_t _head;				///< Next slot to reserve.
+	uint16_t _tail;				///< Oldest queued slot.
+	char* _pool;				///< Text pool ring.
+	uint16_t _poolSize;			///< Capacity of the text pool.
+	uint16_t _poolHead;			///< Next free pool byte.
+	uint16_t _poolTail;			///< First pool byte in use.
+	uint16_t _poolUsed;			///< Pool bytes in use, skipped ones included.
+	thread_reference_t _worker;	///< Worker waiting for commands.
+	UpdateScheduler* _scheduler;	///< Scheduler of the display updates or @p NULL.
+	bool _wakeup;				///< Update requested since the worker last woke.
+	Stats _stats;				///< Statistics.
+
+	/**
+	 * @brief	Reserve a slot and @p textSize bytes of text pool.
+	 * @note	Must be called in locked state.
+	 *
+	 * @returns	The reserved slot or @p NULL if the queue or the pool is full.
+	 */
+	Command* reserveS(uint16_t textSize);
+
+	/**
+	 * @brief	Wake the worker to run the scheduler.
+	 * @note	Request callback of the scheduler, called in locked state.
+	 */
+	static void wakeupS(void* arg);
+
+	/**
+	 * @brief	Publish a reserved slot and wake the worker.
+	 */
+	bool post(Command* cmd);
+
+	/**
+	 * @brief	Reserve, fill and publish a command without text.
+	 */
+	bool post(CommandType type, uint8_t color, uint16_t x, uint16_t y,
+			uint16_t width, uint16_t height, uint8_t arg = 0, const void* ptr = NULL);
+
+	/**
+	 * @brief	Release the oldest slot and its text.
+	 * @note	Must be called in locked state.
+	 */
+	void releaseS();
+
+	/**
+	 * @brief	Execute a command.
+	 */
+	void execute(const Command& cmd);
+
+public:
+	/**
+	 * @param[in] epd		display drawn by the worker
+	 * @param[in] cmds		pointer to the command memory
+	 * @param[in] maxCmds	number of commands
+	 * @param[in] pool		pointer to the text pool memory
+	 * @param[in] poolSize	size of the text pool in bytes
+	 */
+	RenderQueue(EPD& epd, Command* cmds, uint16_t maxCmds, char* pool, uint16_t poolSize);
+
+	/**
+	 * @name	Producer side
+	 * @brief	Post a drawing command.
+	 * @details	The arguments are those of the EPD function of the same
+	 * 			name. Texts are copied, fonts and images must outlive the
+	 * 			command.
+	 * @returns	@p false if the queue or the text pool is full.
+	 * @{
+	 */
+	bool fillDisplay(EPD::Color color) { return post(CMD_FILL, color, 0, 0, 0, 0); }
+	bool setBkgColor(EPD::Color color) { return post(CMD_BKG_COLOR, color, 0, 0, 0, 0); }
+	bool setFont(const uint8_t* bp) { return post(CMD_FONT, 0, 0, 0, 0, 0, 0, bp); }
+	bool drawFilledRect(EPD::Color color, uint16_t x, uint16_t y, uint16_t width, uint16_t height) {
+		return post(CMD_RECT, color, x, y, width, height);
+	}
+	bool drawText(EPD::Color color, uint16_t x, uint16_t y, const char* str,
+			EPD::Align align = EPD::ALIGN_LEFT);
+	bool drawLine(EPD::Color color, uint16_t x0, uint16_t y0, uint16_t x1, uint16_t y1) {
+		return post(CMD_LINE, color, x0, y0, x1, y1);
+	}
+	bool drawRect(EPD::Color color, uint16_t x, uint16_t y, uint16_t width, uint16_t height) {
+		return post(CMD_OUTLINE, color, x, y, width, height);
+	}
+	bool drawCircle(EPD::Color color, uint16_t x, uint16_t y, uint16_t r) {
+		return post(CMD_CIRCLE, color, x, y, r, 0);
+	}
+	bool drawImage(uint16_t x, uint16_t y, const EPD::Image& image) {
+		return post(CMD_IMAGE, 0, x, y, 0, 0, 0, &image);
+	}
+	bool updateDisplay(SSD16xx::UpdateMode mode = SSD16xx::UPDATE_FULL,
+			UpdateScheduler::Priority priority = UpdateScheduler::PRIORITY_COSMETIC) {
+		return post(CMD_UPDATE, priority, 0, 0, 0, 0, mode);
+	}
+	/** @} */
+
+	/**
+	 * @brief	Execute one batch of commands.
+	 * @details	Waits for the first command, then executes the published
+	 * 			ones in order within one bus session, up to and including
+	 * 			a display update. An update request to the scheduler ends
+	 * 			the wait without executing anything.
+	 * @note	To be called by the worker thread only.
+	 *
+	 * @param[in] timeout	the number of ticks to wait for a command
+	 *
+	 * @returns	The number of executed commands.
+	 */
+	size_t process(sysinterval_t timeout);
+
+	/**
+	 * @brief	Route the display updates through a scheduler.
+	 * @details	Update commands become update requests and the worker
+	 * 			thread runs the scheduler between batches. Without a
+	 * 			scheduler the updates start right away, the priority is
+	 * 			ignored.
+	 * 			The request callback of the scheduler is set to wake the
+	 * 			worker thread.
+	 * @note	To be set before starting the worker thread.
+	 *
+	 * @param[in] scheduler		scheduler or @p NULL
+	 */
+	void setScheduler(UpdateScheduler* scheduler);
+
+	/**
+	 * @brief	Worker thread function.
+	 *
+	 * @param[in] arg		the RenderQueue
+	 */
+	static void thread(void* arg);
+
+	/** @brief	Get the number of queued commands. */
+	uint16_t depth() const { return _stats.depth; }
+
+	/** @brief	Get the statistics. */
+	const Stats& stats() const { return _stats; }
+
+	/** @brief	Reset the statistics, the queue depth is kept. */
+	void resetStats();
+};
+
+#endif /* EINK_CLICK_RENDERQUEUE_HPP_ */
@@ -0,0 +1,133 @@
+/*
+ * Copyright (C) 2020 Daniel Igaz
+ *
+ * This file is part of the eINK-click project.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "rle.hpp"
+#include <string.h>
+
+RleDecoder::RleDecoder(const uint8_t* bp, size_t n, uint16_t stride)
+: _begin(bp)
+, _end(bp + n)
+, _stride(stride)
+{
+	osalDbgCheck(bp != NULL);
+
+	reset();
+}
+
+void RleDecoder::reset()
+{
+	_bp = _begin;
+	_lit = NULL;
+	_run = 0;
+	_type = 0;
+	_value = 0;
+	_pos = 0;
+	_error = _stride == 0 || _stride > RLE_MAX_STRIDE;
+	memset(_ring, 0, sizeof(_ring));
+}
+
+size_t RleDecoder::next(const uint8_t** bp, uint8_t* value, size_t max)
+{
+	if (_error)
+		return 0;
+
+	if (_run == 0) {
+		if (_bp >= _end)
+			return 0;
+
+		_type = *_bp++;
+
+		// the literal bytes or the repeated byte must be in the stream
+		size_t need = (_type < 0x80) ? _type + 1 : (_type < 0xC0) ? 1 : 0;
+
+		if (need > size_t(_end - _bp)) {
+			_error = true;
+			_bp = _end;
+			return 0;
+		}
+
+		if (_type < 0x80) {
+			_run = _type + 1;
+			_lit = _bp;
+			_bp += _run;
+		}
+		else if (_type < 0xC0) {
+			_run = _type - 0x7E;
+			_value = *_bp++;
+		}
+		else {
+			_run = _type - 0xBF;
+		}
+	}
+
+	// stay within the ring, it holds the copied bytes
+	size_t n = _stride - _pos;
+	if (n > _run)
+		n = _run;
+	if (n > max)
+		n = max;
+
+	if (_type < 0x80) {
+		*bp = _lit;
+		memcpy(_ring + _pos, _lit, n);
+		_lit += n;
+	}
+	else if (_type < 0xC0) {
+		*bp = NULL;
+		*value = _value;
+		memset(_ring + _pos, _value, n);
+	}
+	else {
+		// the byte one column back sits at the same ring position
+		*bp = _ring + _pos;
+	}
+
+	_pos += n;
+	if (_pos == _stride)
+		_pos = 0;
+	_run -= n;
+
+	return n;
+}
+
+size_t RleDecoder::next(const uint8_t** bp, size_t max)
+{
+	uint8_t value;
+	size_t n = next(bp, &value, max);
+
+	if (n > 0 && *bp == NULL)
+		*bp = _ring + ((_pos >= n) ? _pos - n : _pos + _stride - n);
+
+	return n;
+}
+
+size_t RleDecoder::read(uint8_t* bp, size_t n)
+{
+	const uint8_t* src;
+	size_t total = 0;
+	size_t len;
+
+	while (total < n && (len = next(&src, n - total)) > 0) {
+		if (bp != NULL)
+			memcpy(bp + total, src, len);
+		total += len;
+	}
+
+	return total;
+}
@@ -0,0 +1,113 @@
+/*
+ * Copyright (C) 2020 Daniel Igaz
+ *
+ * This file is part of the eINK-click project.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef EINK_CLICK_RLE_HPP_
+#define EINK_CLICK_RLE_HPP_
+
+#include "hal.h"
+
+/**
+ * @brief	Maximum RAM bytes per image column, size of the history ring.
+ */
+#if !defined(RLE_MAX_STRIDE)
+#define RLE_MAX_STRIDE			64
+#endif
+
+/**
+ * @brief	Streaming decoder of run-length encoded RAM data.
+ * @details	The RAM bytes of an image, column after column, are encoded as
+ * 			a sequence of runs, each starting with a control byte @p c:
+ * 			- @p c < 0x80: @p c + 1 literal bytes follow,
+ * 			- 0x80 <= @p c < 0xC0: the next byte is repeated @p c - 0x7E
+ * 			  times,
+ * 			- @p c >= 0xC0: @p c - 0xBF bytes are copied from the previous
+ * 			  column.
+ *
+ * 			Runs are not bound to image columns. The last column is kept
+ * 			in a ring of @p stride bytes, so an image is decoded piece by
+ * 			piece without a buffer for the whole image.
+ *
+ * 			Decoding stops at a run overrunning the stream, a stride
+ * 			above @p RLE_MAX_STRIDE yields no data, see error().
+ */
+class RleDecoder {
+	const uint8_t* _begin;		///< Start of the encoded stream.
+	const uint8_t* _bp;			///< Next encoded byte.
+	const uint8_t* _end;		///< End of the encoded stream.
+	const uint8_t* _lit;		///< Literal bytes of the current run.
+	size_t _run;				///< Bytes left in the current run.
+	uint8_t _type;				///< Control byte of the current run.
+	uint8_t _value;				///< Repeated byte of the current run.
+	uint16_t _stride;			///< Bytes per image column.
+	uint16_t _pos;				///< Ring position of the next byte.
+	bool _error;				///< Malformed stream or stride.
+	uint8_t _ring[RLE_MAX_STRIDE + 1];	///< Last @p stride decoded bytes and a spare one.
+
+public:
+	/**
+	 * @param[in] bp		pointer to the encoded stream
+	 * @param[in] n			encoded stream size in bytes
+	 * @param[in] stride	bytes per image column
+	 */
+	RleDecoder(const uint8_t* bp, size_t n, uint16_t stride);
+
+	/** @brief	Restart at the beginning of the stream. */
+	void reset();
+
+	/**
+	 * @brief	Get the next piece of the current run.
+	 * @details	The bytes are returned in place, in the encoded stream or
+	 * 			in the ring, and stay valid until the next call.
+	 *
+	 * @param[out] bp		decoded bytes
+	 * @param[in] max		maximum number of bytes
+	 *
+	 * @returns	The number of decoded bytes, 0 at the end of the stream.
+	 */
+	size_t next(const uint8_t** bp, size_t max);
+
+	/**
+	 * @brief	Get the next piece of a repeat run.
+	 * @details	Like next() but a repeat run is returned as a single byte
+	 * 			value with @p bp set to @p NULL.
+	 */
+	size_t next(const uint8_t** bp, uint8_t* value, size_t max);
+
+	/**
+	 * @brief	Decode bytes into memory.
+	 *
+	 * @param[out] bp		pointer to the output buffer or @p NULL to skip
+	 * @param[in] n			number of bytes to decode
+	 *
+	 * @returns	The number of decoded bytes, less than @p n at the end of
+	 * 			the stream.
+	 */
+	size_t read(uint8_t* bp, size_t n);
+
+	/**
+	 * @brief	Get the last decoded column.
+	 * @note	Only valid when a whole number of columns has been decoded.
+	 */
+	const uint8_t* column() const { return _ring; }
+
+	/** @brief	Check whether decoding stopped on a malformed stream. */
+	bool error() const { return _error; }
+};
+
+#endif /* EINK_CLICK_RLE_HPP_ */
@@ -0,0 +1,185 @@
+/*
+ * Copyright (C) 2020 Daniel Igaz
+ *
+ * This file is part of the eINK-click project.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef EINK_CLICK_SHAPES_HPP_
+#define EINK_CLICK_SHAPES_HPP_
+
+#include "hal.h"
+
+/*
+ * Shape rasterizers.
+ *
+ * Shapes are broken into rectangles passed to a callable
+ * rect(x, y, width, height) with signed coordinates, possibly outside
+ * the display. Outlines come out as vertical runs, one per column and
+ * shape part, so a RAM layout buffer is filled along its packed
+ * direction instead of pixel by pixel.
+ */
+
+/**
+ * @brief	Rasterize a line with Bresenham's algorithm.
+ * @details	The pixels of a column are merged into a single run.
+ */
+template<typename Rect>
+void shapeLine(int16_t x0, int16_t y0, int16_t x1, int16_t y1, Rect rect)
+{
+	if (x0 > x1) {
+		int16_t t = x0;
+		x0 = x1;
+		x1 = t;
+		t = y0;
+		y0 = y1;
+		y1 = t;
+	}
+
+	int32_t dx = x1 - x0;
+	int32_t dy = (y1 > y0) ? y1 - y0 : y0 - y1;
+	int16_t sy = (y1 > y0) ? 1 : -1;
+	int32_t err = dx - dy;
+	int16_t x = x0;
+	int16_t y = y0;
+	int16_t run = y0;
+
+	while (x != x1 || y != y1) {
+		int32_t e2 = 2 * err;
+		int16_t nx = x;
+		int16_t ny = y;
+
+		if (e2 > -dy) {
+			err -= dy;
+			nx++;
+		}
+		if (e2 < dx) {
+			err += dx;
+			ny += sy;
+		}
+
+		// column done, emit its run
+		if (nx != x) {
+			rect(x, (run < y) ? run : y, 1, ((run < y) ? y - run : run - y) + 1);
+			run = ny;
+		}
+
+		x = nx;
+		y = ny;
+	}
+
+	rect(x, (run < y) ? run : y, 1, ((run < y) ? y - run : run - y) + 1);
+}
+
+/**
+ * @brief	Rasterize a circle outline with the midpoint algorithm.
+ * @details	The steep octants come out as vertical runs, the flat ones as
+ * 			single pixels.
+ */
+template<typename Rect>
+void shapeCircle(int16_t cx, int16_t cy, int16_t r, Rect rect)
+{
+	int16_t x = 0;
+	int16_t y = r;
+	int16_t xa = 0;
+	int32_t d = 1 - r;
+
+	if (r == 0) {
+		rect(cx, cy, 1, 1);
+		return;
+	}
+
+	while (x <= y) {
+		// the diagonal pixels belong to the runs
+		if (x < y) {
+			rect(cx + x, cy + y, 1, 1);
+			rect(cx + x, cy - y, 1, 1);
+			if (x != 0) {
+				rect(cx - x, cy + y, 1, 1);
+				rect(cx - x, cy - y, 1, 1);
+			}
+		}
+
+		int16_t px = x;
+		int16_t py = y;
+
+		x++;
+		if (d < 0) {
+			d += 2 * x + 1;
+		}
+		else {
+			y--;
+			d += 2 * (x - y) + 1;
+		}
+
+		// run of rows in columns cx +/- py ended
+		if (y != py || x > y) {
+			if (xa == 0) {
+				rect(cx + py, cy - px, 1, 2 * px + 1);
+				rect(cx - py, cy - px, 1, 2 * px + 1);
+			}
+			else {
+				rect(cx + py, cy + xa, 1, px - xa + 1);
+				rect(cx - py, cy + xa, 1, px - xa + 1);
+				rect(cx + py, cy - px, 1, px - xa + 1);
+				rect(cx - py, cy - px, 1, px - xa + 1);
+			}
+			xa = x;
+		}
+	}
+}
+
+/**
+ * @brief	Rasterize a circle arc.
+ * @details	Keeps the outline pixels counterclockwise from the start
+ * 			direction to the end direction, y pointing down. Directions
+ * 			are vectors of any length. Equal directions give a full
+ * 			circle.
+ */
+template<typename Rect>
+void shapeArc(int16_t cx, int16_t cy, int16_t r, int32_t sx, int32_t sy, int32_t ex, int32_t ey, Rect rect)
+{
+	// counterclockwise on screen is clockwise with y down
+	auto cross = [](int32_t ax, int32_t ay, int32_t bx, int32_t by) {
+		return int64_t(ax) * -by - int64_t(-ay) * bx;
+	};
+
+	int64_t se = cross(sx, sy, ex, ey);
+	bool full = se == 0 && int64_t(sx) * ex + int64_t(sy) * ey > 0;
+	bool wide = se < 0 || (se == 0 && !full);
+
+	auto inside = [&](int16_t x, int16_t y) {
+		if (full)
+			return true;
+		int64_t a = cross(sx, sy, x, y);
+		int64_t b = cross(x, y, ex, ey);
+		return wide ? (a >= 0 || b >= 0) : (a >= 0 && b >= 0);
+	};
+
+	// split the runs into the pixels inside the arc
+	shapeCircle(0, 0, r, [&](int16_t x, int16_t y, int16_t width, int16_t height) {
+		(void) width;
+		int16_t ys = y;
+		for (int16_t i = 0; i <= height; i++) {
+			if (i < height && inside(x, y + i))
+				continue;
+			if (ys < y + i)
+				rect(cx + x, cy + ys, 1, y + i - ys);
+			ys = y + i + 1;
+		}
+	});
+}
+
+#endif /* EINK_CLICK_SHAPES_HPP_ */
@@ -0,0 +1,203 @@
+/*
+ * Copyright (C) 2020 Daniel Igaz
+ *
+ * This file is part of the eINK-click project.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Host-side stand-in for the subset of the ChibiOS HAL/OSAL used by the
+ * eINK-click driver. It lets ssd16xx.cpp and epd.cpp be built and
+ * measured on Linux without a board; see hal_sim.hpp for the simulator
+ * control API.
+ */
+
+#ifndef EINK_CLICK_SIM_HAL_H_
+#define EINK_CLICK_SIM_HAL_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#if !defined(FALSE)
+#define FALSE					0
+#endif
+
+#if !defined(TRUE)
+#define TRUE					1
+#endif
+
+/**
+ * @brief	Enables the @p spiAcquireBus() and @p spiReleaseBus() APIs.
+ */
+#if !defined(SPI_USE_MUTUAL_EXCLUSION)
+#define SPI_USE_MUTUAL_EXCLUSION	TRUE
+#endif
+
+/**
+ * @brief	Enables the PAL line event callbacks.
+ */
+#if !defined(PAL_USE_CALLBACKS)
+#define PAL_USE_CALLBACKS		TRUE
+#endif
+
+/**
+ * @name	OSAL types and time conversion
+ * @{
+ */
+typedef int32_t msg_t;
+typedef uint32_t systime_t;
+typedef uint32_t sysinterval_t;
+
+#define MSG_OK					(msg_t)0
+#define MSG_TIMEOUT				(msg_t)-1
+#define MSG_RESET				(msg_t)-2
+
+#define TIME_IMMEDIATE			((sysinterval_t)0)
+#define TIME_INFINITE			((sysinterval_t)-1)
+
+#define TIME_MS2I(msecs)		((sysinterval_t)(msecs))
+#define TIME_I2MS(interval)		((uint32_t)(interval))
+/** @} */
+
+/**
+ * @name	PAL line levels and modes
+ * @{
+ */
+typedef uint32_t ioline_t;
+
+#define PAL_LOW					0U
+#define PAL_HIGH				1U
+
+#define PAL_MODE_RESET			0U
+#define PAL_MODE_INPUT			1U
+#define PAL_MODE_OUTPUT_PUSHPULL	6U
+
+#define PAL_EVENT_MODE_DISABLED		0U
+#define PAL_EVENT_MODE_RISING_EDGE	1U
+#define PAL_EVENT_MODE_FALLING_EDGE	2U
+#define PAL_EVENT_MODE_BOTH_EDGES	3U
+
+/**
+ * @brief	PAL event callback type.
+ */
+typedef void (*palcallback_t)(void* arg);
+/** @} */
+
+/**
+ * @brief	Simulated thread, there is a single one.
+ */
+typedef struct {
+	msg_t msg;				///< Wake-up message.
+	bool resumed;			///< Woken up.
+} thread_t;
+
+typedef thread_t* thread_reference_t;
+
+/**
+ * @brief	SPI driver state machine possible states.
+ */
+typedef enum {
+	SPI_UNINIT = 0,
+	SPI_STOP = 1,
+	SPI_READY = 2,
+	SPI_ACTIVE = 3,
+	SPI_COMPLETE = 4
+} spistate_t;
+
+typedef struct SPIDriver SPIDriver;
+
+/**
+ * @brief	SPI notification callback type.
+ */
+typedef void (*spicallback_t)(SPIDriver* spip);
+
+/**
+ * @brief	SPI driver configuration structure.
+ * @note	Chip select is modeled as @p SPI_SELECT_MODE_LINE.
+ */
+typedef struct {
+	bool circular;			///< Circular buffer mode (unused).
+	spicallback_t end_cb;	///< Operation complete callback or @p NULL.
+	ioline_t ssline;		///< Chip select line.
+} SPIConfig;
+
+/**
+ * @brief	SPI driver structure.
+ */
+struct SPIDriver {
+	spistate_t state;			///< Driver state.
+	const SPIConfig* config;	///< Current configuration data.
+	struct SimSpi* sim;			///< Simulator state, see hal_sim.hpp.
+};
+
+extern SPIDriver SPID1;
+extern SPIDriver SPID2;
+
+/**
+ * @name	OSAL API
+ * @{
+ */
+void osalDbgAssertFail(const char* remark);
+
+#define osalDbgAssert(c, remark)	do { if (!(c)) osalDbgAssertFail(remark); } while (0)
+#define osalDbgCheck(c)				osalDbgAssert(c, __func__)
+
+void osalSysLock(void);
+void osalSysUnlock(void);
+void osalSysLockFromISR(void);
+void osalSysUnlockFromISR(void);
+msg_t osalThreadSuspendTimeoutS(thread_reference_t* trp, sysinterval_t timeout);
+void osalThreadResumeI(thread_reference_t* trp, msg_t msg);
+void osalThreadResumeS(thread_reference_t* trp, msg_t msg);
+
+void chThdSleepMilliseconds(uint32_t msecs);
+systime_t chVTGetSystemTime(void);
+systime_t chVTGetSystemTimeX(void);
+sysinterval_t chVTTimeElapsedSinceX(systime_t start);
+/** @} */
+
+/**
+ * @name	PAL API
+ * @{
+ */
+void palSetLine(ioline_t line);
+void palClearLine(ioline_t line);
+uint32_t palReadLine(ioline_t line);
+void palSetLineMode(ioline_t line, uint32_t mode);
+void palEnableLineEvent(ioline_t line, uint32_t mode);
+void palDisableLineEvent(ioline_t line);
+void palSetLineCallback(ioline_t line, palcallback_t cb, void* arg);
+/** @} */
+
+/**
+ * @name	SPI API
+ * @{
+ */
+void spiStart(SPIDriver* spip, const SPIConfig* config);
+void spiStop(SPIDriver* spip);
+void spiSelect(SPIDriver* spip);
+void spiUnselect(SPIDriver* spip);
+void spiSend(SPIDriver* spip, size_t n, const void* txbuf);
+void spiStartSend(SPIDriver* spip, size_t n, const void* txbuf);
+void spiStartSendI(SPIDriver* spip, size_t n, const void* txbuf);
+void spiUnselectI(SPIDriver* spip);
+#if SPI_USE_MUTUAL_EXCLUSION
+void spiAcquireBus(SPIDriver* spip);
+void spiReleaseBus(SPIDriver* spip);
+#endif
+/** @} */
+
+#endif /* EINK_CLICK_SIM_HAL_H_ */
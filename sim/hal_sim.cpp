@@ -0,0 +1,693 @@
+/*
+ * Copyright (C) 2020 Daniel Igaz
+ *
+ * This file is part of the eINK-click project.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "hal_sim.hpp"
+#include <stdio.h>
+#include <stdlib.h>
+
+/**
+ * @name	SSD16xx commands decoded by the emulator
+ * @{
+ */
+#define SIM_DPSLP				0x10
+#define SIM_DEMDS				0x11
+#define SIM_SWRESET				0x12
+#define SIM_ADPUPDSC			0x20
+#define SIM_DUPCTRL2			0x22
+#define SIM_RAMWR				0x24
+#define SIM_WLUTREG				0x32
+#define SIM_RASTXSE				0x44
+#define SIM_RASTYSE				0x45
+#define SIM_RASTXAC				0x4E
+#define SIM_RASTYAC				0x4F
+#define SIM_NOP					0xFF
+/** @} */
+
+SPIDriver SPID1;
+SPIDriver SPID2;
+
+static SimSpi simSpiD1;
+static SimSpi simSpiD2;
+
+static uint64_t simTime;
+static uint8_t simLines[SIM_MAX_LINES];
+static uint32_t simToggles[SIM_MAX_LINES];
+
+/**
+ * @brief	PAL line event setup.
+ */
+typedef struct {
+	uint32_t mode;			///< Event mode.
+	palcallback_t cb;		///< Event callback.
+	void* arg;				///< Event callback argument.
+} SimLineEvent;
+
+static SimLineEvent simEvents[SIM_MAX_LINES];
+static thread_t simThread;
+static bool simLocked;
+
+SimSSD16xx::SimSSD16xx(ioline_t csLine, ioline_t rstLine, ioline_t busyLine, ioline_t dcLine,
+		uint16_t sources, uint16_t gates)
+: _csLine(csLine)
+, _rstLine(rstLine)
+, _busyLine(busyLine)
+, _dcLine(dcLine)
+, _sources(sources)
+, _gates(gates)
+, _ram(gates * (sources >> 2), 0xFF)
+, _image(gates * (sources >> 2), 0xFF)
+, _refreshMs(1000)
+, _busyUntil(0)
+, _updates(0)
+{
+	reset();
+}
+
+void SimSSD16xx::reset()
+{
+	_cmd = SIM_NOP;
+	_argc = 0;
+	_entryMode = 0x03;
+	_dupCtrl2 = 0x00;
+	_xsa = 0;
+	_xea = (_sources >> 2) - 1;
+	_ysa = 0;
+	_yea = _gates - 1;
+	_xac = 0;
+	_yac = 0;
+	_sleep = false;
+}
+
+bool SimSSD16xx::busy() const
+{
+	return simTime < _busyUntil;
+}
+
+void SimSSD16xx::fillRam(uint8_t b)
+{
+	for (size_t i = 0; i < _ram.size(); i++)
+		_ram[i] = b;
+}
+
+void SimSSD16xx::write(uint8_t b)
+{
+	if (_xac < (_sources >> 2) && _yac < _gates)
+		_ram[_yac * (_sources >> 2) + _xac] = b;
+
+	bool xInc = _entryMode & 0x01;
+	bool yInc = _entryMode & 0x02;
+
+	// the counter reaching the window end wraps to the window start
+	if (_entryMode & 0x04) {
+		if (_yac == _yea) {
+			_yac = _ysa;
+			_xac = (_xac == _xea) ? _xsa : (xInc ? _xac + 1 : _xac - 1);
+		}
+		else
+			_yac = yInc ? _yac + 1 : _yac - 1;
+	}
+	else {
+		if (_xac == _xea) {
+			_xac = _xsa;
+			_yac = (_yac == _yea) ? _ysa : (yInc ? _yac + 1 : _yac - 1);
+		}
+		else
+			_xac = xInc ? _xac + 1 : _xac - 1;
+	}
+}
+
+void SimSSD16xx::receive(bool dc, const uint8_t* bp, size_t n)
+{
+	if (_sleep || busy())
+		return;
+
+	bool wide = _gates > 0xFF;
+
+	for (size_t i = 0; i < n; i++) {
+		uint8_t b = bp[i];
+
+		if (!dc) {
+			_cmd = b;
+			_argc = 0;
+
+			switch (_cmd) {
+			case SIM_SWRESET:
+				reset();
+				break;
+			case SIM_ADPUPDSC:
+				_image = _ram;
+				_busyUntil = simTime + uint64_t(_refreshMs) * 1000000;
+				_updates++;
+				break;
+			case SIM_WLUTREG:
+				_lut.clear();
+				break;
+			default:
+				break;
+			}
+			continue;
+		}
+
+		switch (_cmd) {
+		case SIM_RAMWR:
+			write(b);
+			continue;
+		case SIM_WLUTREG:
+			_lut.push_back(b);
+			continue;
+		default:
+			break;
+		}
+
+		if (_argc < sizeof(_args))
+			_args[_argc++] = b;
+
+		switch (_cmd) {
+		case SIM_DPSLP:
+			_sleep = b & 0x01;
+			break;
+		case SIM_DEMDS:
+			_entryMode = b & 0x07;
+			break;
+		case SIM_DUPCTRL2:
+			_dupCtrl2 = b;
+			break;
+		case SIM_RASTXSE:
+			if (_argc == 2) {
+				_xsa = _args[0];
+				_xea = _args[1];
+			}
+			break;
+		case SIM_RASTYSE:
+			if (wide && _argc == 4) {
+				_ysa = _args[0] | (_args[1] << 8);
+				_yea = _args[2] | (_args[3] << 8);
+			}
+			else if (!wide && _argc == 2) {
+				_ysa = _args[0];
+				_yea = _args[1];
+			}
+			break;
+		case SIM_RASTXAC:
+			_xac = _args[0];
+			break;
+		case SIM_RASTYAC:
+			if (wide && _argc == 2)
+				_yac = _args[0] | (_args[1] << 8);
+			else if (!wide)
+				_yac = _args[0];
+			break;
+		default:
+			break;
+		}
+	}
+}
+
+SimSpi& simSpi(SPIDriver& spi)
+{
+	if (spi.sim == NULL)
+		spi.sim = (&spi == &SPID1) ? &simSpiD1 : &simSpiD2;
+
+	return *spi.sim;
+}
+
+void simAttach(SPIDriver& spi, SimSSD16xx& panel)
+{
+	SimSpi& sim = simSpi(spi);
+
+	for (size_t i = 0; i < SIM_MAX_PANELS; i++) {
+		if (sim.panels[i] == NULL) {
+			sim.panels[i] = &panel;
+			return;
+		}
+	}
+
+	osalDbgAssertFail("simAttach(), too many panels");
+}
+
+void simSetTiming(SPIDriver& spi, uint32_t bitrate, uint32_t callNs)
+{
+	SimSpi& sim = simSpi(spi);
+
+	sim.bitrate = bitrate;
+	sim.callNs = callNs;
+}
+
+uint64_t simTimeNs()
+{
+	return simTime;
+}
+
+/**
+ * @brief	Simulated interrupt.
+ */
+typedef struct {
+	uint64_t at;			///< Simulated time of the interrupt.
+	SimSSD16xx* panel;		///< Panel with a BUSY falling edge or @p NULL.
+	SPIDriver* spip;		///< SPI driver ending a transfer or @p NULL.
+} SimEvent;
+
+/**
+ * @brief	Get the earliest interrupt up to @p until.
+ * @details	BUSY falling edges in (now, @p until] having an event
+ * 			callback and asynchronous SPI transfers ending in
+ * 			[now, @p until] are considered.
+ */
+static bool simNextEvent(uint64_t until, SimEvent* evp)
+{
+	SPIDriver* drivers[] = { &SPID1, &SPID2 };
+	bool found = false;
+
+	for (SPIDriver* spip : drivers) {
+		SimSpi& sim = simSpi(*spip);
+
+		if (sim.active && sim.doneAt <= until && (!found || sim.doneAt < evp->at)) {
+			*evp = { sim.doneAt, NULL, spip };
+			found = true;
+		}
+
+		for (size_t i = 0; i < SIM_MAX_PANELS; i++) {
+			SimSSD16xx* panel = sim.panels[i];
+			if (panel == NULL || panel->busyUntil() <= simTime || panel->busyUntil() > until)
+				continue;
+
+			const SimLineEvent& ev = simEvents[panel->busyLine()];
+			if (!(ev.mode & PAL_EVENT_MODE_FALLING_EDGE) || ev.cb == NULL)
+				continue;
+
+			if (!found || panel->busyUntil() < evp->at) {
+				*evp = { panel->busyUntil(), panel, NULL };
+				found = true;
+			}
+		}
+	}
+
+	return found;
+}
+
+/**
+ * @brief	Run an interrupt handler.
+ */
+static void simFire(const SimEvent& ev)
+{
+	if (ev.panel != NULL) {
+		const SimLineEvent& le = simEvents[ev.panel->busyLine()];
+		le.cb(le.arg);
+		return;
+	}
+
+	// like the HAL, a callback may chain another transfer
+	SPIDriver* spip = ev.spip;
+	simSpi(*spip).active = false;
+	spip->state = SPI_COMPLETE;
+	if (spip->config->end_cb != NULL)
+		spip->config->end_cb(spip);
+	if (spip->state == SPI_COMPLETE)
+		spip->state = SPI_READY;
+}
+
+void simAdvanceNs(uint64_t ns)
+{
+	osalDbgAssert(!simLocked, "simAdvanceNs(), time passing in locked state");
+
+	uint64_t until = simTime + ns;
+	SimEvent ev;
+
+	while (simNextEvent(until, &ev)) {
+		simTime = ev.at;
+		simFire(ev);
+	}
+
+	simTime = until;
+}
+
+uint32_t simLineToggles(ioline_t line)
+{
+	osalDbgCheck(line < SIM_MAX_LINES);
+
+	return simToggles[line];
+}
+
+void simReset()
+{
+	simTime = 0;
+
+	for (size_t i = 0; i < SIM_MAX_LINES; i++) {
+		simLines[i] = PAL_LOW;
+		simToggles[i] = 0;
+		simEvents[i] = SimLineEvent();
+	}
+
+	simThread = thread_t();
+	simLocked = false;
+
+	SPID1 = SPIDriver();
+	SPID2 = SPIDriver();
+	simSpiD1 = SimSpi();
+	simSpiD2 = SimSpi();
+}
+
+static SimSSD16xx* simFindPanel(ioline_t line, ioline_t (SimSSD16xx::*fn)() const)
+{
+	SimSpi* sims[] = { &simSpiD1, &simSpiD2 };
+
+	for (SimSpi* sim : sims) {
+		for (size_t i = 0; i < SIM_MAX_PANELS; i++) {
+			if (sim->panels[i] != NULL && (sim->panels[i]->*fn)() == line)
+				return sim->panels[i];
+		}
+	}
+
+	return NULL;
+}
+
+void osalDbgAssertFail(const char* remark)
+{
+	fprintf(stderr, "assertion failed: %s\n", remark);
+	abort();
+}
+
+void osalSysLock(void)
+{
+	osalDbgAssert(!simLocked, "osalSysLock(), already locked");
+
+	simLocked = true;
+}
+
+void osalSysUnlock(void)
+{
+	osalDbgAssert(simLocked, "osalSysUnlock(), not locked");
+
+	simLocked = false;
+}
+
+void osalSysLockFromISR(void)
+{
+	osalSysLock();
+}
+
+void osalSysUnlockFromISR(void)
+{
+	osalSysUnlock();
+}
+
+msg_t osalThreadSuspendTimeoutS(thread_reference_t* trp, sysinterval_t timeout)
+{
+	osalDbgAssert(simLocked, "osalThreadSuspendTimeoutS(), not locked");
+
+	if (timeout == TIME_IMMEDIATE)
+		return MSG_TIMEOUT;
+
+	uint64_t deadline = (timeout == TIME_INFINITE) ? UINT64_MAX :
+			simTime + uint64_t(TIME_I2MS(timeout)) * 1000000;
+
+	simThread.resumed = false;
+	*trp = &simThread;
+
+	// the only thread sleeps, let time pass until the next event wakes it
+	simLocked = false;
+	while (!simThread.resumed) {
+		SimEvent ev;
+
+		if (!simNextEvent(deadline, &ev)) {
+			osalDbgAssert(deadline != UINT64_MAX, "osalThreadSuspendTimeoutS(), deadlock");
+			simAdvanceNs(deadline - simTime);
+			*trp = NULL;
+			simLocked = true;
+			return MSG_TIMEOUT;
+		}
+
+		simAdvanceNs(ev.at - simTime);
+	}
+	simLocked = true;
+
+	return simThread.msg;
+}
+
+void osalThreadResumeI(thread_reference_t* trp, msg_t msg)
+{
+	if (*trp != NULL) {
+		(*trp)->msg = msg;
+		(*trp)->resumed = true;
+		*trp = NULL;
+	}
+}
+
+void osalThreadResumeS(thread_reference_t* trp, msg_t msg)
+{
+	osalDbgAssert(simLocked, "osalThreadResumeS(), not locked");
+
+	osalThreadResumeI(trp, msg);
+}
+
+void chThdSleepMilliseconds(uint32_t msecs)
+{
+	simAdvanceNs(uint64_t(msecs) * 1000000);
+}
+
+systime_t chVTGetSystemTime(void)
+{
+	return systime_t(simTime / 1000000);
+}
+
+systime_t chVTGetSystemTimeX(void)
+{
+	return chVTGetSystemTime();
+}
+
+sysinterval_t chVTTimeElapsedSinceX(systime_t start)
+{
+	return sysinterval_t(chVTGetSystemTimeX() - start);
+}
+
+static void simWriteLine(ioline_t line, uint8_t level)
+{
+	osalDbgCheck(line < SIM_MAX_LINES);
+
+	if (simLines[line] == level)
+		return;
+
+	simLines[line] = level;
+	simToggles[line]++;
+
+	// falling edge on a reset line resets the panel
+	if (level == PAL_LOW) {
+		SimSSD16xx* panel = simFindPanel(line, &SimSSD16xx::rstLine);
+		if (panel != NULL)
+			panel->reset();
+	}
+}
+
+void palSetLine(ioline_t line)
+{
+	simWriteLine(line, PAL_HIGH);
+}
+
+void palClearLine(ioline_t line)
+{
+	simWriteLine(line, PAL_LOW);
+}
+
+uint32_t palReadLine(ioline_t line)
+{
+	osalDbgCheck(line < SIM_MAX_LINES);
+
+	SimSSD16xx* panel = simFindPanel(line, &SimSSD16xx::busyLine);
+	if (panel != NULL)
+		return panel->busy() ? PAL_HIGH : PAL_LOW;
+
+	return simLines[line];
+}
+
+void palSetLineMode(ioline_t line, uint32_t mode)
+{
+	osalDbgCheck(line < SIM_MAX_LINES);
+
+	(void) mode;
+}
+
+void palEnableLineEvent(ioline_t line, uint32_t mode)
+{
+	osalDbgCheck(line < SIM_MAX_LINES);
+
+	simEvents[line].mode = mode;
+}
+
+void palDisableLineEvent(ioline_t line)
+{
+	osalDbgCheck(line < SIM_MAX_LINES);
+
+	simEvents[line].mode = PAL_EVENT_MODE_DISABLED;
+}
+
+void palSetLineCallback(ioline_t line, palcallback_t cb, void* arg)
+{
+	osalDbgCheck(line < SIM_MAX_LINES);
+
+	simEvents[line].cb = cb;
+	simEvents[line].arg = arg;
+}
+
+void spiStart(SPIDriver* spip, const SPIConfig* config)
+{
+	osalDbgCheck(spip != NULL && config != NULL);
+
+	SimSpi& sim = simSpi(*spip);
+
+	spip->config = config;
+	spip->state = SPI_READY;
+	sim.stats.starts++;
+}
+
+void spiStop(SPIDriver* spip)
+{
+	osalDbgCheck(spip != NULL);
+
+	spip->state = SPI_STOP;
+}
+
+void spiSelect(SPIDriver* spip)
+{
+	osalDbgCheck(spip != NULL);
+	osalDbgAssert(spip->state == SPI_READY, "spiSelect(), not ready");
+
+	SimSpi& sim = simSpi(*spip);
+
+	sim.stats.selects++;
+	sim.selected = NULL;
+	for (size_t i = 0; i < SIM_MAX_PANELS; i++) {
+		if (sim.panels[i] != NULL && sim.panels[i]->csLine() == spip->config->ssline)
+			sim.selected = sim.panels[i];
+	}
+
+	simWriteLine(spip->config->ssline, PAL_LOW);
+}
+
+void spiUnselect(SPIDriver* spip)
+{
+	osalDbgCheck(spip != NULL);
+	osalDbgAssert(spip->state == SPI_READY, "spiUnselect(), not ready");
+
+	SimSpi& sim = simSpi(*spip);
+
+	sim.selected = NULL;
+	simWriteLine(spip->config->ssline, PAL_HIGH);
+}
+
+void spiUnselectI(SPIDriver* spip)
+{
+	osalDbgCheck(spip != NULL);
+	osalDbgAssert(spip->state != SPI_ACTIVE, "spiUnselectI(), transfer on the wire");
+
+	SimSpi& sim = simSpi(*spip);
+
+	sim.selected = NULL;
+	simWriteLine(spip->config->ssline, PAL_HIGH);
+}
+
+/**
+ * @brief	Account and deliver a transfer to the selected panel.
+ *
+ * @returns	The wire time of the transfer in ns.
+ */
+static uint64_t simTransfer(SPIDriver* spip, size_t n, const void* txbuf)
+{
+	SimSpi& sim = simSpi(*spip);
+	bool dc = true;
+
+	if (sim.selected != NULL)
+		dc = simLines[sim.selected->dcLine()] == PAL_HIGH;
+
+	sim.stats.calls++;
+	sim.stats.bytes += n;
+	if (dc) {
+		sim.stats.dataCalls++;
+		sim.stats.dataBytes += n;
+	}
+	else {
+		sim.stats.cmdCalls++;
+		sim.stats.cmdBytes += n;
+	}
+
+	if (sim.logging)
+		sim.log.push_back({ dc, n });
+
+	if (sim.selected != NULL)
+		sim.selected->receive(dc, (const uint8_t*)txbuf, n);
+
+	if (sim.bitrate == 0)
+		return 0;
+
+	return sim.callNs + uint64_t(n) * 8000000000ULL / sim.bitrate;
+}
+
+void spiSend(SPIDriver* spip, size_t n, const void* txbuf)
+{
+	osalDbgCheck(spip != NULL && n > 0 && txbuf != NULL);
+	osalDbgAssert(spip->state == SPI_READY, "spiSend(), not ready");
+
+	simAdvanceNs(simTransfer(spip, n, txbuf));
+}
+
+void spiStartSendI(SPIDriver* spip, size_t n, const void* txbuf)
+{
+	osalDbgCheck(spip != NULL && n > 0 && txbuf != NULL);
+	osalDbgAssert(spip->state == SPI_READY || spip->state == SPI_COMPLETE,
+			"spiStartSendI(), not ready");
+
+	SimSpi& sim = simSpi(*spip);
+
+	// the panel sees the bytes right away, the driver at the end
+	sim.stats.asyncCalls++;
+	sim.doneAt = simTime + simTransfer(spip, n, txbuf);
+	sim.active = true;
+	spip->state = SPI_ACTIVE;
+}
+
+void spiStartSend(SPIDriver* spip, size_t n, const void* txbuf)
+{
+	osalSysLock();
+	spiStartSendI(spip, n, txbuf);
+	osalSysUnlock();
+}
+
+#if SPI_USE_MUTUAL_EXCLUSION
+void spiAcquireBus(SPIDriver* spip)
+{
+	osalDbgCheck(spip != NULL);
+
+	SimSpi& sim = simSpi(*spip);
+
+	osalDbgAssert(!sim.owned, "spiAcquireBus(), bus already owned");
+
+	sim.owned = true;
+	sim.stats.acquires++;
+}
+
+void spiReleaseBus(SPIDriver* spip)
+{
+	osalDbgCheck(spip != NULL);
+
+	SimSpi& sim = simSpi(*spip);
+
+	osalDbgAssert(sim.owned, "spiReleaseBus(), bus not owned");
+
+	sim.owned = false;
+}
+#endif
@@ -0,0 +1,234 @@
+/*
+ * Copyright (C) 2020 Daniel Igaz
+ *
+ * This file is part of the eINK-click project.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef EINK_CLICK_SIM_HAL_SIM_HPP_
+#define EINK_CLICK_SIM_HAL_SIM_HPP_
+
+#include "hal.h"
+#include <vector>
+
+/**
+ * @brief	Maximum number of PAL lines known to the simulator.
+ */
+#if !defined(SIM_MAX_LINES)
+#define SIM_MAX_LINES			64
+#endif
+
+/**
+ * @brief	Maximum number of panels attached to one SPI driver.
+ */
+#if !defined(SIM_MAX_PANELS)
+#define SIM_MAX_PANELS			4
+#endif
+
+/**
+ * @brief	Single SPI transfer as seen on the wire.
+ */
+typedef struct {
+	bool dc;		///< Data/command line state, false for command bytes.
+	size_t n;		///< Number of bytes transferred.
+} SimSpiTransaction;
+
+/**
+ * @brief	Aggregated SPI traffic counters.
+ */
+struct SimSpiStats {
+	uint32_t calls;			///< Number of spiSend() calls.
+	uint32_t bytes;			///< Number of bytes sent.
+	uint32_t cmdCalls;		///< Number of transfers with DC low.
+	uint32_t cmdBytes;		///< Number of bytes sent with DC low.
+	uint32_t dataCalls;		///< Number of transfers with DC high.
+	uint32_t dataBytes;		///< Number of bytes sent with DC high.
+	uint32_t selects;		///< Number of spiSelect() calls.
+	uint32_t starts;		///< Number of spiStart() calls.
+	uint32_t acquires;		///< Number of spiAcquireBus() calls.
+	uint32_t asyncCalls;	///< Number of spiStartSend() calls.
+
+	/** @brief	Clear all counters. */
+	void reset() { *this = SimSpiStats(); }
+
+	/**
+	 * @brief	Estimate the bus time of the recorded traffic.
+	 *
+	 * @param[in] bitrate	SPI clock in Hz
+	 * @param[in] callNs	fixed driver overhead per transfer in ns
+	 *
+	 * @returns	The estimated time in ns.
+	 */
+	uint64_t estimateNs(uint32_t bitrate, uint32_t callNs) const {
+		return uint64_t(calls) * callNs + uint64_t(bytes) * 8000000000ULL / bitrate;
+	}
+};
+
+/**
+ * @brief	Emulated SSD16xx controller.
+ * @details	Decodes the command stream of the selected chip, keeps the RAM
+ * 			window, address counters and data entry mode, and drives the
+ * 			BUSY line for the duration of a display update.
+ */
+class SimSSD16xx {
+	ioline_t _csLine;			///< Chip select line.
+	ioline_t _rstLine;			///< Reset line.
+	ioline_t _busyLine;			///< Busy line.
+	ioline_t _dcLine;			///< Data/command line.
+	uint16_t _sources;			///< Number of sources.
+	uint16_t _gates;			///< Number of gates.
+	std::vector<uint8_t> _ram;	///< Controller RAM, gate-major.
+	std::vector<uint8_t> _image;	///< RAM contents at the last update.
+	std::vector<uint8_t> _lut;	///< Last written LUT.
+	uint8_t _cmd;				///< Current command.
+	uint8_t _args[4];			///< Command arguments received so far.
+	size_t _argc;				///< Number of command arguments received.
+	uint8_t _entryMode;			///< Data entry mode.
+	uint8_t _dupCtrl2;			///< Display update control 2.
+	uint16_t _xsa, _xea;		///< RAM X window.
+	uint16_t _ysa, _yea;		///< RAM Y window.
+	uint16_t _xac, _yac;		///< RAM address counters.
+	bool _sleep;				///< Deep sleep mode.
+	uint32_t _refreshMs;		///< Simulated update duration.
+	uint64_t _busyUntil;		///< Simulated time the BUSY line drops.
+	uint32_t _updates;			///< Number of display updates.
+
+	void write(uint8_t b);
+
+public:
+	SimSSD16xx(ioline_t csLine, ioline_t rstLine, ioline_t busyLine, ioline_t dcLine,
+			uint16_t sources, uint16_t gates);
+
+	/** @brief	Hardware reset, keeps RAM contents. */
+	void reset();
+
+	/**
+	 * @brief	Feed bytes received while the chip is selected.
+	 *
+	 * @param[in] dc	data/command line state
+	 * @param[in] bp	pointer to the received bytes
+	 * @param[in] n		number of bytes
+	 */
+	void receive(bool dc, const uint8_t* bp, size_t n);
+
+	ioline_t csLine() const { return _csLine; }
+	ioline_t rstLine() const { return _rstLine; }
+	ioline_t busyLine() const { return _busyLine; }
+	ioline_t dcLine() const { return _dcLine; }
+	uint16_t sources() const { return _sources; }
+	uint16_t gates() const { return _gates; }
+
+	/** @brief	Set the simulated display update duration. */
+	void setRefreshTime(uint32_t ms) { _refreshMs = ms; }
+
+	/** @brief	Get the BUSY line state. */
+	bool busy() const;
+
+	/** @brief	Get the simulated time in ns the BUSY line drops. */
+	uint64_t busyUntil() const { return _busyUntil; }
+
+	/** @brief	Get the deep sleep state. */
+	bool sleeping() const { return _sleep; }
+
+	/** @brief	Get the number of display updates. */
+	uint32_t updates() const { return _updates; }
+
+	/** @brief	Get the data entry mode. */
+	uint8_t entryMode() const { return _entryMode; }
+
+	/** @brief	Get display update control 2 value. */
+	uint8_t updateControl() const { return _dupCtrl2; }
+
+	/** @brief	Get the last written LUT. */
+	const std::vector<uint8_t>& lut() const { return _lut; }
+
+	/** @brief	Get RAM byte at RAM address (@p xa, @p ya). */
+	uint8_t ram(uint16_t xa, uint16_t ya) const { return _ram[ya * (_sources >> 2) + xa]; }
+
+	/** @brief	Get RAM byte of the displayed image at RAM address (@p xa, @p ya). */
+	uint8_t image(uint16_t xa, uint16_t ya) const { return _image[ya * (_sources >> 2) + xa]; }
+
+	/** @brief	Get the 2 bit GS level of RAM pixel (@p source, @p gate). */
+	uint8_t level(uint16_t source, uint16_t gate) const {
+		return (ram(source >> 2, gate) >> ((3 - (source & 0x03)) << 1)) & 0x03;
+	}
+
+	/** @brief	Fill the whole RAM with @p b. */
+	void fillRam(uint8_t b);
+};
+
+/**
+ * @brief	Simulator state attached to a @p SPIDriver.
+ */
+struct SimSpi {
+	SimSpiStats stats;							///< Traffic counters.
+	std::vector<SimSpiTransaction> log;			///< Transfer log.
+	bool logging;								///< Record transfers to @p log.
+	bool owned;									///< Bus acquired.
+	uint32_t bitrate;							///< SPI clock in Hz, 0 for no bus time.
+	uint32_t callNs;							///< Driver overhead per transfer in ns.
+	SimSSD16xx* panels[SIM_MAX_PANELS];			///< Attached panels.
+	SimSSD16xx* selected;						///< Currently selected panel.
+	bool active;								///< Asynchronous transfer on the wire.
+	uint64_t doneAt;							///< Simulated end time of the transfer.
+};
+
+/**
+ * @brief	Get the simulator state of @p spi.
+ */
+SimSpi& simSpi(SPIDriver& spi);
+
+/**
+ * @brief	Attach an emulated panel to @p spi.
+ * @details	The panel is selected whenever the chip select line of the
+ * 			active @p SPIConfig matches the panel chip select line.
+ */
+void simAttach(SPIDriver& spi, SimSSD16xx& panel);
+
+/**
+ * @brief	Set the bus timing model of @p spi.
+ * @details	Each transfer advances the simulated time by @p callNs plus the
+ * 			wire time of the transferred bytes.
+ *
+ * @param[in] spi		SPI driver
+ * @param[in] bitrate	SPI clock in Hz, 0 disables bus time
+ * @param[in] callNs	driver overhead per transfer in ns
+ */
+void simSetTiming(SPIDriver& spi, uint32_t bitrate, uint32_t callNs);
+
+/**
+ * @brief	Get the simulated time in ns.
+ */
+uint64_t simTimeNs();
+
+/**
+ * @brief	Advance the simulated time.
+ * @details	BUSY line falling edges passed on the way invoke the enabled
+ * 			PAL event callbacks and ending asynchronous SPI transfers
+ * 			invoke the @p SPIConfig end callback at their simulated time.
+ */
+void simAdvanceNs(uint64_t ns);
+
+/**
+ * @brief	Get the number of level changes of @p line.
+ */
+uint32_t simLineToggles(ioline_t line);
+
+/**
+ * @brief	Reset time, lines and detach all panels.
+ */
+void simReset();
+
+#endif /* EINK_CLICK_SIM_HAL_SIM_HPP_ */
@@ -34,7 +34,7 @@ public:
 	virtual uint16_t sources() const { return 72; }
 	virtual uint16_t gates() const { return 172; }
 
-	virtual void sendLUTData() {
+	virtual void sendLUTData(UpdateMode mode) {
 		static constexpr uint8_t LUTData[]= {
 			0x82,0x00,0x00,0x00,	// step 0
 			0xAA,0x00,0x00,0x00,
@@ -62,7 +62,38 @@ public:
 			0x00,0x00
 		};
 
-		sendData(LUTData, sizeof(LUTData));
+		// only the final GS drive steps of the full waveform, no flashing
+		static constexpr uint8_t PartialLUTData[]= {
+			0x15,0x15,0x15,0x15,	// step 0
+			0x05,0x05,0x05,0x05,
+			0x01,0x01,0x01,0x01,
+			0x00,0x00,0x00,0x00,
+			0x00,0x00,0x00,0x00,
+			0x00,0x00,0x00,0x00,
+			0x00,0x00,0x00,0x00,
+			0x00,0x00,0x00,0x00,
+			0x00,0x00,0x00,0x00,
+			0x00,0x00,0x00,0x00,
+			0x00,0x00,0x00,0x00,
+			0x00,0x00,0x00,0x00,
+			0x00,0x00,0x00,0x00,
+			0x00,0x00,0x00,0x00,
+			0x00,0x00,0x00,0x00,
+			0x00,0x00,0x00,0x00,
+			0x00,0x00,0x00,0x00,
+			0x00,0x00,0x00,0x00,
+			0x00,0x00,0x00,0x00,
+			0x00,0x00,0x00,0x00,	// step 19
+
+			// timing part of the LUT
+			0x55,0x01,0x00,0x00,0x00,0x00,0x00,0x00,
+			0x00,0x00
+		};
+
+		if (mode == UPDATE_PARTIAL)
+			sendData(PartialLUTData, sizeof(PartialLUTData));
+		else
+			sendData(LUTData, sizeof(LUTData));
 	}
 };
 
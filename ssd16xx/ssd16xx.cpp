@@ -18,6 +18,7 @@
  */
 
 #include "ssd16xx.hpp"
+#include <string.h>
 
 SSD16xx::SSD16xx(SPIDriver& spi, const SPIConfig& spiCfg, ioline_t rstLine, ioline_t busyLine, ioline_t dcLine)
 : _spi(&spi)
@@ -25,15 +26,56 @@ SSD16xx::SSD16xx(SPIDriver& spi, const SPIConfig& spiCfg, ioline_t rstLine, ioli
 , _rstLine(rstLine)
 , _busyLine(busyLine)
 , _dcLine(dcLine)
+, _lutMode(UPDATE_FULL)
+, _partialCount(0)
+, _fullInterval(SSD16XX_FULL_UPDATE_INTERVAL)
+, _updating(false)
+, _updateStart(0)
+, _updateTime(0)
+, _waitThread(NULL)
+, _updateCb(NULL)
+, _updateCbArg(NULL)
+, _busDepth(0)
+, _dataEntry(0x01)
+, _entryMode(0)
+, _windowValid(false)
+, _counterValid(false)
+, _ramWrite(false)
+, _xsa(0)
+, _xea(0)
+, _ysa(0)
+, _yea(0)
+, _xac(0)
+, _yac(0)
+, _uploadCfg()
+, _uploadState(UPLOAD_IDLE)
+, _uploadUpdate(false)
+, _uploadThread(NULL)
+, _uploadCb(NULL)
+, _uploadCbArg(NULL)
 {
+	_uploadCfg.cfg = spiCfg;
+	_uploadCfg.cfg.end_cb = uploadCallback;
+	_uploadCfg.ssd = this;
 }
 
 SSD16xx::~SSD16xx()
 {
 }
 
+/**
+ * @brief	Reverse the order of the 4 pixels of a RAM byte.
+ */
+static inline uint8_t reversePixels(uint8_t b)
+{
+	b = (b >> 4) | (b << 4);
+	return ((b >> 2) & 0x33) | ((b & 0x33) << 2);
+}
+
 void SSD16xx::sendCmd(Command c)
 {
+	_ramWrite = (c == SSD16xx_RAMWR);
+
 	palClearLine(_dcLine);
 	spiSend(_spi, 1, &c);
 	palSetLine(_dcLine);
@@ -41,28 +83,136 @@ void SSD16xx::sendCmd(Command c)
 
 void SSD16xx::sendData(uint8_t b)
 {
+	if (_ramWrite && !(_entryMode & 0x01))
+		b = reversePixels(b);
+
 	spiSend(_spi, 1, &b);
+
+	if (_ramWrite)
+		advanceCounter(1);
 }
 
 void SSD16xx::sendData(const uint8_t* bp, size_t n)
 {
+	if (_ramWrite && !(_entryMode & 0x01)) {
+		uint8_t buf[SSD16XX_FILL_BUFFER_SIZE];
+
+		// the x address decrements, reverse the pixels chunk by chunk
+		for (size_t i = 0; i < n; i += sizeof(buf)) {
+			size_t len = (n - i < sizeof(buf)) ? n - i : sizeof(buf);
+			for (size_t j = 0; j < len; j++)
+				buf[j] = reversePixels(bp[i + j]);
+			spiSend(_spi, len, buf);
+		}
+
+		advanceCounter(n);
+		return;
+	}
+
 	spiSend(_spi, n, bp);
+
+	if (_ramWrite)
+		advanceCounter(n);
 }
 
-void SSD16xx::select()
+void SSD16xx::fillData(uint8_t b, size_t n)
 {
-#if	SPI_USE_MUTUAL_EXCLUSION
-	spiAcquireBus(_spi);
-	spiStart(_spi, _spiCfg);
-#endif
+	uint8_t buf[SSD16XX_FILL_BUFFER_SIZE];
+	size_t total = n;
+
+	if (_ramWrite && !(_entryMode & 0x01))
+		b = reversePixels(b);
+
+	memset(buf, b, (n < sizeof(buf)) ? n : sizeof(buf));
+
+	while (n > 0) {
+		size_t len = (n < sizeof(buf)) ? n : sizeof(buf);
+		spiSend(_spi, len, buf);
+		n -= len;
+	}
+
+	if (_ramWrite)
+		advanceCounter(total);
+}
+
+void SSD16xx::advanceCounter(size_t n)
+{
+	if (!_counterValid)
+		return;
+
+	bool xInc = _entryMode & 0x01;
+	bool yInc = _entryMode & 0x02;
+
+	// window size and counter position along each axis
+	int32_t xn = (xInc ? _xea - _xsa : _xsa - _xea) + 1;
+	int32_t yn = (yInc ? _yea - _ysa : _ysa - _yea) + 1;
+	int32_t xi = xInc ? _xac - _xsa : _xsa - _xac;
+	int32_t yi = yInc ? _yac - _ysa : _ysa - _yac;
+
+	if (xn <= 0 || yn <= 0 || xi < 0 || xi >= xn || yi < 0 || yi >= yn) {
+		_counterValid = false;
+		return;
+	}
+
+	// the counter runs along y first when AM is set
+	size_t pos = (_entryMode & 0x04) ? size_t(xi) * yn + yi : size_t(yi) * xn + xi;
+
+	// where the counter lands after the window end is not specified
+	pos += n;
+	if (pos >= size_t(xn) * yn) {
+		_counterValid = false;
+		return;
+	}
+
+	if (_entryMode & 0x04) {
+		xi = pos / yn;
+		yi = pos % yn;
+	}
+	else {
+		yi = pos / xn;
+		xi = pos % xn;
+	}
+
+	_xac = xInc ? _xsa + xi : _xsa - xi;
+	_yac = yInc ? _ysa + yi : _ysa - yi;
+}
+
+msg_t SSD16xx::select()
+{
+	msg_t msg = waitUpdate(SSD16XX_UPDATE_TIMEOUT);
+
+	acquireBus();
 
 	spiSelect(_spi);
+
+	return msg;
 }
 
 void SSD16xx::unselect()
 {
 	spiUnselect(_spi);
 
+	releaseBus();
+}
+
+void SSD16xx::acquireBus()
+{
+	if (_busDepth++ > 0)
+		return;
+
+#if	SPI_USE_MUTUAL_EXCLUSION
+	spiAcquireBus(_spi);
+	spiStart(_spi, _spiCfg);
+#endif
+}
+
+void SSD16xx::releaseBus()
+{
+	osalDbgAssert(_busDepth > 0, "SSD16xx::releaseBus(), no session");
+
+	if (--_busDepth > 0)
+		return;
+
 #if	SPI_USE_MUTUAL_EXCLUSION
 	spiReleaseBus(_spi);
 #endif
@@ -73,12 +223,21 @@ void SSD16xx::start()
 	// set PWM analog pin to push-pull
 	palSetLineMode(_dcLine, PAL_MODE_OUTPUT_PUSHPULL);
 
+#if PAL_USE_CALLBACKS
+	// display update ends on the BUSY line falling edge
+	palSetLineCallback(_busyLine, busyCallback, this);
+	palEnableLineEvent(_busyLine, PAL_EVENT_MODE_FALLING_EDGE);
+#endif
+
 	// panel reset
 	palClearLine(_rstLine);
 	chThdSleepMilliseconds(10);
 	palSetLine(_rstLine);
 	chThdSleepMilliseconds(10);
 
+	osalDbgAssert(_busDepth == 0, "SSD16xx::start(), bus session active");
+	osalDbgAssert(_uploadState == UPLOAD_IDLE, "SSD16xx::start(), upload active");
+
 #if	SPI_USE_MUTUAL_EXCLUSION
 	spiAcquireBus(_spi);
 #endif
@@ -86,9 +245,13 @@ void SSD16xx::start()
 
 	spiSelect(_spi);
 
-	// data entry mode setting, increment X, decrement Y
+	// RAM window and counter are unknown after reset
+	invalidateAddress();
+
+	// data entry mode setting, by default increment X, decrement Y
 	sendCmd(SSD16xx_DEMDS);
-	sendData(0x01);
+	sendData(_dataEntry);
+	_entryMode = _dataEntry;
 
 	// write VCOM register
 	sendCmd(SSD16xx_WVCOMREG);
@@ -104,7 +267,11 @@ void SSD16xx::start()
 
 	// write LUT register
 	sendCmd(SSD16xx_WLUTREG);
-	sendLUTData();
+	sendLUTData(UPDATE_FULL);
+	_lutMode = UPDATE_FULL;
+
+	// first update has to be a full one
+	_partialCount = UINT16_MAX;
 
 	spiUnselect(_spi);
 
@@ -115,6 +282,14 @@ void SSD16xx::start()
 
 void SSD16xx::stop()
 {
+	waitUpdate(SSD16XX_UPDATE_TIMEOUT);
+
+#if PAL_USE_CALLBACKS
+	palDisableLineEvent(_busyLine);
+#endif
+
+	osalDbgAssert(_busDepth == 0, "SSD16xx::stop(), bus session active");
+
 #if	SPI_USE_MUTUAL_EXCLUSION
 	spiAcquireBus(_spi);
 	spiStart(_spi, _spiCfg);
@@ -129,6 +304,7 @@ void SSD16xx::stop()
 	// enter deep sleep mode
 	sendCmd(SSD16xx_DPSLP);
 	sendData(0x01);
+	invalidateAddress();
 
 	spiUnselect(_spi);
 
@@ -139,27 +315,212 @@ void SSD16xx::stop()
 #endif
 }
 
-void SSD16xx::update()
+void SSD16xx::endUpdateI()
 {
-#if	SPI_USE_MUTUAL_EXCLUSION
-	spiAcquireBus(_spi);
-	spiStart(_spi, _spiCfg);
+	if (!_updating)
+		return;
+
+	_updating = false;
+	_updateTime = chVTTimeElapsedSinceX(_updateStart);
+
+	osalThreadResumeI(&_waitThread, MSG_OK);
+
+	if (_updateCb != NULL)
+		_updateCb(this, _updateCbArg);
+}
+
+#if PAL_USE_CALLBACKS
+void SSD16xx::busyCallback(void* arg)
+{
+	SSD16xx* ssd = (SSD16xx*)arg;
+
+	osalSysLockFromISR();
+	ssd->endUpdateI();
+	osalSysUnlockFromISR();
+}
 #endif
 
-	spiSelect(_spi);
+SSD16xx::UpdateMode SSD16xx::loadWaveform(UpdateMode mode)
+{
+	// force a full update to clear ghosting
+	if (mode == UPDATE_PARTIAL && (_partialCount == UINT16_MAX ||
+			(_fullInterval != 0 && _partialCount >= _fullInterval)))
+		mode = UPDATE_FULL;
+
+	if (mode == UPDATE_FULL)
+		_partialCount = 0;
+	else if (_partialCount < UINT16_MAX - 1)
+		_partialCount++;
+
+	// load the waveform
+	if (mode != _lutMode) {
+		sendCmd(SSD16xx_WLUTREG);
+		sendLUTData(mode);
+		_lutMode = mode;
+	}
+
+	return mode;
+}
+
+msg_t SSD16xx::startUpdate(UpdateMode mode)
+{
+	// the device would ignore the update command
+	if (select() != MSG_OK) {
+		unselect();
+		return MSG_TIMEOUT;
+	}
+
+	loadWaveform(mode);
+
+	_updateStart = chVTGetSystemTimeX();
+	_updating = true;
 
 	// update display
 	sendCmd(SSD16xx_ADPUPDSC);
 
-	spiUnselect(_spi);
+	unselect();
 
-#if	SPI_USE_MUTUAL_EXCLUSION
-	spiReleaseBus(_spi);
+	return MSG_OK;
+}
+
+msg_t SSD16xx::waitUpdate(sysinterval_t timeout)
+{
+	// an update may be queued behind the upload
+	if (waitUpload(timeout) != MSG_OK)
+		return MSG_TIMEOUT;
+
+#if PAL_USE_CALLBACKS
+	msg_t msg = MSG_OK;
+
+	osalSysLock();
+	if (_updating)
+		msg = osalThreadSuspendTimeoutS(&_waitThread, timeout);
+	osalSysUnlock();
+
+	return msg;
+#else
+	systime_t start = chVTGetSystemTimeX();
+
+	while (palReadLine(_busyLine) == PAL_HIGH) {
+		if (timeout != TIME_INFINITE && chVTTimeElapsedSinceX(start) >= timeout)
+			return MSG_TIMEOUT;
+		chThdSleepMilliseconds(10);
+	}
+
+	osalSysLock();
+	endUpdateI();
+	osalSysUnlock();
+
+	return MSG_OK;
 #endif
+}
+
+bool SSD16xx::updating()
+{
+#if !PAL_USE_CALLBACKS
+	if (_updating && palReadLine(_busyLine) == PAL_LOW) {
+		osalSysLock();
+		endUpdateI();
+		osalSysUnlock();
+	}
+#endif
+
+	return _updating || (uploading() && _uploadUpdate);
+}
+
+void SSD16xx::startUpload(uint8_t xsa, uint8_t xea, uint16_t ysa, uint16_t yea,
+		const uint8_t* bp, size_t n, bool update, UpdateMode mode)
+{
+	osalDbgCheck(bp != NULL && n > 0);
+	osalDbgAssert(_entryMode & 0x01, "SSD16xx::startUpload(), decrementing x address");
+
+	select();
+
+	if (update)
+		loadWaveform(mode);
+
+	setAddress(xsa, xea, ysa, yea);
+
+	// the update command ends the RAM write
+	advanceCounter(n);
+	if (update)
+		_ramWrite = false;
+
+	_uploadUpdate = update;
+	_uploadState = UPLOAD_DATA;
+
+	// the bus and the chip are released once the data are out
+	spiStart(_spi, &_uploadCfg.cfg);
+	spiStartSend(_spi, n, bp);
+}
+
+void SSD16xx::uploadCallback(SPIDriver* spip)
+{
+	static const uint8_t cmd = SSD16xx_ADPUPDSC;
+	SSD16xx* ssd = ((const UploadConfig*)spip->config)->ssd;
+
+	osalSysLockFromISR();
+
+	if (ssd->_uploadState == UPLOAD_DATA && ssd->_uploadUpdate) {
+		// chain the display update command
+		ssd->_uploadState = UPLOAD_CMD;
+		palClearLine(ssd->_dcLine);
+		spiStartSendI(spip, 1, &cmd);
+	}
+	else if (ssd->uploading()) {
+		if (ssd->_uploadState == UPLOAD_CMD) {
+			palSetLine(ssd->_dcLine);
+			ssd->_updateStart = chVTGetSystemTimeX();
+			ssd->_updating = true;
+		}
+
+		spiUnselectI(spip);
+		ssd->_uploadState = UPLOAD_DONE;
+		osalThreadResumeI(&ssd->_uploadThread, MSG_OK);
+
+		if (ssd->_uploadCb != NULL)
+			ssd->_uploadCb(ssd, ssd->_uploadCbArg);
+	}
+
+	osalSysUnlockFromISR();
+}
+
+msg_t SSD16xx::waitUpload(sysinterval_t timeout)
+{
+	msg_t msg = MSG_OK;
+
+	osalSysLock();
+	if (uploading())
+		msg = osalThreadSuspendTimeoutS(&_uploadThread, timeout);
+	osalSysUnlock();
+
+	// the bus is released in thread context
+	if (_uploadState == UPLOAD_DONE) {
+		_uploadState = UPLOAD_IDLE;
+		spiStart(_spi, _spiCfg);
+		releaseBus();
+	}
+
+	return msg;
+}
+
+msg_t SSD16xx::update(UpdateMode mode)
+{
+	msg_t msg = startUpdate(mode);
 
 	// wait until ready
-	while (palReadLine(_busyLine) == PAL_HIGH)
-		chThdSleepMilliseconds(10);
+	if (msg == MSG_OK)
+		msg = waitUpdate(SSD16XX_UPDATE_TIMEOUT);
+
+	// give up on an update that never ends
+	if (msg == MSG_TIMEOUT) {
+		osalSysLock();
+		_updating = false;
+		osalThreadResumeI(&_waitThread, MSG_TIMEOUT);
+		osalSysUnlock();
+	}
+
+	return msg;
 }
 
 void SSD16xx::setAddress(uint8_t xsa, uint8_t xea, uint16_t ysa, uint16_t yea)
@@ -169,28 +530,46 @@ void SSD16xx::setAddress(uint8_t xsa, uint8_t xea, uint16_t ysa, uint16_t yea)
 			"SSD16xx::setAddress(), invalid address");
 
 	// set RAM X-address start/end position
-	sendCmd(SSD16xx_RASTXSE);
-	sendData(xsa);
-	sendData(xea);
+	if (!_windowValid || xsa != _xsa || xea != _xea) {
+		sendCmd(SSD16xx_RASTXSE);
+		sendData(xsa);
+		sendData(xea);
+	}
 
 	// set RAM Y-address start/end position
-	sendCmd(SSD16xx_RASTYSE);
-	sendData(ysa);
-	if (gates() > 0xFF)
-		sendData(ysa >> 8);
-	sendData(yea);
-	if (gates() > 0xFF)
-		sendData(yea >> 8);
+	if (!_windowValid || ysa != _ysa || yea != _yea) {
+		sendCmd(SSD16xx_RASTYSE);
+		sendData(ysa);
+		if (gates() > 0xFF)
+			sendData(ysa >> 8);
+		sendData(yea);
+		if (gates() > 0xFF)
+			sendData(yea >> 8);
+	}
 
 	// set RAM X address count
-	sendCmd(SSD16xx_RASTXAC);
-	sendData(xsa);
+	if (!_counterValid || xsa != _xac) {
+		sendCmd(SSD16xx_RASTXAC);
+		sendData(xsa);
+	}
 
 	// set RAM Y address count
-	sendCmd(SSD16xx_RASTYAC);
-	sendData(ysa);
-	if (gates() > 0xFF)
-		sendData(yea >> 8);
+	if (!_counterValid || ysa != _yac) {
+		sendCmd(SSD16xx_RASTYAC);
+		sendData(ysa);
+		if (gates() > 0xFF)
+			sendData(ysa >> 8);
+	}
+
+	_xsa = xsa;
+	_xea = xea;
+	_ysa = ysa;
+	_yea = yea;
+	_windowValid = true;
+
+	_xac = xsa;
+	_yac = ysa;
+	_counterValid = true;
 
 	// data write into RAM after this command
 	sendCmd(SSD16xx_RAMWR);
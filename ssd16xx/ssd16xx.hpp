@@ -22,8 +22,71 @@
 
 #include "hal.h"
 
+/**
+ * @brief	Size of the buffer used to stream repeated RAM data.
+ * @details	Bigger buffers need less SPI transfers for the same fill.
+ */
+#if !defined(SSD16XX_FILL_BUFFER_SIZE)
+#define SSD16XX_FILL_BUFFER_SIZE	64
+#endif
+
+/**
+ * @brief	Default number of partial updates between two full updates.
+ * @details	Full updates clear the ghosting left by partial updates, zero
+ * 			never forces a full update.
+ */
+#if !defined(SSD16XX_FULL_UPDATE_INTERVAL)
+#define SSD16XX_FULL_UPDATE_INTERVAL	10
+#endif
+
+/**
+ * @brief	Maximum time a blocking display update may take.
+ */
+#if !defined(SSD16XX_UPDATE_TIMEOUT)
+#define SSD16XX_UPDATE_TIMEOUT		TIME_MS2I(5000)
+#endif
+
 /** @brief	Base SSD16xx driver for EPD displays. */
 class SSD16xx {
+public:
+	/**
+	 * @brief	Display update waveform.
+	 */
+	typedef enum {
+		UPDATE_FULL = 0,		///< Full update, clears ghosting.
+		UPDATE_PARTIAL = 1,		///< Fast update without flashing.
+	} UpdateMode;
+
+	/**
+	 * @brief	SPI bus session.
+	 * @details	Holds the SPI bus from construction to destruction so the
+	 * 			select() and unselect() calls in between do not acquire,
+	 * 			start and release the bus each time. Sessions nest.
+	 * @see		acquireBus()
+	 */
+	class Session {
+		SSD16xx& _ssd;			///< Underlying SSD16xx IC.
+
+		Session(const Session&) = delete;
+		Session& operator=(const Session&) = delete;
+
+	public:
+		Session(SSD16xx& ssd) : _ssd(ssd) { _ssd.acquireBus(); }
+		~Session() { _ssd.releaseBus(); }
+	};
+
+	/**
+	 * @brief	Display update end callback.
+	 * @note	Invoked from the BUSY line ISR in locked state.
+	 */
+	typedef void (*UpdateCallback)(SSD16xx* ssd, void* arg);
+
+	/**
+	 * @brief	RAM upload end callback.
+	 * @note	Invoked from the SPI ISR in locked state.
+	 */
+	typedef void (*UploadCallback)(SSD16xx* ssd, void* arg);
+
 protected:
 	/**
 	 * @name	SSD16xx register addresses
@@ -70,11 +133,94 @@ protected:
 	} Command;
 	/** @} */
 
+	/**
+	 * @brief	Asynchronous RAM upload state.
+	 */
+	typedef enum : uint8_t {
+		UPLOAD_IDLE = 0,		///< No upload.
+		UPLOAD_DATA = 1,		///< RAM data on the wire.
+		UPLOAD_CMD = 2,			///< Display update command on the wire.
+		UPLOAD_DONE = 3,		///< Upload ended, bus not released yet.
+	} UploadState;
+
+	/**
+	 * @brief	SPI configuration used by uploads.
+	 * @details	Copy of the click configuration with the end callback
+	 * 			driving the upload.
+	 */
+	typedef struct {
+		SPIConfig cfg;			///< SPI configuration, must be the first member.
+		SSD16xx* ssd;			///< Owner of the upload.
+	} UploadConfig;
+
 	SPIDriver* _spi;			///< Pointer to click @p SPIDriver SPI driver.
 	const SPIConfig* _spiCfg;	///< Pointer to click @p SPIConfig SPI configuration.
 	ioline_t _rstLine;			///< Click reset line.
 	ioline_t _busyLine;			///< Click busy line.
 	ioline_t _dcLine;			///< Click data/command line.
+	UpdateMode _lutMode;		///< Waveform currently loaded in the LUT register.
+	uint16_t _partialCount;		///< Partial updates since the last full update.
+	uint16_t _fullInterval;		///< Partial updates forcing a full update.
+	volatile bool _updating;	///< Display update in progress.
+	systime_t _updateStart;		///< Start time of the last display update.
+	sysinterval_t _updateTime;	///< Duration of the last display update.
+	thread_reference_t _waitThread;	///< Thread waiting for the update end.
+	UpdateCallback _updateCb;	///< Update end callback.
+	void* _updateCbArg;			///< Update end callback argument.
+	uint16_t _busDepth;			///< Nesting depth of bus sessions.
+	uint8_t _dataEntry;			///< Data entry mode written by start().
+	uint8_t _entryMode;			///< Data entry mode mirror.
+	bool _windowValid;			///< RAM window mirror matches the IC.
+	bool _counterValid;			///< RAM address counter mirror matches the IC.
+	bool _ramWrite;				///< Data bytes go to the RAM and move the counter.
+	uint8_t _xsa, _xea;			///< RAM x window mirror.
+	uint16_t _ysa, _yea;		///< RAM y window mirror.
+	uint8_t _xac;				///< RAM x address counter mirror.
+	uint16_t _yac;				///< RAM y address counter mirror.
+	UploadConfig _uploadCfg;	///< SPI configuration used by uploads.
+	volatile UploadState _uploadState;	///< Upload state.
+	bool _uploadUpdate;			///< Start a display update after the upload.
+	thread_reference_t _uploadThread;	///< Thread waiting for the upload end.
+	UploadCallback _uploadCb;	///< Upload end callback.
+	void* _uploadCbArg;			///< Upload end callback argument.
+
+	/**
+	 * @brief	Finish the display update.
+	 * @note	Must be called in locked state.
+	 */
+	void endUpdateI();
+
+#if PAL_USE_CALLBACKS
+	/**
+	 * @brief	BUSY line falling edge callback.
+	 */
+	static void busyCallback(void* arg);
+#endif
+
+	/**
+	 * @brief	SPI end callback of the uploads.
+	 * @details	Chains the display update command to the RAM data and
+	 * 			unselects the chip at the end.
+	 */
+	static void uploadCallback(SPIDriver* spip);
+
+	/**
+	 * @brief	Apply the full update policy and load the waveform.
+	 * @note	Need to call select() before execution.
+	 *
+	 * @param[in] mode	requested waveform
+	 *
+	 * @returns	The waveform used.
+	 */
+	UpdateMode loadWaveform(UpdateMode mode);
+
+	/**
+	 * @brief	Move the RAM address counter mirror by @p n written bytes.
+	 * @details	The counter follows the data entry mode within the window.
+	 * 			Where it lands once the window end is reached is not
+	 * 			specified, the mirror is invalidated then.
+	 */
+	void advanceCounter(size_t n);
 
 	/**
 	 * @brief	Send command.
@@ -91,8 +237,10 @@ protected:
 	 * @details	LUT data represent the waveforms needed for changing GS colors.
 	 * @note	This pure virtual member has to implemented for all derived
 	 * 			drivers cause its driver dependent.
+	 *
+	 * @param[in] mode	waveform to send
 	 */
-	virtual void sendLUTData() = 0;
+	virtual void sendLUTData(UpdateMode mode) = 0;
 
 public:
 	SSD16xx(SPIDriver& spi, const SPIConfig& spiCfg, ioline_t rstLine, ioline_t busyLine, ioline_t dcLine);
@@ -124,8 +272,17 @@ public:
 	 * @brief	Select the SPI chip.
 	 * @note	When SPI_USE_MUTUAL_EXCLUSION is enabled also acquire SPI
 	 * 			bus and starts the driver.
+	 * @note	Waits for an upload and a display update in progress to
+	 * 			end, the device ignores the interface while busy.
+	 *
+	 * @returns	The operation status, the chip is selected anyway and
+	 * 			unselect() must follow.
+	 * @retval MSG_OK		if the device is ready.
+	 * @retval MSG_TIMEOUT	if the device is still busy after
+	 * 						@p SSD16XX_UPDATE_TIMEOUT, commands sent
+	 * 						meanwhile are ignored.
 	 */
-	void select();
+	msg_t select();
 
 	/**
 	 * @brief	Unselect the SPI chip.
@@ -134,28 +291,191 @@ public:
 	 */
 	void unselect();
 
+	/**
+	 * @brief	Begin a bus session.
+	 * @details	The outermost call acquires the SPI bus and starts the
+	 * 			driver when SPI_USE_MUTUAL_EXCLUSION is enabled, nested
+	 * 			calls only count.
+	 * @note	The bus stays owned while waiting for a display update
+	 * 			inside the session.
+	 */
+	void acquireBus();
+
+	/**
+	 * @brief	End a bus session.
+	 * @details	The outermost call releases the SPI bus.
+	 */
+	void releaseBus();
+
 	/**
 	 * @brief	Start the SPI driver and send initialize sequence.
 	 */
 	void start();
 
+	/**
+	 * @brief	Set the data entry mode.
+	 * @details	Takes effect with the next start(). While the RAM x address
+	 * 			decrements, the pixels of each RAM data byte are reversed
+	 * 			on the way out so the data keep their first pixel in the
+	 * 			most significant bits.
+	 *
+	 * @param[in] mode		DEMDS value, bit 0 increments x, bit 1 y and
+	 * 						bit 2 updates y first
+	 */
+	void setDataEntryMode(uint8_t mode) { _dataEntry = mode & 0x07; }
+
 	/**
 	 * @brief	Stop the SPI driver, clock and put the device to sleep.
 	 */
 	void stop();
 
+	/**
+	 * @brief	Start a display update without waiting for its end.
+	 * @details	The LUT register is rewritten only when the waveform
+	 * 			changes. A partial update is turned into a full one once
+	 * 			the full update interval is reached and for the first
+	 * 			update after start(). The update ends on the BUSY line
+	 * 			falling edge which wakes waitUpdate() and invokes the
+	 * 			update callback.
+	 * @note	Waits for a previous update to end, nothing is started if
+	 * 			it does not end in time.
+	 *
+	 * @param[in] mode	requested waveform
+	 *
+	 * @returns	The operation status.
+	 * @retval MSG_OK		if the update was started.
+	 * @retval MSG_TIMEOUT	if the previous update did not end after
+	 * 						@p SSD16XX_UPDATE_TIMEOUT.
+	 */
+	msg_t startUpdate(UpdateMode mode = UPDATE_FULL);
+
+	/**
+	 * @brief	Wait for the display update to end.
+	 *
+	 * @param[in] timeout	the number of ticks before the operation timeouts
+	 *
+	 * @returns	The operation status.
+	 * @retval MSG_OK		if the update ended or none is in progress.
+	 * @retval MSG_TIMEOUT	if the update is still in progress.
+	 */
+	msg_t waitUpdate(sysinterval_t timeout);
+
+	/**
+	 * @brief	Check whether a display update is in progress.
+	 * @details	Includes an update queued behind an upload.
+	 */
+	bool updating();
+
+	/**
+	 * @brief	Start sending RAM data without waiting.
+	 * @details	Sets the RAM window and hands the data to the SPI DMA, the
+	 * 			buffer is read in place and must stay unchanged until the
+	 * 			upload ends. A display update may be queued right behind
+	 * 			the data, it starts without CPU involvement. The upload end
+	 * 			wakes waitUpload() and invokes the upload callback.
+	 * 			Uploads need an incrementing RAM x address, the data are
+	 * 			not reversed.
+	 * @note	The SPI bus stays acquired until the owning thread calls
+	 * 			waitUpload() or any other driver function.
+	 *
+	 * @param[in] xsa		RAM x start address
+	 * @param[in] xea		RAM x end address
+	 * @param[in] ysa		RAM y start address
+	 * @param[in] yea		RAM y end address
+	 * @param[in] bp		pointer to the RAM data
+	 * @param[in] n			number of bytes to send
+	 * @param[in] update	start a display update after the data
+	 * @param[in] mode		requested waveform of the update
+	 */
+	void startUpload(uint8_t xsa, uint8_t xea, uint16_t ysa, uint16_t yea,
+			const uint8_t* bp, size_t n, bool update = false, UpdateMode mode = UPDATE_FULL);
+
+	/**
+	 * @brief	Wait for the upload to end and release the SPI bus.
+	 *
+	 * @param[in] timeout	the number of ticks before the operation timeouts
+	 *
+	 * @returns	The operation status.
+	 * @retval MSG_OK		if the upload ended or none is in progress.
+	 * @retval MSG_TIMEOUT	if the upload is still in progress.
+	 */
+	msg_t waitUpload(sysinterval_t timeout);
+
+	/**
+	 * @brief	Check whether an upload is on the wire.
+	 */
+	bool uploading() const { return _uploadState == UPLOAD_DATA || _uploadState == UPLOAD_CMD; }
+
+	/**
+	 * @brief	Set the upload end callback.
+	 *
+	 * @param[in] cb		callback or @p NULL
+	 * @param[in] arg		callback argument
+	 */
+	void setUploadCallback(UploadCallback cb, void* arg) {
+		_uploadCb = cb;
+		_uploadCbArg = arg;
+	}
+
 	/**
 	 * @brief	Send the update display command and wait until device
 	 *			is ready.
 	 * @note	No need to select/unselect chip cause it is already done
 	 * 			before waiting for the busy line to go low to release
 	 * 			the SPI bus for other applications.
+	 *
+	 * @param[in] mode	requested waveform
+	 *
+	 * @returns	The operation status.
+	 * @retval MSG_OK		if the update ended.
+	 * @retval MSG_TIMEOUT	if the previous or this update took longer
+	 * 						than @p SSD16XX_UPDATE_TIMEOUT.
 	 */
-	void update();
+	msg_t update(UpdateMode mode = UPDATE_FULL);
+
+	/**
+	 * @brief	Set the display update end callback.
+	 *
+	 * @param[in] cb		callback or @p NULL
+	 * @param[in] arg		callback argument
+	 */
+	void setUpdateCallback(UpdateCallback cb, void* arg) {
+		_updateCb = cb;
+		_updateCbArg = arg;
+	}
+
+	/**
+	 * @brief	Get the duration of the last finished display update.
+	 */
+	sysinterval_t updateTime() const { return _updateTime; }
+
+	/**
+	 * @brief	Get the start time of the last display update.
+	 */
+	systime_t updateStart() const { return _updateStart; }
+
+	/**
+	 * @brief	Set the number of partial updates between two full updates.
+	 *
+	 * @param[in] n		partial updates, zero never forces a full update
+	 */
+	void setFullUpdateInterval(uint16_t n) { _fullInterval = n; }
+
+	/**
+	 * @brief	Forget the mirrored RAM window and address counter.
+	 * @details	The next setAddress() sends the whole window. Needed after
+	 * 			talking to the IC behind the driver's back.
+	 */
+	void invalidateAddress() {
+		_windowValid = false;
+		_counterValid = false;
+	}
 
 	/**
 	 * @brief	Set the RAM start and end address.
-	 * @details After this command RAM data need to be send.
+	 * @details After this command RAM data need to be send. The window and
+	 * 			address counter are mirrored, commands that would not
+	 * 			change them are skipped.
 	 * @note	Need to call select() before execution.
 	 * @note	The RAM x and y axis do not necessary correspond to display
 	 * 			axis.
@@ -177,12 +497,27 @@ public:
 
 	/**
 	 * @brief	Send data / RAM data.
+	 * @details	With a decrementing x address the pixels of each RAM byte
+	 * 			are reversed into a buffer of @p SSD16XX_FILL_BUFFER_SIZE
+	 * 			bytes, one SPI transfer per buffer.
 	 * @note	Need to call unselect() after all RAM data are sent.
 	 *
 	 * @param[in] bp	pointer to the data buffer
 	 * @param[in] n		number of bytes to send
 	 */
 	void sendData(const uint8_t* bp, size_t n);
+
+	/**
+	 * @brief	Send a repeated data byte / RAM data.
+	 * @details	The byte is streamed from a buffer of
+	 * 			@p SSD16XX_FILL_BUFFER_SIZE bytes so a fill takes only a
+	 * 			few SPI transfers.
+	 * @note	Need to call unselect() after all RAM data are sent.
+	 *
+	 * @param[in] b		data byte
+	 * @param[in] n		number of times to send @p b
+	 */
+	void fillData(uint8_t b, size_t n);
 };
 
 #endif /* EINK_CLICK_SSD16XX_HPP_ */
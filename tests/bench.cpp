@@ -0,0 +1,477 @@
+/*
+ * Copyright (C) 2020 Daniel Igaz
+ *
+ * This file is part of the eINK-click project.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Host benchmark of the eINK-click driver on the simulator.
+ *
+ * Build and run:	make -C tests bench
+ *
+ * Each SPI case reports the transfers and bytes of one operation, the
+ * bus time they take at BENCH_BITRATE and the host time of the driver
+ * code. The transfer and byte counts are deterministic and checked
+ * against the limits of the case, exceeding one fails the run. Host
+ * times depend on the machine and are informational.
+ *
+ * The other cases time an optimized path against its scalar reference
+ * from reference.hpp, in TSC cycles on x86 hosts and in ns elsewhere.
+ * The best of BENCH_SAMPLES runs is reported, an optimized path slower
+ * than its reference is flagged without failing the run. The output of
+ * both is compared where it is checked, a difference fails the run.
+ */
+
+#include "hal_sim.hpp"
+#include "ssd1606.hpp"
+#include "epd.hpp"
+#include "dither.hpp"
+#include "Cambria_Bold_12x12.hpp"
+#include "reference.hpp"
+#include "rleencode.hpp"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define TICKS_NAME				"cycles"
+#else
+#define TICKS_NAME				"ns"
+#endif
+
+/**
+ * @brief	SPI clock used for the bus time estimate.
+ */
+#define BENCH_BITRATE			4000000
+
+/**
+ * @brief	Driver overhead per SPI transfer used for the bus time estimate.
+ */
+#define BENCH_CALL_NS			2000
+
+/**
+ * @brief	Timed runs of a reference case, the fastest one is reported.
+ */
+#define BENCH_SAMPLES			5
+
+static int failures = 0;
+
+/**
+ * @brief	Host time of a function in ns per call.
+ */
+template<typename F>
+static double timeNs(F fn, int iters)
+{
+	auto t0 = std::chrono::steady_clock::now();
+	for (int i = 0; i < iters; i++)
+		fn();
+	auto t1 = std::chrono::steady_clock::now();
+
+	return std::chrono::duration<double, std::nano>(t1 - t0).count() / iters;
+}
+
+/**
+ * @brief	Host time stamp in TICKS_NAME.
+ */
+static uint64_t ticks()
+{
+#if defined(__x86_64__) || defined(__i386__)
+	return __rdtsc();
+#else
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(
+			std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+/**
+ * @brief	Host time of a function in TICKS_NAME per call.
+ */
+template<typename F>
+static double timeTicks(F fn, int iters)
+{
+	uint64_t t0 = ticks();
+	for (int i = 0; i < iters; i++)
+		fn();
+
+	return double(ticks() - t0) / iters;
+}
+
+/**
+ * @brief	Best host time of a function over BENCH_SAMPLES runs.
+ */
+template<typename F>
+static double bestTicks(F fn, int iters)
+{
+	double best = timeTicks(fn, iters);
+
+	for (int i = 1; i < BENCH_SAMPLES; i++) {
+		double t = timeTicks(fn, iters);
+		if (t < best)
+			best = t;
+	}
+
+	return best;
+}
+
+/**
+ * @brief	Measure one SPI case.
+ * @details	@p prepare runs before each call of @p op and is neither
+ * 			counted nor timed.
+ */
+template<typename P, typename F>
+static void spiCase(const char* name, uint32_t maxCalls, uint32_t maxBytes, P prepare, F op, int iters)
+{
+	SimSpi& sim = simSpi(SPID1);
+
+	prepare();
+	sim.stats.reset();
+	op();
+	SimSpiStats st = sim.stats;
+
+	double ns = 0;
+	for (int i = 0; i < iters; i++) {
+		prepare();
+		ns += timeNs(op, 1);
+	}
+	ns /= iters;
+
+	bool fail = st.calls > maxCalls || st.bytes > maxBytes;
+	printf("%-26s calls=%6u (max %6u) bytes=%6u (max %6u) bus=%8.1f us host=%8.1f us%s\n",
+			name, st.calls, maxCalls, st.bytes, maxBytes,
+			st.estimateNs(BENCH_BITRATE, BENCH_CALL_NS) / 1000.0, ns / 1000.0,
+			fail ? "  REGRESSION" : "");
+	if (fail)
+		failures++;
+}
+
+/**
+ * @brief	Compare an optimized path with its scalar reference.
+ *
+ * @param[in] units		work done by one call, in @p unitName
+ */
+template<typename F, typename R>
+static void refCase(const char* name, F fast, R ref, int iters, double units, const char* unitName)
+{
+	double f = bestTicks(fast, iters);
+	double r = bestTicks(ref, iters);
+
+	printf("%-26s %9.2f %s/%s  reference %9.2f  x%.1f%s\n",
+			name, f / units, TICKS_NAME, unitName, r / units, r / f,
+			(f >= r) ? "  slower" : "");
+}
+
+/**
+ * @brief	Drawing and flushing on the SSD1606 (172x72).
+ */
+static void benchSpi()
+{
+	static const SPIConfig cfg = { false, NULL, 1 };
+	static uint8_t fb[FrameBuffer::size(172, 72)];
+	const char* text = "Hello, eINK world 12";
+	auto none = [] {};
+
+	simReset();
+	SimSSD16xx panel(1, 2, 3, 4, 72, 172);
+	simAttach(SPID1, panel);
+	SSD1606 ssd(SPID1, cfg, 2, 3, 4);
+	EPD epd(ssd, 172, 72, Cambria_Bold_12x12);
+	epd.start();
+
+	printf("-- SPI traffic, SSD1606 172x72\n");
+
+	spiCase("fillDisplay", 60, 3107, none,
+			[&] { epd.fillDisplay(EPD::COLOR_WHITE); }, 2000);
+	spiCase("drawFilledRect 100x40", 29, 1111, none,
+			[&] { epd.drawFilledRect(EPD::COLOR_BLACK, 10, 10, 100, 40); }, 2000);
+	spiCase("drawText 20 chars", 19, 503, none,
+			[&] { epd.drawText(EPD::COLOR_BLACK, 0, 13, text); }, 2000);
+
+	epd.setFrameBuffer(fb);
+
+	spiCase("flush full screen", 12, 3107,
+			[&] { epd.fillDisplay(EPD::COLOR_WHITE); },
+			[&] { epd.flush(); }, 2000);
+	spiCase("flush rect 20x10", 12, 71,
+			[&] { epd.drawFilledRect(EPD::COLOR_BLACK, 30, 21, 20, 10); },
+			[&] { epd.flush(); }, 2000);
+	spiCase("flush text 20 chars", 19, 503,
+			[&] { epd.drawText(EPD::COLOR_BLACK, 0, 13, text); },
+			[&] { epd.flush(); }, 2000);
+
+	epd.setFrameBuffer(NULL);
+}
+
+/**
+ * @brief	Specialized EPD::drawBitmap() against the original per pixel
+ * 			callback, direct mode on the SSD1606 (172x72).
+ * @details	Both include the simulator overhead of their SPI transfers.
+ * 			The emulated RAM must end up the same.
+ */
+static void benchBitmap()
+{
+	static const SPIConfig cfg = { false, NULL, 1 };
+	const EPD::Font* font = (const EPD::Font*)Cambria_Bold_12x12;
+	const char* text = "Hello, eINK world 12";
+	uint16_t textWidth = EPD::getTextWidth(font, text);
+
+	simReset();
+	SimSSD16xx panel(1, 2, 3, 4, 72, 172);
+	simAttach(SPID1, panel);
+	SSD1606 ssd(SPID1, cfg, 2, 3, 4);
+	EPD epd(ssd, 172, 72, Cambria_Bold_12x12);
+	epd.start();
+
+	auto ram = [&] {
+		uint64_t h = 0;
+		for (uint16_t g = 0; g < 172; g++) {
+			for (uint8_t x = 0; x < 18; x++)
+				h = h * 131 + panel.ram(x, g);
+		}
+		return h;
+	};
+	auto rect = [&] { epd.drawFilledRect(EPD::COLOR_BLACK, 10, 9, 100, 40); };
+	auto refRect = [&] {
+		refDrawBitmap(ssd, 172, EPD::COLOR_BLACK, EPD::COLOR_WHITE, 10, 9, 100, 40,
+				[](uint16_t, uint16_t, uint16_t, uint16_t) { return true; });
+	};
+	auto draw = [&] { epd.drawText(EPD::COLOR_BLACK, 0, 13, text); };
+	auto refDraw = [&] { refDrawText(ssd, 172, font, EPD::COLOR_BLACK, EPD::COLOR_WHITE, 0, 13, text); };
+
+	printf("-- drawBitmap, SSD1606 172x72\n");
+
+	epd.fillDisplay(EPD::COLOR_WHITE);
+	rect();
+	draw();
+	uint64_t h = ram();
+	epd.fillDisplay(EPD::COLOR_WHITE);
+	refRect();
+	refDraw();
+	if (ram() != h) {
+		printf("drawBitmap: RAM differs from the reference  REGRESSION\n");
+		failures++;
+	}
+
+	refCase("drawFilledRect 100x40", rect, refRect, 2000, 100 * 40, "px");
+	refCase("drawText 20 chars", draw, refDraw, 2000, textWidth * font->header.height, "px");
+}
+
+/**
+ * @brief	296x128 panel drawn into a frame buffer only.
+ */
+class Panel296 : public SSD16xx {
+public:
+	Panel296(SPIDriver& spi, const SPIConfig& spiCfg, ioline_t rstLine, ioline_t busyLine, ioline_t dcLine)
+	: SSD16xx(spi, spiCfg, rstLine, busyLine, dcLine)
+	{}
+
+	virtual uint16_t sources() const { return 128; }
+	virtual uint16_t gates() const { return 296; }
+	virtual void sendLUTData(UpdateMode mode) { (void)mode; }
+};
+
+/**
+ * @brief	Run-length encoding of 296x128 frames.
+ * @details	Reports the compression ratio and the decode speed of a UI
+ * 			screen, vertical gray bars and random noise. The encoded
+ * 			sizes are deterministic and checked against limits, the
+ * 			decoded frames must match.
+ */
+static void benchRle()
+{
+	static const SPIConfig cfg = { false, NULL, 1 };
+	const uint16_t W = 296;
+	const uint16_t H = 128;
+	const size_t size = FrameBuffer::size(W, H);
+	static uint8_t fb[FrameBuffer::size(W, H)];
+	static uint8_t out[FrameBuffer::size(W, H)];
+
+	simReset();
+	SimSSD16xx panel(1, 2, 3, 4, H, W);
+	simAttach(SPID1, panel);
+	Panel296 ssd(SPID1, cfg, 2, 3, 4);
+	EPD epd(ssd, W, H, Cambria_Bold_12x12);
+	epd.setFrameBuffer(fb);
+
+	epd.fillDisplay(EPD::COLOR_WHITE);
+	epd.drawFilledRect(EPD::COLOR_BLACK, 0, 0, W, 20);
+	epd.setBkgColor(EPD::COLOR_BLACK);
+	epd.drawText(EPD::COLOR_WHITE, 4, 4, "Status 12:34  Battery 87%");
+	epd.setBkgColor(EPD::COLOR_LIGHT_GRAY);
+	for (int i = 0; i < 6; i++) {
+		epd.drawFilledRect(EPD::COLOR_LIGHT_GRAY, 10, 28 + i * 16, 276, 12);
+		epd.drawText(EPD::COLOR_BLACK, 14, 28 + i * 16, "Sensor reading 42.0");
+	}
+
+	struct {
+		const char* name;
+		size_t maxSize;
+		std::vector<uint8_t> raw;
+	} frames[] = {
+		{ "ui screen", 2749, std::vector<uint8_t>(fb, fb + size) },
+		{ "vertical gray bars", 296, std::vector<uint8_t>(size) },
+		{ "random noise", 9546, std::vector<uint8_t>(size) },
+	};
+
+	for (uint16_t x = 0; x < W; x++) {
+		for (uint16_t b = 0; b < FrameBuffer::size(1, H); b++)
+			frames[1].raw[x * FrameBuffer::size(1, H) + b] = uint8_t((x / 37) * 0x55);
+	}
+	srand(1);
+	for (auto& b : frames[2].raw)
+		b = rand();
+
+	printf("-- RLE, 296x128 frame of %zu bytes\n", size);
+
+	for (auto& f : frames) {
+		std::vector<uint8_t> enc = rleEncode(f.raw, FrameBuffer::size(1, H));
+		auto decode = [&] {
+			RleDecoder dec(enc.data(), enc.size(), FrameBuffer::size(1, H));
+			dec.read(out, size);
+		};
+		double t = bestTicks(decode, 500);
+		double ns = timeNs(decode, 500);
+
+		bool fail = enc.size() > f.maxSize || memcmp(out, f.raw.data(), size) != 0;
+		printf("%-26s %5zu bytes (max %5zu) %5.1f%%  decode %6.0f MB/s %5.2f %s/B%s\n",
+				f.name, enc.size(), f.maxSize, 100.0 * enc.size() / size,
+				size / ns * 1000.0, t / size, TICKS_NAME, fail ? "  REGRESSION" : "");
+		if (fail)
+			failures++;
+	}
+
+	epd.setFrameBuffer(NULL);
+}
+
+/**
+ * @brief	FrameBuffer raster operations on a 296x128 buffer.
+ */
+static void benchRaster()
+{
+	const uint16_t W = 296;
+	const uint16_t H = 128;
+	static uint8_t mem[FrameBuffer::size(W, H)];
+	static uint8_t img[FrameBuffer::size(W, H)];
+	FrameBuffer fb(mem, W, H);
+
+	for (auto& b : img)
+		b = rand();
+
+	printf("-- FrameBuffer raster, 296x128\n");
+
+	refCase("fill xor 296x128",
+			[&] { fb.fillRect(0, 0, W, H, 2, FrameBuffer::ROP_XOR); },
+			[&] { refRaster(fb, 0, 0, W, H, NULL, 0, 0, 0, 0, 2, FrameBuffer::ROP_XOR, -1); },
+			200, W * H, "px");
+	refCase("fill or 200x100 row 3",
+			[&] { fb.fillRect(10, 3, 200, 100, 1, FrameBuffer::ROP_OR); },
+			[&] { refRaster(fb, 10, 3, 200, 100, NULL, 0, 0, 0, 0, 1, FrameBuffer::ROP_OR, -1); },
+			200, 200 * 100, "px");
+	refCase("copy 200x100 row 1 to 3",
+			[&] { fb.blit(5, 3, 200, 100, img, H, 50, 1); },
+			[&] { refRaster(fb, 5, 3, 200, 100, img, W, H, 50, 1, 0, FrameBuffer::ROP_COPY, -1); },
+			200, 200 * 100, "px");
+	refCase("masked 200x100 row 2 to 1",
+			[&] { fb.blitMasked(5, 1, 200, 100, img, H, 50, 2, 3); },
+			[&] { refRaster(fb, 5, 1, 200, 100, img, W, H, 50, 2, 0, FrameBuffer::ROP_COPY, 3); },
+			200, 200 * 100, "px");
+	refCase("move 200x100 by 1,1",
+			[&] { fb.blit(11, 11, 200, 100, fb, 10, 10); },
+			[&] { refRaster(fb, 11, 11, 200, 100, mem, W, H, 10, 10, 0, FrameBuffer::ROP_COPY, -1); },
+			200, 200 * 100, "px");
+}
+
+/**
+ * @brief	Dithering of a 296x128 gray ramp.
+ * @details	Threshold and ordered modes into 4-row strips are timed
+ * 			against the scalar reference, their frame buffer output must
+ * 			match it. Frame buffer and diffusion times are informational.
+ */
+static void benchDither()
+{
+	const uint16_t W = 296;
+	const uint16_t H = 128;
+	static uint8_t gray[W * H];
+	static uint8_t fb[FrameBuffer::size(W, H)];
+	static uint8_t ref[FrameBuffer::size(W, H)];
+	static uint8_t strips[W];
+	static int16_t errors[Dither::errorBufferSize(W)];
+	const uint16_t stride = FrameBuffer::size(1, H);
+
+	srand(1);
+	for (uint16_t y = 0; y < H; y++) {
+		for (uint16_t x = 0; x < W; x++)
+			gray[y * W + x] = uint8_t(x * 255 / (W - 1) + rand() % 9 - 4);
+	}
+
+	printf("-- Dither, 296x128 gray ramp\n");
+
+	for (int m = Dither::DITHER_THRESHOLD; m <= Dither::DITHER_ORDERED; m++) {
+		Dither dither(Dither::Mode(m), W);
+		bool ordered = m == Dither::DITHER_ORDERED;
+		auto frame = [&] {
+			for (uint16_t y = 0; y < H; y++)
+				dither.row(gray + y * W, y, fb + (y >> 2), stride);
+		};
+		auto strip = [&] {
+			for (uint16_t y = 0; y < H; y++)
+				dither.row(gray + y * W, y, strips);
+		};
+		auto refStrip = [&] {
+			for (uint16_t y = 0; y < H; y++)
+				refDitherRow(ordered, gray + y * W, W, y, strips, 1);
+		};
+
+		frame();
+		for (uint16_t y = 0; y < H; y++)
+			refDitherRow(ordered, gray + y * W, W, y, ref + (y >> 2), stride);
+		if (memcmp(fb, ref, sizeof(fb)) != 0) {
+			printf("%s: frame differs from the reference  REGRESSION\n", ordered ? "ordered" : "threshold");
+			failures++;
+		}
+
+		refCase(ordered ? "ordered 4-row strips" : "threshold 4-row strips", strip, refStrip, 200, W * H, "px");
+		printf("%-26s %9.2f %s/px\n", ordered ? "ordered frame buffer" : "threshold frame buffer",
+				bestTicks(frame, 200) / (W * H), TICKS_NAME);
+	}
+
+	Dither dither(Dither::DITHER_DIFFUSION, W, errors);
+	auto diffuse = [&] {
+		dither.reset();
+		for (uint16_t y = 0; y < H; y++)
+			dither.row(gray + y * W, y, fb + (y >> 2), stride);
+	};
+	printf("%-26s %9.2f %s/px\n", "diffusion frame buffer", bestTicks(diffuse, 200) / (W * H), TICKS_NAME);
+}
+
+int main()
+{
+	srand(1);
+
+	benchSpi();
+	benchBitmap();
+	benchRaster();
+	benchRle();
+	benchDither();
+
+	if (failures > 0) {
+		printf("%d regression(s)\n", failures);
+		return 1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,179 @@
+/*
+ * Copyright (C) 2020 Daniel Igaz
+ *
+ * This file is part of the eINK-click project.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef EINK_CLICK_TESTS_REFERENCE_HPP_
+#define EINK_CLICK_TESTS_REFERENCE_HPP_
+
+/*
+ * Scalar pixel by pixel references of the optimized drawing code, shared
+ * by the tests and the benchmark.
+ */
+
+#include "framebuffer.hpp"
+#include "epd.hpp"
+#include <functional>
+#include <vector>
+
+/**
+ * @brief	Combine a rectangle of @p dst with a source, pixel by pixel.
+ * @details	Reference of FrameBuffer::fillRect(), blit() and blitMasked().
+ * 			The source is copied first, so overlapping areas of the same
+ * 			buffer read the original pixels.
+ *
+ * @param[in] src			source pixels in the RAM layout or @p NULL to
+ * 							use @p fill
+ * @param[in] srcHeight		source height in pixels
+ * @param[in] fill			2 bit color used without a source
+ * @param[in] transparent	2 bit source color left out or -1
+ */
+static inline void refRaster(FrameBuffer& dst, uint16_t x, uint16_t y, uint16_t width, uint16_t height,
+		const uint8_t* src, uint16_t srcWidth, uint16_t srcHeight, uint16_t sx, uint16_t sy,
+		uint8_t fill, FrameBuffer::RasterOp op, int transparent)
+{
+	std::vector<uint8_t> copy;
+
+	if (src != NULL)
+		copy.assign(src, src + FrameBuffer::size(srcWidth, srcHeight));
+
+	FrameBuffer s(copy.data(), srcWidth, srcHeight);
+
+	for (uint16_t i = 0; i < width; i++) {
+		for (uint16_t j = 0; j < height; j++) {
+			uint8_t p = (src != NULL) ? s.pixel(sx + i, sy + j) : fill;
+			uint8_t d = dst.pixel(x + i, y + j);
+
+			if (transparent >= 0 && p == transparent)
+				continue;
+
+			switch (op) {
+			case FrameBuffer::ROP_AND:
+				p &= d;
+				break;
+			case FrameBuffer::ROP_OR:
+				p |= d;
+				break;
+			case FrameBuffer::ROP_XOR:
+				p ^= d;
+				break;
+			default:
+				break;
+			}
+
+			dst.setPixel(x + i, y + j, p);
+		}
+	}
+}
+
+/**
+ * @brief	Pixel callback of the original EPD::drawBitmap().
+ */
+typedef std::function<bool(uint16_t width, uint16_t height, uint16_t w, uint16_t h)> RefBmpFnc;
+
+/**
+ * @brief	Original EPD::drawBitmap() in the normal orientation.
+ * @details	One callback per pixel and one SPI transfer per RAM byte.
+ *
+ * @param[in] displayWidth	display width in pixels
+ */
+static inline void refDrawBitmap(SSD16xx& ssd, uint16_t displayWidth, uint8_t color, uint8_t bkgColor,
+		uint16_t x, uint16_t y, uint16_t width, uint16_t height, RefBmpFnc bmpFnc)
+{
+	uint8_t bkg = bkgColor * 0x55;
+	uint8_t b = bkg;
+
+	ssd.select();
+	ssd.setAddress(y >> 2, ((y + height + 3) >> 2) - 1, displayWidth - 1 - x, displayWidth - 1 - (x - 1 + width));
+
+	for (uint16_t w = 0; w < width; w++) {
+		for (uint16_t h = 0; h < height; h++) {
+			if (bmpFnc(width, height, w, h)) {
+				b &= ~(0x03 << ((3 - ((h + y) & 0x03)) << 1));
+				b |= (color << ((3 - ((h + y) & 0x03)) << 1));
+			}
+
+			// one byte after each 4 pixels or at the last pixel
+			if (((h + y) & 0x03) == 0x03 || (h == (height - 1))) {
+				ssd.sendData(b);
+				b = bkg;
+			}
+		}
+	}
+
+	ssd.unselect();
+}
+
+/**
+ * @brief	Original EPD::drawText() on top of refDrawBitmap(), left aligned.
+ */
+static inline void refDrawText(SSD16xx& ssd, uint16_t displayWidth, const EPD::Font* fntp,
+		uint8_t color, uint8_t bkgColor, uint16_t x, uint16_t y, const char* str)
+{
+	uint16_t height = fntp->header.height;
+
+	for (; *str != 0; str++) {
+		if (*str < fntp->header.first_char || *str > fntp->header.last_char)
+			continue;
+
+		uint16_t width = fntp->char_table[*str - fntp->header.first_char].width;
+		const uint8_t* bp = (const uint8_t*)fntp + fntp->char_table[*str - fntp->header.first_char].offset;
+
+		if (x + width > displayWidth)
+			return;
+
+		refDrawBitmap(ssd, displayWidth, color, bkgColor, x, y, width, height,
+				[bp](uint16_t width, uint16_t height, uint16_t w, uint16_t h) -> bool {
+			(void)height;
+			return bool((bp[(h * ((width + 7) & 0xF8) + (w & 0xF8)) >> 3] >> (w & 0x07)) & 0x01);
+		});
+		x += width;
+	}
+}
+
+/**
+ * @brief	Threshold and ordered Dither::row(), pixel by pixel.
+ * @details	Color k is taken from the fraction (2 * b + 1) / 32 of the
+ * 			85 gray step above color k - 1, with b the Bayer entry when
+ * 			@p ordered, 7.5 otherwise.
+ */
+static inline void refDitherRow(bool ordered, const uint8_t* gray, uint16_t width, uint16_t y,
+		uint8_t* bp, size_t step)
+{
+	static const uint8_t bayer[4][4] = {
+		{  0,  8,  2, 10 },
+		{ 12,  4, 14,  6 },
+		{  3, 11,  1,  9 },
+		{ 15,  7, 13,  5 },
+	};
+	uint8_t shift = (3 - (y & 0x03)) << 1;
+
+	for (uint16_t x = 0; x < width; x++) {
+		uint32_t b2 = ordered ? 2 * bayer[y & 0x03][x & 0x03] + 1 : 16;
+		uint8_t level = 0;
+
+		for (uint8_t k = 1; k <= 3; k++) {
+			if (32 * uint32_t(gray[x]) >= 85 * (32 * (k - 1) + b2))
+				level = k;
+		}
+
+		uint8_t* cp = bp + x * step;
+		*cp = (*cp & ~(0x03 << shift)) | (level << shift);
+	}
+}
+
+#endif /* EINK_CLICK_TESTS_REFERENCE_HPP_ */
@@ -0,0 +1,226 @@
+/*
+ * Copyright (C) 2020 Daniel Igaz
+ *
+ * This file is part of the eINK-click project.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Band rendering against the whole scene drawn into the shadow frame
+ * buffer of a second panel: the RAM matches for all band heights, one or
+ * two band buffers, display lists and orientations, and each band goes
+ * out through one window.
+ */
+
+#include "hal_sim.hpp"
+#include "ssd1606.hpp"
+#include "epd.hpp"
+#include "displaylist.hpp"
+#include "Cambria_Bold_12x12.hpp"
+#include <stdio.h>
+#include <stdlib.h>
+
+#define WIDTH		172
+#define HEIGHT		72
+#define SCENES		20
+
+static int failures = 0;
+
+#define CHECK(cond) do { \
+	if (!(cond)) { \
+		printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+		failures++; \
+	} \
+} while (0)
+
+static const SPIConfig cfgA = { false, NULL, 10 };
+static const SPIConfig cfgB = { false, NULL, 20 };
+
+static bool sameRam(const SimSSD16xx& a, const SimSSD16xx& b)
+{
+	for (uint16_t ya = 0; ya < a.gates(); ya++) {
+		for (uint16_t xa = 0; xa < a.sources() >> 2; xa++) {
+			if (a.ram(xa, ya) != b.ram(xa, ya))
+				return false;
+		}
+	}
+	return true;
+}
+
+/**
+ * @brief	Random scene, drawn the same for each band.
+ */
+struct Scene {
+	unsigned seed;
+	unsigned passes;
+	bool shapes;			///< Shapes are not recorded to display lists.
+
+	void draw(EPD& epd) {
+		char str[8];
+
+		passes++;
+		srand(seed);
+
+		for (int i = rand() % 16; i >= 0; i--) {
+			EPD::Color color = EPD::Color(rand() & 0x03);
+			uint16_t x = rand() % WIDTH;
+			uint16_t y = rand() % HEIGHT;
+			uint16_t w = rand() % (WIDTH - x) + 1;
+			uint16_t h = rand() % (HEIGHT - y) + 1;
+
+			switch (rand() % (shapes ? 7 : 5)) {
+			case 0:
+				epd.setBkgColor(color);
+				break;
+			case 1:
+				y = (y > HEIGHT - 12) ? HEIGHT - 12 : y;
+				snprintf(str, sizeof(str), "%d", rand() % 1000);
+				epd.drawText(color, x, y, str);
+				break;
+			case 5:
+				epd.drawLine(color, x, y, x + w, y + h);
+				break;
+			case 6:
+				epd.drawCircle(color, x, y, w >> 1);
+				break;
+			default:
+				epd.drawFilledRect(color, x, y, w, h);
+				break;
+			}
+		}
+	}
+
+	static void render(EPD* epd, void* arg) {
+		((Scene*)arg)->draw(*epd);
+	}
+};
+
+static void testScenes(EPD::Orientation orientation)
+{
+	static const uint16_t bands[] = { 4, 8, 20, 36, HEIGHT };
+	static uint8_t fb[FrameBuffer::size(WIDTH, HEIGHT)];
+	static uint8_t bp0[FrameBuffer::size(WIDTH, HEIGHT)], bp1[FrameBuffer::size(WIDTH, HEIGHT)];
+	static DisplayList::Item items[32];
+	static char text[128];
+
+	simReset();
+	SimSSD16xx simA(10, 11, 12, 13, HEIGHT, WIDTH), simB(20, 21, 22, 23, HEIGHT, WIDTH);
+	simAttach(SPID1, simA);
+	simAttach(SPID1, simB);
+	SSD1606 ssdA(SPID1, cfgA, 11, 12, 13), ssdB(SPID1, cfgB, 21, 22, 23);
+	EPD epdA(ssdA, WIDTH, HEIGHT, Cambria_Bold_12x12, orientation);
+	EPD epdB(ssdB, WIDTH, HEIGHT, Cambria_Bold_12x12, orientation);
+	DisplayList list(items, 32, text, sizeof(text));
+
+	epdA.start();
+	epdB.start();
+	epdB.setFrameBuffer(fb);
+
+	int bad = 0;
+
+	for (int i = 0; i < SCENES; i++) {
+		Scene scene = { unsigned(rand()), 0, (i & 1) == 0 };
+
+		epdB.fillDisplay(EPD::COLOR_WHITE);
+		scene.draw(epdB);
+		epdB.setBkgColor(EPD::COLOR_WHITE);
+		epdB.flush();
+
+		for (size_t b = 0; b < sizeof(bands) / sizeof(bands[0]); b++) {
+			uint16_t rows = bands[b];
+			uint16_t count = (HEIGHT + rows - 1) / rows;
+
+			for (int buffers = 1; buffers <= 2; buffers++) {
+				epdA.fillDisplay(EPD::COLOR_BLACK);
+				scene.passes = 0;
+				epdA.renderBands(bp0, (buffers == 2) ? bp1 : NULL, rows, Scene::render, &scene);
+				CHECK(epdA.waitUpload(TIME_INFINITE) == MSG_OK);
+				CHECK(scene.passes == count);
+				if (!sameRam(simA, simB))
+					bad++;
+			}
+
+			// the scene recorded once, replayed for each band
+			if (scene.shapes)
+				continue;
+			epdA.fillDisplay(EPD::COLOR_BLACK);
+			epdA.setDisplayList(&list);
+			scene.draw(epdA);
+			epdA.setBkgColor(EPD::COLOR_WHITE);
+			epdA.renderBands(bp0, bp1, rows, list);
+			epdA.setDisplayList(NULL);
+			CHECK(epdA.waitUpload(TIME_INFINITE) == MSG_OK);
+			if (!sameRam(simA, simB))
+				bad++;
+		}
+	}
+
+	CHECK(bad == 0);
+}
+
+/**
+ * @brief	SPI traffic of the bands.
+ */
+static void testTraffic()
+{
+	static uint8_t bp0[FrameBuffer::size(WIDTH, 8)], bp1[FrameBuffer::size(WIDTH, 8)];
+
+	simReset();
+	SimSSD16xx sim(10, 11, 12, 13, HEIGHT, WIDTH);
+	simAttach(SPID1, sim);
+	SSD1606 ssd(SPID1, cfgA, 11, 12, 13);
+	EPD epd(ssd, WIDTH, HEIGHT, Cambria_Bold_12x12);
+	Scene scene = { 1, 0, true };
+
+	epd.start();
+
+	SimSpiStats& stats = simSpi(SPID1).stats;
+	uint32_t bands = HEIGHT / 8;
+
+	// one window and one burst per band
+	stats.reset();
+	epd.renderBands(bp0, 8, Scene::render, &scene);
+	printf("%u bands, 1 buffer: %u calls, %u bytes\n", unsigned(bands),
+			unsigned(stats.calls), unsigned(stats.bytes));
+	CHECK(scene.passes == bands);
+	CHECK(stats.asyncCalls == 0);
+	CHECK(stats.calls <= 84);
+	CHECK(stats.bytes <= 3171);
+
+	// the bands go to the DMA
+	stats.reset();
+	epd.renderBands(bp0, bp1, 8, Scene::render, &scene);
+	CHECK(epd.waitUpload(TIME_INFINITE) == MSG_OK);
+	printf("%u bands, 2 buffers: %u calls, %u bytes\n", unsigned(bands),
+			unsigned(stats.calls), unsigned(stats.bytes));
+	CHECK(stats.asyncCalls == bands);
+	CHECK(stats.calls <= 81);
+	CHECK(stats.bytes <= 3168);
+}
+
+int main()
+{
+	srand(1);
+
+	testScenes(EPD::ORIENTATION_NORMAL);
+	testScenes(EPD::ORIENTATION_MIRROR_X);
+	testScenes(EPD::ORIENTATION_MIRROR_Y);
+	testScenes(EPD::ORIENTATION_ROTATE_180);
+	testTraffic();
+
+	printf("bands: %d failures\n", failures);
+
+	return failures > 0 ? 1 : 0;
+}
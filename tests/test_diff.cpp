@@ -0,0 +1,205 @@
+/*
+ * Copyright (C) 2020 Daniel Igaz
+ *
+ * This file is part of the eINK-click project.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Frame diff uploads against full dirty area uploads on a second panel:
+ * the RAM matches after every flush, unchanged bytes are not sent and
+ * changed columns share a window while it costs less than EPD_WINDOW_COST
+ * per extra window.
+ */
+
+#include "hal_sim.hpp"
+#include "ssd1606.hpp"
+#include "epd.hpp"
+#include "Cambria_Bold_12x12.hpp"
+#include <stdio.h>
+#include <stdlib.h>
+
+#define WIDTH		172
+#define HEIGHT		72
+#define ROUNDS		300
+
+static int failures = 0;
+
+#define CHECK(cond) do { \
+	if (!(cond)) { \
+		printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+		failures++; \
+	} \
+} while (0)
+
+static const SPIConfig cfgA = { false, NULL, 10 };
+static const SPIConfig cfgB = { false, NULL, 20 };
+
+static bool sameRam(const SimSSD16xx& a, const SimSSD16xx& b)
+{
+	for (uint16_t ya = 0; ya < a.gates(); ya++) {
+		for (uint16_t xa = 0; xa < a.sources() >> 2; xa++) {
+			if (a.ram(xa, ya) != b.ram(xa, ya))
+				return false;
+		}
+	}
+	return true;
+}
+
+/**
+ * @brief	Draw the same random item on both displays.
+ */
+static void drawRandom(EPD& a, EPD& b)
+{
+	EPD::Color color = EPD::Color(rand() & 0x03);
+	uint16_t x = rand() % WIDTH;
+	uint16_t y = rand() % HEIGHT;
+	uint16_t w = rand() % (WIDTH - x) + 1;
+	uint16_t h = rand() % (HEIGHT - y) + 1;
+	char str[8];
+
+	switch (rand() % 8) {
+	case 0:
+		a.fillDisplay(color);
+		b.fillDisplay(color);
+		break;
+	case 1:
+		snprintf(str, sizeof(str), "%d", rand() % 1000);
+		a.drawText(color, x, y, str);
+		b.drawText(color, x, y, str);
+		break;
+	case 2:
+		a.drawLine(color, x, y, x + w, y + h);
+		b.drawLine(color, x, y, x + w, y + h);
+		break;
+	case 3:
+		// redraw what is there already
+		a.drawFilledRect(EPD::COLOR_WHITE, x, y, w, h);
+		a.drawFilledRect(color, x, y, w, h);
+		b.drawFilledRect(EPD::COLOR_WHITE, x, y, w, h);
+		b.drawFilledRect(color, x, y, w, h);
+		break;
+	default:
+		a.drawFilledRect(color, x, y, w, h);
+		b.drawFilledRect(color, x, y, w, h);
+		break;
+	}
+}
+
+int main()
+{
+	static uint8_t fbA[FrameBuffer::size(WIDTH, HEIGHT)], prev[FrameBuffer::size(WIDTH, HEIGHT)];
+	static uint8_t fbB[FrameBuffer::size(WIDTH, HEIGHT)];
+
+	simReset();
+	SimSSD16xx simA(10, 11, 12, 13, HEIGHT, WIDTH), simB(20, 21, 22, 23, HEIGHT, WIDTH);
+	simAttach(SPID1, simA);
+	simAttach(SPID1, simB);
+	SSD1606 ssdA(SPID1, cfgA, 11, 12, 13), ssdB(SPID1, cfgB, 21, 22, 23);
+	EPD epdA(ssdA, WIDTH, HEIGHT, Cambria_Bold_12x12), epdB(ssdB, WIDTH, HEIGHT, Cambria_Bold_12x12);
+	epdA.start();
+	epdB.start();
+	epdA.setFrameBuffer(fbA);
+	epdA.setPrevFrameBuffer(prev);
+	epdB.setFrameBuffer(fbB);
+
+	// the first flush has nothing to compare with
+	epdA.flush();
+	epdB.flush();
+	CHECK(sameRam(simA, simB));
+	CHECK(epdA.flushStats().sentBytes == FrameBuffer::size(WIDTH, HEIGHT));
+
+	// random drawing, flushed every few items
+	int bad = 0;
+	for (int i = 0; i < ROUNDS; i++) {
+		for (int n = rand() % 6; n >= 0; n--)
+			drawRandom(epdA, epdB);
+		epdA.flush();
+		epdB.flush();
+		if (!sameRam(simA, simB))
+			bad++;
+	}
+	CHECK(bad == 0);
+	CHECK(epdA.flushStats().sentBytes < epdB.flushStats().sentBytes);
+
+	SimSpiStats& stats = simSpi(SPID1).stats;
+	const EPD::FlushStats& fs = epdA.flushStats();
+
+	epdA.fillDisplay(EPD::COLOR_WHITE);
+	epdA.flush();
+
+	// an unchanged frame sends nothing
+	epdA.resetFlushStats();
+	stats.reset();
+	epdA.drawFilledRect(EPD::COLOR_WHITE, 0, 0, WIDTH, HEIGHT);
+	epdA.drawText(EPD::COLOR_BLACK, 20, 20, "42");
+	epdA.drawText(EPD::COLOR_WHITE, 20, 20, "42");
+	epdA.flush();
+	CHECK(fs.windows == 0);
+	CHECK(fs.sentBytes == 0);
+	CHECK(fs.lastSaved == FrameBuffer::size(WIDTH, HEIGHT));
+	CHECK(stats.calls == 0);
+
+	// close changed columns share a window
+	uint16_t gap = EPD_WINDOW_COST + 1;
+	epdA.resetFlushStats();
+	stats.reset();
+	epdA.drawFilledRect(EPD::COLOR_WHITE, 0, 0, WIDTH, 4);
+	epdA.drawFilledRect(EPD::COLOR_BLACK, 10, 0, 1, 4);
+	epdA.drawFilledRect(EPD::COLOR_BLACK, 10 + gap, 0, 1, 4);
+	epdA.flush();
+	CHECK(fs.windows == 1);
+	CHECK(fs.sentBytes == gap + 1u);
+	printf("diff 2 bytes %u columns apart: %u calls, %u bytes\n",
+			unsigned(gap), unsigned(stats.calls), unsigned(stats.bytes));
+	CHECK(stats.calls <= 12);
+	CHECK(stats.bytes <= 29);
+
+	// farther ones do not
+	epdA.resetFlushStats();
+	stats.reset();
+	epdA.drawFilledRect(EPD::COLOR_WHITE, 0, 8, WIDTH, 4);
+	epdA.drawFilledRect(EPD::COLOR_DARG_GRAY, 10, 8, 1, 4);
+	epdA.drawFilledRect(EPD::COLOR_DARG_GRAY, 10 + gap + 1, 8, 1, 4);
+	epdA.flush();
+	CHECK(fs.windows == 2);
+	CHECK(fs.sentBytes == 2);
+	printf("diff 2 bytes %u columns apart: %u calls, %u bytes\n",
+			unsigned(gap + 1), unsigned(stats.calls), unsigned(stats.bytes));
+	CHECK(stats.calls <= 21);
+	CHECK(stats.bytes <= 21);
+
+	// a column sends its changed span only
+	epdA.resetFlushStats();
+	epdA.drawFilledRect(EPD::COLOR_LIGHT_GRAY, 50, 20, 1, 8);
+	epdA.drawFilledRect(EPD::COLOR_LIGHT_GRAY, 50, 40, 1, 4);
+	epdA.flush();
+	CHECK(fs.windows == 1);
+	CHECK(fs.sentBytes == 6);
+
+	epdB.fillDisplay(EPD::COLOR_WHITE);
+	epdB.drawFilledRect(EPD::COLOR_BLACK, 10, 0, 1, 4);
+	epdB.drawFilledRect(EPD::COLOR_BLACK, 10 + gap, 0, 1, 4);
+	epdB.drawFilledRect(EPD::COLOR_DARG_GRAY, 10, 8, 1, 4);
+	epdB.drawFilledRect(EPD::COLOR_DARG_GRAY, 10 + gap + 1, 8, 1, 4);
+	epdB.drawFilledRect(EPD::COLOR_LIGHT_GRAY, 50, 20, 1, 8);
+	epdB.drawFilledRect(EPD::COLOR_LIGHT_GRAY, 50, 40, 1, 4);
+	epdB.flush();
+	CHECK(sameRam(simA, simB));
+
+	printf("diff: %d failures\n", failures);
+
+	return failures > 0 ? 1 : 0;
+}
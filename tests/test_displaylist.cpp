@@ -0,0 +1,228 @@
+/*
+ * Copyright (C) 2020 Daniel Igaz
+ *
+ * This file is part of the eINK-click project.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Drawing recorded to a display list against the same drawing done right
+ * away on a second panel: the RAM matches after every commit, directly
+ * and through the shadow frame buffer, covered calls are dropped,
+ * adjacent rectangles merged, and calls sharing a RAM x window are
+ * replayed together.
+ */
+
+#include "hal_sim.hpp"
+#include "ssd1606.hpp"
+#include "epd.hpp"
+#include "displaylist.hpp"
+#include "Cambria_Bold_12x12.hpp"
+#include <stdio.h>
+#include <stdlib.h>
+
+#define WIDTH		172
+#define HEIGHT		72
+#define ROUNDS		200
+
+static int failures = 0;
+
+#define CHECK(cond) do { \
+	if (!(cond)) { \
+		printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+		failures++; \
+	} \
+} while (0)
+
+static const SPIConfig cfgA = { false, NULL, 10 };
+static const SPIConfig cfgB = { false, NULL, 20 };
+
+static bool sameRam(const SimSSD16xx& a, const SimSSD16xx& b)
+{
+	for (uint16_t ya = 0; ya < a.gates(); ya++) {
+		for (uint16_t xa = 0; xa < a.sources() >> 2; xa++) {
+			if (a.ram(xa, ya) != b.ram(xa, ya))
+				return false;
+		}
+	}
+	return true;
+}
+
+/**
+ * @brief	Draw the same random item on both displays.
+ */
+static void drawRandom(EPD& a, EPD& b)
+{
+	EPD::Color color = EPD::Color(rand() & 0x03);
+	uint16_t x = rand() % WIDTH;
+	uint16_t y = rand() % HEIGHT;
+	uint16_t w = rand() % (WIDTH - x) + 1;
+	uint16_t h = rand() % (HEIGHT - y) + 1;
+	char str[8];
+
+	switch (rand() % 10) {
+	case 0:
+		a.fillDisplay(color);
+		b.fillDisplay(color);
+		break;
+	case 1:
+		a.setBkgColor(color);
+		b.setBkgColor(color);
+		break;
+	case 2:
+	case 3:
+	case 4:
+		y = (y > HEIGHT - 12) ? HEIGHT - 12 : y;
+		snprintf(str, sizeof(str), "%d", rand() % 1000);
+		a.drawText(color, x, y, str);
+		b.drawText(color, x, y, str);
+		break;
+	case 5:
+		// neighbours of the same color
+		a.drawFilledRect(color, x, y, w, h);
+		b.drawFilledRect(color, x, y, w, h);
+		if (x + w < WIDTH) {
+			a.drawFilledRect(color, x + w, y, (WIDTH - x - w + 1) / 2, h);
+			b.drawFilledRect(color, x + w, y, (WIDTH - x - w + 1) / 2, h);
+		}
+		break;
+	default:
+		a.drawFilledRect(color, x, y, w, h);
+		b.drawFilledRect(color, x, y, w, h);
+		break;
+	}
+}
+
+static void testRandom(EPD::Orientation orientation, bool buffered)
+{
+	static DisplayList::Item items[16];
+	static char text[64];
+	static uint8_t fbA[FrameBuffer::size(WIDTH, HEIGHT)], fbB[FrameBuffer::size(WIDTH, HEIGHT)];
+
+	simReset();
+	SimSSD16xx simA(10, 11, 12, 13, HEIGHT, WIDTH), simB(20, 21, 22, 23, HEIGHT, WIDTH);
+	simAttach(SPID1, simA);
+	simAttach(SPID1, simB);
+	SSD1606 ssdA(SPID1, cfgA, 11, 12, 13), ssdB(SPID1, cfgB, 21, 22, 23);
+	EPD epdA(ssdA, WIDTH, HEIGHT, Cambria_Bold_12x12, orientation);
+	EPD epdB(ssdB, WIDTH, HEIGHT, Cambria_Bold_12x12, orientation);
+	DisplayList list(items, 16, text, sizeof(text));
+
+	epdA.start();
+	epdB.start();
+	if (buffered) {
+		epdA.setFrameBuffer(fbA);
+		epdB.setFrameBuffer(fbB);
+	}
+	epdA.setDisplayList(&list);
+
+	int bad = 0;
+
+	for (int i = 0; i < ROUNDS; i++) {
+		for (int n = rand() % 12; n >= 0; n--)
+			drawRandom(epdA, epdB);
+
+		if (buffered) {
+			epdA.flush();
+			epdB.flush();
+		}
+		else {
+			epdA.commitDisplayList();
+		}
+		if (!sameRam(simA, simB))
+			bad++;
+	}
+
+	CHECK(bad == 0);
+	CHECK(list.stats().culled > 0);
+	CHECK(list.stats().merged > 0);
+	CHECK(list.stats().replayed + list.stats().culled + list.stats().merged == list.stats().recorded);
+}
+
+/**
+ * @brief	Culling, merging and the SPI traffic of a sorted replay.
+ */
+static void testTraffic()
+{
+	static DisplayList::Item items[16];
+	static char text[64];
+
+	simReset();
+	SimSSD16xx simA(10, 11, 12, 13, HEIGHT, WIDTH), simB(20, 21, 22, 23, HEIGHT, WIDTH);
+	simAttach(SPID1, simA);
+	simAttach(SPID1, simB);
+	SSD1606 ssdA(SPID1, cfgA, 11, 12, 13), ssdB(SPID1, cfgB, 21, 22, 23);
+	EPD epdA(ssdA, WIDTH, HEIGHT, Cambria_Bold_12x12), epdB(ssdB, WIDTH, HEIGHT, Cambria_Bold_12x12);
+	DisplayList list(items, 16, text, sizeof(text));
+
+	epdA.start();
+	epdB.start();
+	epdA.setDisplayList(&list);
+
+	// a covered rectangle is dropped
+	epdA.drawFilledRect(EPD::COLOR_BLACK, 0, 0, 40, 40);
+	epdA.drawFilledRect(EPD::COLOR_DARG_GRAY, 0, 0, 40, 40);
+	epdA.commitDisplayList();
+	CHECK(list.stats().culled == 1);
+	CHECK(list.stats().replayed == 1);
+
+	// neighbours of the same color are merged
+	epdA.drawFilledRect(EPD::COLOR_BLACK, 50, 0, 20, 8);
+	epdA.drawFilledRect(EPD::COLOR_BLACK, 70, 0, 20, 8);
+	epdA.commitDisplayList();
+	CHECK(list.stats().merged == 1);
+	CHECK(list.stats().replayed == 2);
+
+	epdB.drawFilledRect(EPD::COLOR_DARG_GRAY, 0, 0, 40, 40);
+	epdB.drawFilledRect(EPD::COLOR_BLACK, 50, 0, 40, 8);
+	CHECK(sameRam(simA, simB));
+
+	// rows taking turns, replayed grouped by RAM x window
+	SimSpiStats& stats = simSpi(SPID1).stats;
+
+	stats.reset();
+	for (uint16_t i = 0; i < 6; i++)
+		epdA.drawFilledRect(EPD::Color(i % 3), 20 + i * 12, (i & 1) ? 44 : 4, 12, 16);
+	CHECK(stats.calls == 0);
+	epdA.commitDisplayList();
+	uint32_t listCalls = stats.calls;
+	uint32_t listBytes = stats.bytes;
+
+	stats.reset();
+	for (uint16_t i = 0; i < 6; i++)
+		epdB.drawFilledRect(EPD::Color(i % 3), 20 + i * 12, (i & 1) ? 44 : 4, 12, 16);
+	printf("6 rectangles: list %u calls, %u bytes, direct %u calls, %u bytes\n",
+			unsigned(listCalls), unsigned(listBytes), unsigned(stats.calls), unsigned(stats.bytes));
+	CHECK(listCalls < stats.calls);
+	CHECK(listBytes < stats.bytes);
+	CHECK(listCalls <= 60);
+	CHECK(listBytes <= 342);
+	CHECK(sameRam(simA, simB));
+}
+
+int main()
+{
+	srand(1);
+
+	testRandom(EPD::ORIENTATION_NORMAL, false);
+	testRandom(EPD::ORIENTATION_ROTATE_180, false);
+	testRandom(EPD::ORIENTATION_MIRROR_Y, false);
+	testRandom(EPD::ORIENTATION_NORMAL, true);
+	testTraffic();
+
+	printf("displaylist: %d failures\n", failures);
+
+	return failures > 0 ? 1 : 0;
+}
@@ -0,0 +1,178 @@
+/*
+ * Copyright (C) 2020 Daniel Igaz
+ *
+ * This file is part of the eINK-click project.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Shadow frame buffer flushes against direct drawing on a second panel:
+ * the RAM matches after every flush, and only the dirty areas go over
+ * the bus, merged while one window is cheaper than two.
+ */
+
+#include "hal_sim.hpp"
+#include "ssd1606.hpp"
+#include "epd.hpp"
+#include "Cambria_Bold_12x12.hpp"
+#include <stdio.h>
+#include <stdlib.h>
+
+#define WIDTH		172
+#define HEIGHT		72
+#define ROUNDS		300
+
+static int failures = 0;
+
+#define CHECK(cond) do { \
+	if (!(cond)) { \
+		printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+		failures++; \
+	} \
+} while (0)
+
+static const SPIConfig cfgA = { false, NULL, 10 };
+static const SPIConfig cfgB = { false, NULL, 20 };
+
+static bool sameRam(const SimSSD16xx& a, const SimSSD16xx& b)
+{
+	for (uint16_t ya = 0; ya < a.gates(); ya++) {
+		for (uint16_t xa = 0; xa < a.sources() >> 2; xa++) {
+			if (a.ram(xa, ya) != b.ram(xa, ya))
+				return false;
+		}
+	}
+	return true;
+}
+
+static void drawRect(EPD& a, EPD& b, EPD::Color color, uint16_t x, uint16_t y,
+		uint16_t width, uint16_t height)
+{
+	a.drawFilledRect(color, x, y, width, height);
+	b.drawFilledRect(color, x, y, width, height);
+}
+
+/**
+ * @brief	Draw the same random item on both displays.
+ * @details	Direct drawing pads partial RAM bytes with the background,
+ * 			the items cover whole RAM bytes to compare the pixels.
+ */
+static void drawRandom(EPD& a, EPD& b)
+{
+	EPD::Color color = EPD::Color(rand() & 0x03);
+	uint16_t x = rand() % WIDTH;
+	uint16_t y = (rand() % HEIGHT) & ~0x03;
+	uint16_t w = rand() % (WIDTH - x) + 1;
+	uint16_t h = (rand() % (HEIGHT - y) + 4) & ~0x03;
+	char str[8];
+
+	switch (rand() % 8) {
+	case 0:
+		a.fillDisplay(color);
+		b.fillDisplay(color);
+		break;
+	case 1:
+	case 2:
+		// the text must fit in direct mode
+		y = (y > HEIGHT - 12) ? HEIGHT - 12 : y;
+		snprintf(str, sizeof(str), "%d", rand() % 1000);
+		a.drawText(color, x, y, str);
+		b.drawText(color, x, y, str);
+		break;
+	default:
+		a.drawFilledRect(color, x, y, w, h);
+		b.drawFilledRect(color, x, y, w, h);
+		break;
+	}
+}
+
+int main()
+{
+	static uint8_t fb[FrameBuffer::size(WIDTH, HEIGHT)];
+
+	simReset();
+	SimSSD16xx simA(10, 11, 12, 13, HEIGHT, WIDTH), simB(20, 21, 22, 23, HEIGHT, WIDTH);
+	simAttach(SPID1, simA);
+	simAttach(SPID1, simB);
+	SSD1606 ssdA(SPID1, cfgA, 11, 12, 13), ssdB(SPID1, cfgB, 21, 22, 23);
+	EPD epdA(ssdA, WIDTH, HEIGHT, Cambria_Bold_12x12), epdB(ssdB, WIDTH, HEIGHT, Cambria_Bold_12x12);
+	epdA.start();
+	epdB.start();
+
+	// the buffer starts as the background color, all of it dirty
+	epdA.setFrameBuffer(fb);
+	epdB.fillDisplay(EPD::COLOR_WHITE);
+	epdA.flush();
+	CHECK(sameRam(simA, simB));
+
+	// random drawing, flushed every few items
+	int bad = 0;
+	for (int i = 0; i < ROUNDS; i++) {
+		for (int n = rand() % 6; n >= 0; n--)
+			drawRandom(epdA, epdB);
+		epdA.flush();
+		if (!sameRam(simA, simB))
+			bad++;
+	}
+	CHECK(bad == 0);
+
+	SimSpiStats& stats = simSpi(SPID1).stats;
+	const EPD::FlushStats& fs = epdA.flushStats();
+
+	// nothing dirty, nothing sent
+	stats.reset();
+	epdA.flush();
+	CHECK(stats.calls == 0);
+
+	// one rectangle, one window of whole RAM bytes
+	epdA.resetFlushStats();
+	drawRect(epdA, epdB, EPD::COLOR_BLACK, 30, 12, 20, 12);
+	stats.reset();
+	epdA.flush();
+	CHECK(fs.windows == 1);
+	CHECK(fs.sentBytes == 20 * 3);
+	CHECK(stats.calls <= 12);
+	CHECK(stats.bytes <= 71);
+
+	// overlapping rectangles merge
+	epdA.resetFlushStats();
+	drawRect(epdA, epdB, EPD::COLOR_BLACK, 30, 12, 20, 8);
+	drawRect(epdA, epdB, EPD::COLOR_DARG_GRAY, 40, 12, 20, 8);
+	epdA.flush();
+	CHECK(fs.windows == 1);
+	CHECK(fs.sentBytes == 30 * 2);
+
+	// far apart rectangles do not
+	epdA.resetFlushStats();
+	drawRect(epdA, epdB, EPD::COLOR_BLACK, 0, 0, 8, 8);
+	drawRect(epdA, epdB, EPD::COLOR_BLACK, 160, 64, 8, 8);
+	epdA.flush();
+	CHECK(fs.windows == 2);
+	CHECK(fs.sentBytes == 2 * 8 * 2);
+
+	// more areas than slots grow the cheapest ones
+	epdA.resetFlushStats();
+	for (uint16_t i = 0; i < 2 * EPD_DIRTY_RECTS; i++)
+		drawRect(epdA, epdB, EPD::COLOR_LIGHT_GRAY, i * 10, (i & 1) * 60, 4, 4);
+	epdA.flush();
+	CHECK(fs.windows <= EPD_DIRTY_RECTS);
+	CHECK(fs.sentBytes < FrameBuffer::size(WIDTH, HEIGHT));
+
+	CHECK(sameRam(simA, simB));
+
+	printf("flush: %d failures\n", failures);
+
+	return failures > 0 ? 1 : 0;
+}
@@ -0,0 +1,208 @@
+/*
+ * Copyright (C) 2020 Daniel Igaz
+ *
+ * This file is part of the eINK-click project.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Texts drawn directly with the glyph cache against texts drawn without
+ * it and against the shadow frame buffer: the RAM matches for all colors,
+ * vertical phases and orientations, glyphs found in the cache take no
+ * more transfers than packing them again, and the least recently used
+ * glyph is replaced.
+ */
+
+#include "hal_sim.hpp"
+#include "ssd1606.hpp"
+#include "epd.hpp"
+#include "glyphcache.hpp"
+#include "Cambria_Bold_12x12.hpp"
+#include <stdio.h>
+#include <stdlib.h>
+
+#define WIDTH		172
+#define HEIGHT		72
+#define TEXTS		300
+
+static int failures = 0;
+
+#define CHECK(cond) do { \
+	if (!(cond)) { \
+		printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+		failures++; \
+	} \
+} while (0)
+
+static const SPIConfig cfgA = { false, NULL, 10 };
+static const SPIConfig cfgB = { false, NULL, 20 };
+static const SPIConfig cfgC = { false, NULL, 30 };
+
+static bool sameRam(const SimSSD16xx& a, const SimSSD16xx& b)
+{
+	for (uint16_t ya = 0; ya < a.gates(); ya++) {
+		for (uint16_t xa = 0; xa < a.sources() >> 2; xa++) {
+			if (a.ram(xa, ya) != b.ram(xa, ya))
+				return false;
+		}
+	}
+	return true;
+}
+
+static void testTexts(EPD::Orientation orientation)
+{
+	static uint8_t arena[4096];
+	static uint8_t fb[FrameBuffer::size(WIDTH, HEIGHT)];
+
+	simReset();
+	SimSSD16xx simA(10, 11, 12, 13, HEIGHT, WIDTH);
+	SimSSD16xx simB(20, 21, 22, 23, HEIGHT, WIDTH);
+	SimSSD16xx simC(30, 31, 32, 33, HEIGHT, WIDTH);
+	simAttach(SPID1, simA);
+	simAttach(SPID1, simB);
+	simAttach(SPID1, simC);
+	SSD1606 ssdA(SPID1, cfgA, 11, 12, 13), ssdB(SPID1, cfgB, 21, 22, 23), ssdC(SPID1, cfgC, 31, 32, 33);
+	EPD epdA(ssdA, WIDTH, HEIGHT, Cambria_Bold_12x12, orientation);
+	EPD epdB(ssdB, WIDTH, HEIGHT, Cambria_Bold_12x12, orientation);
+	EPD epdC(ssdC, WIDTH, HEIGHT, Cambria_Bold_12x12, orientation);
+	GlyphCache cache(arena, sizeof(arena));
+
+	epdA.start();
+	epdB.start();
+	epdC.start();
+	epdA.setGlyphCache(&cache);
+	epdC.setFrameBuffer(fb);
+	epdA.fillDisplay(EPD::COLOR_WHITE);
+	epdB.fillDisplay(EPD::COLOR_WHITE);
+
+	int bad = 0;
+	int badBuffered = 0;
+
+	for (int i = 0; i < TEXTS; i++) {
+		EPD::Color color = EPD::Color(rand() & 0x03);
+		EPD::Color bkgColor = EPD::Color(rand() & 0x03);
+		uint16_t x = rand() % (WIDTH - 20);
+		// y multiple of 4 every other text, buffered drawing keeps the
+		// pixels around the text
+		uint16_t y = rand() % (HEIGHT - 12);
+		char str[8];
+
+		if (i & 1)
+			y &= ~0x03;
+		snprintf(str, sizeof(str), "%c%c%d", 'A' + rand() % 8, 'a' + rand() % 8, rand() % 100);
+
+		epdA.setBkgColor(bkgColor);
+		epdB.setBkgColor(bkgColor);
+		epdC.setBkgColor(bkgColor);
+		epdA.drawText(color, x, y, str);
+		epdB.drawText(color, x, y, str);
+		epdC.drawText(color, x, y, str);
+
+		if (!sameRam(simA, simB))
+			bad++;
+
+		if (i & 1) {
+			epdC.flush();
+			if (!sameRam(simA, simC))
+				badBuffered++;
+		}
+		else {
+			// start over from the same RAM
+			epdA.fillDisplay(bkgColor);
+			epdB.fillDisplay(bkgColor);
+			epdC.fillDisplay(bkgColor);
+		}
+	}
+
+	CHECK(bad == 0);
+	CHECK(badBuffered == 0);
+	CHECK(cache.stats().hits > 0);
+	CHECK(cache.stats().misses > 0);
+}
+
+/**
+ * @brief	Hits, misses and evictions, and the SPI traffic of hits.
+ */
+static void testTraffic()
+{
+	static uint8_t arena[2048];
+	static uint8_t small[2 * (GLYPH_CACHE_SLOT_SIZE + 32)];
+
+	simReset();
+	SimSSD16xx simA(10, 11, 12, 13, HEIGHT, WIDTH), simB(20, 21, 22, 23, HEIGHT, WIDTH);
+	simAttach(SPID1, simA);
+	simAttach(SPID1, simB);
+	SSD1606 ssdA(SPID1, cfgA, 11, 12, 13), ssdB(SPID1, cfgB, 21, 22, 23);
+	EPD epdA(ssdA, WIDTH, HEIGHT, Cambria_Bold_12x12), epdB(ssdB, WIDTH, HEIGHT, Cambria_Bold_12x12);
+	GlyphCache cache(arena, sizeof(arena));
+
+	epdA.start();
+	epdB.start();
+	epdA.setGlyphCache(&cache);
+
+	SimSpiStats& stats = simSpi(SPID1).stats;
+	const char* str = "0123456789:0123456789";
+
+	// the first text fills the cache
+	epdA.drawText(EPD::COLOR_BLACK, 0, 8, str);
+	CHECK(cache.stats().misses == 11);
+	CHECK(cache.stats().hits == 10);
+
+	// the same glyphs at another vertical phase miss
+	epdA.drawText(EPD::COLOR_BLACK, 0, 30, "0");
+	CHECK(cache.stats().misses == 12);
+
+	stats.reset();
+	epdA.drawText(EPD::COLOR_BLACK, 0, 40, str);
+	uint32_t hitCalls = stats.calls;
+	uint32_t hitBytes = stats.bytes;
+	CHECK(cache.stats().hits == 31);
+
+	stats.reset();
+	epdB.drawText(EPD::COLOR_BLACK, 0, 40, str);
+	printf("drawText 21 chars: cached %u calls, %u bytes, uncached %u calls, %u bytes\n",
+			unsigned(hitCalls), unsigned(hitBytes), unsigned(stats.calls), unsigned(stats.bytes));
+	CHECK(hitCalls <= stats.calls);
+	CHECK(hitBytes == stats.bytes);
+	CHECK(hitCalls <= 18);
+
+	// two slots, the least recently used glyph goes
+	GlyphCache two(small, sizeof(small));
+	CHECK(two.slots() == 2);
+	epdA.setGlyphCache(&two);
+	epdA.drawText(EPD::COLOR_BLACK, 0, 0, "ab");
+	epdA.drawText(EPD::COLOR_BLACK, 0, 0, "a");
+	epdA.drawText(EPD::COLOR_BLACK, 0, 0, "c");
+	CHECK(two.stats().evictions == 1);
+	epdA.drawText(EPD::COLOR_BLACK, 0, 0, "a");
+	CHECK(two.stats().hits == 2);
+	epdA.drawText(EPD::COLOR_BLACK, 0, 0, "b");
+	CHECK(two.stats().misses == 4);
+}
+
+int main()
+{
+	srand(1);
+
+	testTexts(EPD::ORIENTATION_NORMAL);
+	testTexts(EPD::ORIENTATION_MIRROR_X);
+	testTexts(EPD::ORIENTATION_MIRROR_Y);
+	testTexts(EPD::ORIENTATION_ROTATE_180);
+	testTraffic();
+
+	printf("glyphcache: %d failures\n", failures);
+
+	return failures > 0 ? 1 : 0;
+}
@@ -0,0 +1,149 @@
+/*
+ * Copyright (C) 2020 Daniel Igaz
+ *
+ * This file is part of the eINK-click project.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Panel selection of PanelManager on simulated time: idle panels are
+ * served first in index order, then the busy one expected to end first,
+ * and an upload pending on the shared bus ends before the next panel is
+ * drawn.
+ */
+
+#include "hal_sim.hpp"
+#include "ssd1606.hpp"
+#include "panelmanager.hpp"
+#include "Cambria_Bold_12x12.hpp"
+#include <stdio.h>
+
+#define PANELS		3
+#define WIDTH		172
+#define HEIGHT		72
+
+static int failures = 0;
+
+#define CHECK(cond) do { \
+	if (!(cond)) { \
+		printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+		failures++; \
+	} \
+} while (0)
+
+static size_t order[PANELS];
+static size_t drawn = 0;
+
+static void draw(EPD* epd, size_t index, void*)
+{
+	order[drawn++] = index;
+	epd->fillDisplay(EPD::COLOR_WHITE);
+	epd->drawText(EPD::COLOR_BLACK, 10, 20, "panel");
+}
+
+static uint8_t image[FrameBuffer::size(WIDTH, HEIGHT)];
+
+static void upload(EPD* epd, size_t index, void*)
+{
+	order[drawn++] = index;
+	epd->startUpload(0, 0, WIDTH, HEIGHT, image);
+}
+
+static bool inOrder(size_t a, size_t b, size_t c)
+{
+	return drawn == PANELS && order[0] == a && order[1] == b && order[2] == c;
+}
+
+int main()
+{
+	static const SPIConfig cfg[PANELS] = {
+		{ false, NULL, 10 }, { false, NULL, 20 }, { false, NULL, 30 },
+	};
+	static const uint32_t refresh[PANELS] = { 1500, 300, 800 };
+
+	simReset();
+	simSetTiming(SPID1, 4000000, 2000);
+
+	SimSSD16xx sim0(10, 11, 12, 13, HEIGHT, WIDTH);
+	SimSSD16xx sim1(20, 21, 22, 23, HEIGHT, WIDTH);
+	SimSSD16xx sim2(30, 31, 32, 33, HEIGHT, WIDTH);
+	SimSSD16xx* sims[PANELS] = { &sim0, &sim1, &sim2 };
+	SSD1606 ssd0(SPID1, cfg[0], 11, 12, 13);
+	SSD1606 ssd1(SPID1, cfg[1], 21, 22, 23);
+	SSD1606 ssd2(SPID1, cfg[2], 31, 32, 33);
+	EPD epd0(ssd0, WIDTH, HEIGHT, Cambria_Bold_12x12);
+	EPD epd1(ssd1, WIDTH, HEIGHT, Cambria_Bold_12x12);
+	EPD epd2(ssd2, WIDTH, HEIGHT, Cambria_Bold_12x12);
+	EPD* panels[PANELS] = { &epd0, &epd1, &epd2 };
+
+	for (size_t i = 0; i < PANELS; i++) {
+		sims[i]->setRefreshTime(refresh[i]);
+		simAttach(SPID1, *sims[i]);
+		panels[i]->start();
+	}
+
+	PanelManager pm(panels, PANELS);
+
+	// all idle, index order, the later panels overlap the first refresh
+	drawn = 0;
+	pm.refresh(draw, NULL);
+	CHECK(inOrder(0, 1, 2));
+	CHECK(pm.stats().overlapped == 2);
+	CHECK(pm.stats().stalls == 0);
+
+	// all busy without an estimate, the earliest start goes first and the
+	// panels ending meanwhile are idle then
+	drawn = 0;
+	pm.refresh(draw, NULL);
+	CHECK(inOrder(0, 1, 2));
+	CHECK(pm.stats().stalls == 1);
+	CHECK(pm.stats().overlapped == 4);
+
+	// all busy with an estimate, the shortest refresh goes first
+	drawn = 0;
+	pm.refresh(draw, NULL);
+	CHECK(inOrder(1, 2, 0));
+	CHECK(pm.stats().stalls == 4);
+
+	// idle panels go before a busy one
+	CHECK(pm.waitAll(TIME_INFINITE) == MSG_OK);
+	CHECK(epd1.startUpdateDisplay() == MSG_OK);
+	drawn = 0;
+	pm.refresh(draw, NULL);
+	CHECK(inOrder(0, 2, 1));
+	CHECK(pm.stats().stalls == 5);
+
+	// uploads are finished before the next panel takes the bus
+	CHECK(pm.waitAll(TIME_INFINITE) == MSG_OK);
+	for (size_t i = 0; i < sizeof(image); i++)
+		image[i] = i * 7;
+	drawn = 0;
+	pm.refresh(upload, NULL);
+	CHECK(inOrder(0, 1, 2));
+	CHECK(pm.waitAll(TIME_INFINITE) == MSG_OK);
+
+	for (size_t i = 0; i < PANELS; i++) {
+		CHECK(sims[i]->updates() == 5 + (i == 1));
+		CHECK(sims[i]->ram(0, WIDTH - 1) == image[0]);
+		CHECK(sims[i]->ram(HEIGHT / 4 - 1, 0) == image[sizeof(image) - 1]);
+	}
+
+	CHECK(pm.stats().rounds == 5);
+	CHECK(pm.stats().updates == 5 * PANELS);
+
+	printf("panels: %d failures\n", failures);
+
+	return failures > 0 ? 1 : 0;
+}
@@ -0,0 +1,161 @@
+/*
+ * Copyright (C) 2020 Daniel Igaz
+ *
+ * This file is part of the eINK-click project.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Double buffered presenting against single buffered flushes followed
+ * by blocking updates: every update shows the frame presented for it,
+ * handing a frame over sends nothing, and the pipelined frames take
+ * less time than the sequential ones.
+ */
+
+#include "hal_sim.hpp"
+#include "ssd1606.hpp"
+#include "epd.hpp"
+#include "Cambria_Bold_12x12.hpp"
+#include <stdio.h>
+#include <vector>
+
+#define WIDTH		172
+#define HEIGHT		72
+#define FRAMES		20
+#define REFRESH		300
+#define DRAW_MS		120
+
+static int failures = 0;
+
+#define CHECK(cond) do { \
+	if (!(cond)) { \
+		printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+		failures++; \
+	} \
+} while (0)
+
+static const SPIConfig cfgA = { false, NULL, 10 };
+static const SPIConfig cfgB = { false, NULL, 20 };
+
+/**
+ * @brief	RAM contents of a panel at its last update.
+ */
+static std::vector<uint8_t> image(const SimSSD16xx& panel)
+{
+	std::vector<uint8_t> v;
+
+	for (uint16_t ya = 0; ya < panel.gates(); ya++) {
+		for (uint16_t xa = 0; xa < panel.sources() >> 2; xa++)
+			v.push_back(panel.image(xa, ya));
+	}
+	return v;
+}
+
+/**
+ * @brief	Draw frame @p n over frame @p n - 1, the application takes
+ * 			DRAW_MS to render it.
+ */
+static void drawFrame(EPD& epd, int n)
+{
+	char str[16];
+
+	simAdvanceNs(uint64_t(DRAW_MS) * 1000000);
+
+	snprintf(str, sizeof(str), "frame %d", n);
+	epd.drawFilledRect(EPD::COLOR_WHITE, 0, 0, WIDTH, 16);
+	epd.drawText(EPD::COLOR_BLACK, 4, 2, str);
+	epd.drawFilledRect(EPD::Color(n & 0x03), (n * 8) % (WIDTH - 12), 40, 12, 12);
+}
+
+int main()
+{
+	static uint8_t fb0[FrameBuffer::size(WIDTH, HEIGHT)], fb1[FrameBuffer::size(WIDTH, HEIGHT)];
+	static uint8_t fb[FrameBuffer::size(WIDTH, HEIGHT)];
+	static std::vector<uint8_t> frames[FRAMES];
+
+	simReset();
+	simSetTiming(SPID1, 4000000, 2000);
+	SimSSD16xx simA(10, 11, 12, 13, HEIGHT, WIDTH), simB(20, 21, 22, 23, HEIGHT, WIDTH);
+	simA.setRefreshTime(REFRESH);
+	simB.setRefreshTime(REFRESH);
+	simAttach(SPID1, simA);
+	simAttach(SPID1, simB);
+	SSD1606 ssdA(SPID1, cfgA, 11, 12, 13), ssdB(SPID1, cfgB, 21, 22, 23);
+	EPD epdA(ssdA, WIDTH, HEIGHT, Cambria_Bold_12x12), epdB(ssdB, WIDTH, HEIGHT, Cambria_Bold_12x12);
+	epdA.start();
+	epdB.start();
+
+	// sequential: draw, flush and wait for the update
+	epdB.setFrameBuffer(fb);
+	uint64_t start = simTimeNs();
+	for (int n = 0; n < FRAMES; n++) {
+		drawFrame(epdB, n);
+		epdB.flush();
+		CHECK(epdB.updateDisplay() == MSG_OK);
+		frames[n] = image(simB);
+	}
+	uint64_t sequential = simTimeNs() - start;
+
+	// pipelined: drawing goes on while the display refreshes
+	SimSpiStats& stats = simSpi(SPID1).stats;
+	uint32_t handedOver = 0;
+	int bad = 0;
+
+	epdA.setFrameBuffers(fb0, fb1);
+	start = simTimeNs();
+	for (int n = 0; n < FRAMES; n++) {
+		drawFrame(epdA, n);
+
+		uint32_t updates = simA.updates();
+		bool busy = ssdA.updating();
+
+		stats.reset();
+		epdA.present();
+
+		if (busy && !epdA.presentPending()) {
+			printf("frame %d: not handed over\n", n);
+			bad++;
+		}
+		if (epdA.presentPending() && simA.updates() == updates) {
+			// handing over waits for nothing and sends nothing
+			handedOver++;
+			if (stats.calls != 0)
+				bad++;
+		}
+		if (simA.updates() > 0 && image(simA) != frames[simA.updates() - 1])
+			bad++;
+	}
+	CHECK(epdA.syncPresent(TIME_INFINITE) == MSG_OK);
+	CHECK(epdA.waitUpdateDisplay(TIME_INFINITE) == MSG_OK);
+	uint64_t pipelined = simTimeNs() - start;
+
+	CHECK(bad == 0);
+	CHECK(handedOver > 0);
+	CHECK(simA.updates() == FRAMES);
+	CHECK(image(simA) == frames[FRAMES - 1]);
+
+	// the pending frame sends its own dirty areas only
+	CHECK(epdA.flushStats().windows == epdB.flushStats().windows);
+	CHECK(epdA.flushStats().sentBytes == epdB.flushStats().sentBytes);
+
+	printf("%d frames: sequential %u ms, pipelined %u ms\n", FRAMES,
+			unsigned(sequential / 1000000), unsigned(pipelined / 1000000));
+	CHECK(pipelined < sequential);
+	CHECK(pipelined <= uint64_t(FRAMES) * (REFRESH + 20) * 1000000);
+
+	printf("pipeline: %d failures\n", failures);
+
+	return failures > 0 ? 1 : 0;
+}
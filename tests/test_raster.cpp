@@ -0,0 +1,195 @@
+/*
+ * Copyright (C) 2020 Daniel Igaz
+ *
+ * This file is part of the eINK-click project.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Compare the word-wise FrameBuffer raster operations with the scalar
+ * reference: fills, blits, masked blits and overlapping moves in the
+ * same buffer, for every raster op. Random cases are followed by sweeps
+ * over the unaligned rows, heights and columns at the buffer edges.
+ * Guard bytes after each buffer catch writes past its end.
+ */
+
+#include "reference.hpp"
+#include <stdio.h>
+#include <stdlib.h>
+
+#define GUARD_SIZE				8
+
+typedef enum {
+	KIND_FILL = 0,
+	KIND_BLIT = 1,
+	KIND_MASKED = 2,
+	KIND_MOVE = 3,
+} Kind;
+
+static const char* const kindNames[] = { "fill", "blit", "masked", "move" };
+
+static uint32_t cases = 0;
+static uint32_t mismatches = 0;
+
+static void randomize(std::vector<uint8_t>& v)
+{
+	for (auto& b : v)
+		b = rand();
+}
+
+/**
+ * @brief	Run one operation on both implementations and compare.
+ * @details	The source has @p srcWidth x @p srcHeight pixels, it is the
+ * 			destination itself for KIND_MOVE.
+ */
+static void runCase(Kind kind, FrameBuffer::RasterOp op, uint16_t width, uint16_t height,
+		uint16_t x, uint16_t y, uint16_t w, uint16_t h,
+		uint16_t srcWidth, uint16_t srcHeight, uint16_t sx, uint16_t sy)
+{
+	size_t size = FrameBuffer::size(width, height);
+	std::vector<uint8_t> fast(size + GUARD_SIZE), ref, src(FrameBuffer::size(srcWidth, srcHeight));
+
+	randomize(fast);
+	randomize(src);
+	ref = fast;
+
+	FrameBuffer a(fast.data(), width, height);
+	FrameBuffer b(ref.data(), width, height);
+	uint8_t color = rand() & 0x03;
+
+	switch (kind) {
+	case KIND_FILL:
+		// the plain fill has its own entry point
+		if (op == FrameBuffer::ROP_COPY && (rand() & 1))
+			a.fillRect(x, y, w, h, color);
+		else
+			a.fillRect(x, y, w, h, color, op);
+		refRaster(b, x, y, w, h, NULL, 0, 0, 0, 0, color, op, -1);
+		break;
+	case KIND_BLIT:
+		a.blit(x, y, w, h, src.data(), srcHeight, sx, sy, op);
+		refRaster(b, x, y, w, h, src.data(), srcWidth, srcHeight, sx, sy, 0, op, -1);
+		break;
+	case KIND_MASKED:
+		a.blitMasked(x, y, w, h, src.data(), srcHeight, sx, sy, color);
+		refRaster(b, x, y, w, h, src.data(), srcWidth, srcHeight, sx, sy, 0, FrameBuffer::ROP_COPY, color);
+		break;
+	case KIND_MOVE:
+		a.blit(x, y, w, h, a, sx, sy, op);
+		refRaster(b, x, y, w, h, ref.data(), width, height, sx, sy, 0, op, -1);
+		break;
+	}
+
+	cases++;
+
+	if (fast != ref) {
+		if (mismatches++ < 10)
+			printf("mismatch: %s op=%d buffer %ux%u area %u,%u %ux%u source %u,%u\n",
+					kindNames[kind], op, width, height, x, y, w, h, sx, sy);
+	}
+}
+
+/**
+ * @brief	Run all kinds and ops on an area, sources at every row phase.
+ */
+static void runArea(uint16_t width, uint16_t height, uint16_t x, uint16_t y, uint16_t w, uint16_t h)
+{
+	uint16_t srcWidth = width + 2;
+	uint16_t srcHeight = height + 4;
+
+	for (int op = 0; op < 4; op++) {
+		for (uint16_t phase = 0; phase < 4; phase++) {
+			// sources at the top and at the bottom edge of the source
+			uint16_t sy = (phase & 1) ? srcHeight - h - phase : phase;
+			uint16_t sx = (phase & 2) ? srcWidth - w : 0;
+
+			runCase(KIND_FILL, FrameBuffer::RasterOp(op), width, height, x, y, w, h, 0, 0, 0, 0);
+			runCase(KIND_BLIT, FrameBuffer::RasterOp(op), width, height, x, y, w, h, srcWidth, srcHeight, sx, sy);
+			if (op == FrameBuffer::ROP_COPY)
+				runCase(KIND_MASKED, FrameBuffer::ROP_COPY, width, height, x, y, w, h, srcWidth, srcHeight, sx, sy);
+
+			// move by up to 3 rows and a column within the buffer
+			int my = y + phase - (rand() % 7);
+			int mx = x + (rand() % 3) - 1;
+			if (my >= 0 && my + h <= height && mx >= 0 && mx + w <= width)
+				runCase(KIND_MOVE, FrameBuffer::RasterOp(op), width, height, x, y, w, h, width, height, mx, my);
+		}
+	}
+}
+
+static void randomCases(int n)
+{
+	for (int i = 0; i < n; i++) {
+		Kind kind = Kind(rand() % 4);
+		FrameBuffer::RasterOp op = FrameBuffer::RasterOp(rand() % 4);
+		uint16_t width = 1 + rand() % 300;
+		uint16_t height = 1 + rand() % 140;
+		uint16_t w = 1 + rand() % width;
+		uint16_t h = 1 + rand() % height;
+		uint16_t x = rand() % (width - w + 1);
+		uint16_t y = rand() % (height - h + 1);
+
+		if (kind == KIND_MOVE) {
+			runCase(kind, op, width, height, x, y, w, h, width, height,
+					rand() % (width - w + 1), rand() % (height - h + 1));
+		}
+		else {
+			uint16_t srcWidth = w + rand() % 20;
+			uint16_t srcHeight = h + rand() % 20;
+
+			if (kind == KIND_MASKED)
+				op = FrameBuffer::ROP_COPY;
+			runCase(kind, op, width, height, x, y, w, h, srcWidth, srcHeight,
+					rand() % (srcWidth - w + 1), rand() % (srcHeight - h + 1));
+		}
+	}
+}
+
+/**
+ * @brief	Every row and height touching the top or the bottom of
+ * 			buffers of unaligned heights, at the left and right columns.
+ */
+static void edgeCases()
+{
+	static const uint16_t heights[] = { 1, 2, 3, 4, 5, 6, 7, 8, 9, 11, 12, 31, 32, 33, 34, 35, 126, 127, 128, 129 };
+	static const uint16_t columns[][2] = { { 0, 3 }, { 0, 1 }, { 2, 1 }, { 1, 2 } };
+	int n = 0;
+
+	for (uint16_t height : heights) {
+		for (uint16_t y = 0; y < height; y++) {
+			for (uint16_t h = 1; y + h <= height; h++) {
+				// all areas of small buffers, the ones within 9 rows of
+				// an edge otherwise
+				if (height > 12 && y > 8 && y + h < height - 8)
+					continue;
+
+				const uint16_t* c = columns[n++ & 3];
+				runArea(3, height, c[0], y, c[1], h);
+			}
+		}
+	}
+}
+
+int main()
+{
+	srand(1);
+
+	randomCases(30000);
+	edgeCases();
+
+	printf("raster: %u cases, %u mismatches\n", cases, mismatches);
+
+	return mismatches > 0 ? 1 : 0;
+}
@@ -0,0 +1,275 @@
+/*
+ * Copyright (C) 2020 Daniel Igaz
+ *
+ * This file is part of the eINK-click project.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*
+ * RenderQueue against direct EPD calls on a second panel: a random mix
+ * of commands gives the same RAM, texts wrapping around the end of the
+ * pool stay intact, and posting to a full queue or pool fails without
+ * losing queued commands.
+ */
+
+#include "hal_sim.hpp"
+#include "ssd1606.hpp"
+#include "renderqueue.hpp"
+#include "Cambria_Bold_12x12.hpp"
+#include <stdio.h>
+#include <stdlib.h>
+
+#define WIDTH		172
+#define HEIGHT		72
+#define COMMANDS	400
+
+static int failures = 0;
+
+#define CHECK(cond) do { \
+	if (!(cond)) { \
+		printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+		failures++; \
+	} \
+} while (0)
+
+static const SPIConfig cfgA = { false, NULL, 10 };
+static const SPIConfig cfgB = { false, NULL, 20 };
+
+static bool sameRam(const SimSSD16xx& a, const SimSSD16xx& b)
+{
+	for (uint16_t ya = 0; ya < a.gates(); ya++) {
+		for (uint16_t xa = 0; xa < a.sources() >> 2; xa++) {
+			if (a.ram(xa, ya) != b.ram(xa, ya))
+				return false;
+		}
+	}
+	return true;
+}
+
+/**
+ * @brief	Queued display and the reference drawn directly.
+ */
+struct Fixture {
+	SimSSD16xx simA, simB;
+	SSD1606 ssdA, ssdB;
+	EPD epdA, epdB;
+
+	Fixture()
+	: simA(10, 11, 12, 13, HEIGHT, WIDTH)
+	, simB(20, 21, 22, 23, HEIGHT, WIDTH)
+	, ssdA(SPID1, cfgA, 11, 12, 13)
+	, ssdB(SPID1, cfgB, 21, 22, 23)
+	, epdA(ssdA, WIDTH, HEIGHT, Cambria_Bold_12x12)
+	, epdB(ssdB, WIDTH, HEIGHT, Cambria_Bold_12x12)
+	{
+		simAttach(SPID1, simA);
+		simAttach(SPID1, simB);
+		epdA.start();
+		epdB.start();
+	}
+};
+
+/**
+ * @brief	Random drawing command.
+ */
+struct Op {
+	int kind;
+	EPD::Color color;
+	uint16_t x, y;
+	char str[32];
+};
+
+static uint8_t pixels[FrameBuffer::size(20, 12)];
+static const EPD::Image image = { 20, 12, pixels };
+
+static bool post(RenderQueue& q, const Op& op)
+{
+	switch (op.kind) {
+	case 0: return q.drawText(op.color, op.x, op.y, op.str);
+	case 1: return q.drawFilledRect(op.color, op.x, op.y, 10, 7);
+	case 2: return q.drawLine(op.color, op.x, op.y, WIDTH - 1 - op.x, HEIGHT - 1 - op.y);
+	case 3: return q.drawRect(op.color, op.x, op.y, 20, 9);
+	case 4: return q.drawCircle(op.color, op.x, op.y, 9);
+	case 5: return q.drawImage(op.x, op.y, image);
+	case 6: return q.setBkgColor(op.color);
+	case 7: return q.fillDisplay(op.color);
+	default: return q.updateDisplay(SSD16xx::UPDATE_PARTIAL);
+	}
+}
+
+static void draw(EPD& epd, const Op& op)
+{
+	switch (op.kind) {
+	case 0: epd.drawText(op.color, op.x, op.y, op.str); break;
+	case 1: epd.drawFilledRect(op.color, op.x, op.y, 10, 7); break;
+	case 2: epd.drawLine(op.color, op.x, op.y, WIDTH - 1 - op.x, HEIGHT - 1 - op.y); break;
+	case 3: epd.drawRect(op.color, op.x, op.y, 20, 9); break;
+	case 4: epd.drawCircle(op.color, op.x, op.y, 9); break;
+	case 5: epd.drawImage(op.x, op.y, image); break;
+	case 6: epd.setBkgColor(op.color); break;
+	case 7: epd.fillDisplay(op.color); break;
+	default: epd.startUpdateDisplay(SSD16xx::UPDATE_PARTIAL); break;
+	}
+}
+
+static void testMixed()
+{
+	static RenderQueue::Command cmds[16];
+	static char pool[100];
+	static Op ops[COMMANDS];
+
+	simReset();
+	Fixture f;
+	RenderQueue q(f.epdA, cmds, 16, pool, sizeof(pool));
+
+	for (size_t i = 0; i < sizeof(pixels); i++)
+		pixels[i] = rand();
+
+	for (int i = 0; i < COMMANDS; i++) {
+		Op& op = ops[i];
+
+		// mostly drawing, few fills and updates
+		op.kind = rand() % 16;
+		if (op.kind > 8)
+			op.kind %= 3;
+		op.color = EPD::Color(rand() & 0x03);
+		op.x = rand() % (WIDTH - 20);
+		op.y = rand() % (HEIGHT - 12);
+		snprintf(op.str, sizeof(op.str), "T%d-%.*s", i, rand() % 20, "abcdefghijklmnopqrstuvwxyz");
+	}
+
+	uint32_t rejected = 0;
+
+	for (int i = 0; i < COMMANDS; i++) {
+		while (!post(q, ops[i])) {
+			rejected++;
+			q.process(TIME_IMMEDIATE);
+		}
+		if (rand() % 10 == 0)
+			q.process(TIME_IMMEDIATE);
+	}
+
+	while (q.process(TIME_IMMEDIATE) > 0)
+		;
+
+	for (int i = 0; i < COMMANDS; i++)
+		draw(f.epdB, ops[i]);
+
+	CHECK(sameRam(f.simA, f.simB));
+	CHECK(f.simA.updates() == f.simB.updates());
+
+	const RenderQueue::Stats& stats = q.stats();
+	CHECK(rejected > 0);
+	CHECK(stats.rejected == rejected);
+	CHECK(stats.posted == COMMANDS);
+	CHECK(stats.executed == COMMANDS);
+	CHECK(stats.depth == 0);
+	CHECK(stats.maxDepth == 16);
+}
+
+/**
+ * @brief	Texts wrapping around the pool end and a full pool.
+ */
+static void testPoolWrap()
+{
+	static RenderQueue::Command cmds[8];
+	static char pool[16];
+
+	simReset();
+	Fixture f;
+	RenderQueue q(f.epdA, cmds, 8, pool, sizeof(pool));
+
+	// pool bytes 0..7, then the update ends the first batch
+	CHECK(q.drawText(EPD::COLOR_BLACK, 0, 0, "abcdefg"));
+	CHECK(q.updateDisplay());
+	// pool bytes 8..13
+	CHECK(q.drawText(EPD::COLOR_BLACK, 0, 20, "hijkl"));
+	CHECK(q.process(TIME_IMMEDIATE) == 2);
+	CHECK(q.depth() == 1);
+
+	// 2 bytes left at the end, the text goes to the pool start
+	CHECK(q.drawText(EPD::COLOR_DARG_GRAY, 0, 40, "mnopq"));
+	// 2 bytes free before the queued text
+	CHECK(!q.drawText(EPD::COLOR_BLACK, 0, 60, "rs"));
+	CHECK(q.stats().rejected == 1);
+	CHECK(q.drawFilledRect(EPD::COLOR_LIGHT_GRAY, 100, 0, 20, 20));
+
+	CHECK(q.process(TIME_IMMEDIATE) == 3);
+	CHECK(q.depth() == 0);
+
+	// an empty pool starts over
+	CHECK(q.drawText(EPD::COLOR_BLACK, 80, 40, "tuvwxyz0123456"));
+
+	CHECK(q.process(TIME_IMMEDIATE) == 1);
+
+	f.epdB.drawText(EPD::COLOR_BLACK, 0, 0, "abcdefg");
+	f.epdB.startUpdateDisplay();
+	f.epdB.drawText(EPD::COLOR_BLACK, 0, 20, "hijkl");
+	f.epdB.drawText(EPD::COLOR_DARG_GRAY, 0, 40, "mnopq");
+	f.epdB.drawFilledRect(EPD::COLOR_LIGHT_GRAY, 100, 0, 20, 20);
+	f.epdB.drawText(EPD::COLOR_BLACK, 80, 40, "tuvwxyz0123456");
+
+	CHECK(sameRam(f.simA, f.simB));
+}
+
+/**
+ * @brief	Posting to a full queue.
+ */
+static void testFull()
+{
+	static RenderQueue::Command cmds[4];
+	static char pool[16];
+
+	simReset();
+	Fixture f;
+	RenderQueue q(f.epdA, cmds, 4, pool, sizeof(pool));
+
+	for (uint16_t i = 0; i < 4; i++)
+		CHECK(q.drawFilledRect(EPD::COLOR_BLACK, i * 20, 0, 10, 10));
+
+	CHECK(!q.drawFilledRect(EPD::COLOR_BLACK, 80, 0, 10, 10));
+	CHECK(!q.drawText(EPD::COLOR_BLACK, 80, 0, "x"));
+	CHECK(q.stats().rejected == 2);
+	CHECK(q.stats().posted == 4);
+	CHECK(q.depth() == 4);
+
+	CHECK(q.process(TIME_IMMEDIATE) == 4);
+	CHECK(q.depth() == 0);
+	CHECK(q.drawFilledRect(EPD::COLOR_BLACK, 80, 0, 10, 10));
+	CHECK(q.process(TIME_IMMEDIATE) == 1);
+
+	// nothing queued
+	CHECK(q.process(TIME_IMMEDIATE) == 0);
+
+	for (uint16_t i = 0; i < 5; i++)
+		f.epdB.drawFilledRect(EPD::COLOR_BLACK, i * 20, 0, 10, 10);
+
+	CHECK(sameRam(f.simA, f.simB));
+	CHECK(q.stats().executed == 5);
+	CHECK(q.stats().maxDepth == 4);
+}
+
+int main()
+{
+	srand(1);
+
+	testMixed();
+	testPoolWrap();
+	testFull();
+
+	printf("renderqueue: %d failures\n", failures);
+
+	return failures > 0 ? 1 : 0;
+}
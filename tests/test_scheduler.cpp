@@ -0,0 +1,152 @@
+/*
+ * Copyright (C) 2020 Daniel Igaz
+ *
+ * This file is part of the eINK-click project.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Update scheduling on simulated time: cosmetic requests wait for the
+ * coalescing window and the minimum interval, urgent ones only for the
+ * running update, merged requests count as saved and take the full
+ * waveform if any of them asks for it.
+ */
+
+#include "hal_sim.hpp"
+#include "ssd1606.hpp"
+#include "updatescheduler.hpp"
+#include "Cambria_Bold_12x12.hpp"
+#include <stdio.h>
+
+#define WINDOW			100
+#define MIN_INTERVAL	1000
+#define REFRESH			500
+
+static int failures = 0;
+
+#define CHECK(cond) do { \
+	if (!(cond)) { \
+		printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+		failures++; \
+	} \
+} while (0)
+
+static int wakeups = 0;
+
+static void wake(void*)
+{
+	wakeups++;
+}
+
+static void sleepMs(uint32_t ms)
+{
+	simAdvanceNs(uint64_t(ms) * 1000000);
+}
+
+int main()
+{
+	static const SPIConfig cfg = { false, NULL, 1 };
+
+	simReset();
+	SimSSD16xx panel(1, 2, 3, 4, 72, 172);
+	panel.setRefreshTime(REFRESH);
+	simAttach(SPID1, panel);
+	SSD1606 ssd(SPID1, cfg, 2, 3, 4);
+	EPD epd(ssd, 172, 72, Cambria_Bold_12x12);
+	epd.start();
+
+	UpdateScheduler us(epd, TIME_MS2I(WINDOW), TIME_MS2I(MIN_INTERVAL));
+	us.setRequestCallback(wake, NULL);
+
+	// nothing pending
+	CHECK(us.process() == TIME_INFINITE);
+	CHECK(!us.pending());
+
+	// requests within the window merge into one update
+	systime_t first = chVTGetSystemTime();
+	us.request(SSD16xx::UPDATE_PARTIAL);
+	CHECK(us.pending());
+	CHECK(wakeups == 1);
+	CHECK(us.process() == TIME_MS2I(WINDOW));
+	sleepMs(40);
+	us.request(SSD16xx::UPDATE_PARTIAL);
+	us.request(SSD16xx::UPDATE_PARTIAL);
+	CHECK(wakeups == 3);
+	CHECK(us.process() == TIME_MS2I(WINDOW - 40));
+	CHECK(panel.updates() == 0);
+	sleepMs(WINDOW - 40);
+	CHECK(us.process() == TIME_INFINITE);
+	CHECK(!us.pending());
+	CHECK(panel.updates() == 1);
+	CHECK(chVTGetSystemTime() - first == WINDOW);
+	CHECK(us.stats().requests == 3);
+	CHECK(us.stats().updates == 1);
+	CHECK(us.stats().saved == 2);
+	CHECK(us.stats().urgent == 0);
+
+	// the first update is a full one
+	std::vector<uint8_t> fullLut = panel.lut();
+
+	// a cosmetic request waits for the minimum interval
+	systime_t last = chVTGetSystemTime();
+	sleepMs(200);
+	us.request(SSD16xx::UPDATE_PARTIAL);
+	CHECK(us.process() == TIME_MS2I(MIN_INTERVAL - 200));
+	sleepMs(MIN_INTERVAL - 200);
+	CHECK(us.process() == TIME_INFINITE);
+	CHECK(panel.updates() == 2);
+	CHECK(chVTGetSystemTime() - last == MIN_INTERVAL);
+	CHECK(panel.lut() != fullLut);
+
+	// an urgent request only waits for the running update
+	last = chVTGetSystemTime();
+	sleepMs(100);
+	us.request(SSD16xx::UPDATE_PARTIAL, UpdateScheduler::PRIORITY_URGENT);
+	CHECK(us.process() == TIME_INFINITE);
+	CHECK(panel.updates() == 3);
+	CHECK(chVTGetSystemTime() - last == REFRESH);
+	CHECK(us.stats().urgent == 1);
+
+	// an urgent request takes over a pending cosmetic one
+	sleepMs(MIN_INTERVAL);
+	us.request(SSD16xx::UPDATE_PARTIAL);
+	CHECK(us.process() == TIME_MS2I(WINDOW));
+	us.request(SSD16xx::UPDATE_PARTIAL, UpdateScheduler::PRIORITY_URGENT);
+	last = chVTGetSystemTime();
+	CHECK(us.process() == TIME_INFINITE);
+	CHECK(panel.updates() == 4);
+	CHECK(chVTGetSystemTime() == last);
+	CHECK(us.stats().urgent == 2);
+	CHECK(us.stats().saved == 3);
+
+	// a full request merged with partial ones takes the full waveform
+	sleepMs(MIN_INTERVAL);
+	us.request(SSD16xx::UPDATE_PARTIAL);
+	us.request(SSD16xx::UPDATE_FULL);
+	us.request(SSD16xx::UPDATE_PARTIAL);
+	sleepMs(WINDOW);
+	CHECK(us.process() == TIME_INFINITE);
+	CHECK(panel.updates() == 5);
+	CHECK(panel.lut() == fullLut);
+
+	CHECK(us.stats().requests == 10);
+	CHECK(us.stats().updates == 5);
+	CHECK(us.stats().saved == 5);
+	CHECK(us.stats().requests == us.stats().updates + us.stats().saved);
+
+	printf("scheduler: %d failures\n", failures);
+
+	return failures > 0 ? 1 : 0;
+}
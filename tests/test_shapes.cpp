@@ -0,0 +1,237 @@
+/*
+ * Copyright (C) 2020 Daniel Igaz
+ *
+ * This file is part of the eINK-click project.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Shapes drawn in direct mode against the emulated panel RAM: only the
+ * RAM bytes holding shape pixels may change, their other pixels get the
+ * background color, and everything else keeps the previous content.
+ */
+
+#include "hal_sim.hpp"
+#include "ssd1606.hpp"
+#include "epd.hpp"
+#include "Cambria_Bold_12x12.hpp"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define WIDTH		172
+#define HEIGHT		72
+#define SHAPES		400
+
+static int failures = 0;
+
+#define CHECK(cond) do { \
+	if (!(cond)) { \
+		printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+		failures++; \
+	} \
+} while (0)
+
+static uint8_t fb[FrameBuffer::size(WIDTH, HEIGHT)];
+
+/**
+ * @brief	Panel pixel levels indexed by gate and source.
+ */
+typedef uint8_t Levels[WIDTH][HEIGHT];
+
+static void snapshot(const SimSSD16xx& panel, Levels levels)
+{
+	for (uint16_t g = 0; g < WIDTH; g++) {
+		for (uint16_t s = 0; s < HEIGHT; s++)
+			levels[g][s] = panel.level(s, g);
+	}
+}
+
+/**
+ * @brief	Random shape, coordinates may lie partly off the display.
+ */
+struct Shape {
+	int kind;
+	EPD::Color color;
+	uint16_t x, y, w, h, x1, y1, r, start, end;
+
+	void random() {
+		kind = rand() % 4;
+		color = EPD::Color(rand() % 4);
+		x = rand() % (WIDTH + 20) - 10;
+		y = rand() % (HEIGHT + 20) - 10;
+		w = rand() % 80;
+		h = rand() % 50;
+		x1 = rand() % (WIDTH + 20) - 10;
+		y1 = rand() % (HEIGHT + 20) - 10;
+		r = rand() % 60;
+		start = rand() % 360;
+		end = rand() % 360;
+	}
+
+	void draw(EPD& epd) const {
+		switch (kind) {
+		case 0: epd.drawLine(color, x, y, x1, y1); break;
+		case 1: epd.drawRect(color, x, y, w, h); break;
+		case 2: epd.drawCircle(color, x, y, r); break;
+		default: epd.drawArc(color, x, y, r, start, end); break;
+		}
+	}
+};
+
+/**
+ * @brief	Draw random content in buffered mode and send it to the RAM.
+ */
+static void drawContent(EPD& epd)
+{
+	epd.setFrameBuffer(fb);
+	epd.fillDisplay(EPD::Color(rand() % 4));
+	for (int i = rand() % 6; i > 0; i--) {
+		uint16_t x = rand() % WIDTH;
+		uint16_t y = rand() % HEIGHT;
+
+		epd.drawFilledRect(EPD::Color(rand() % 4), x, y,
+				rand() % (WIDTH - x) + 1, rand() % (HEIGHT - y) + 1);
+	}
+	epd.drawText(EPD::Color(rand() % 4), rand() % WIDTH, rand() % HEIGHT, "42");
+	epd.flush();
+}
+
+/**
+ * @brief	Get the panel pixels of @p shape by drawing it in buffered mode
+ * 			over two fills different from the shape color.
+ */
+static void shapePixels(EPD& epd, const SimSSD16xx& panel, const Shape& shape, Levels mask)
+{
+	static Levels a, b;
+	EPD::Color c1 = EPD::Color((shape.color + 1) & 0x03);
+	EPD::Color c2 = EPD::Color((shape.color + 2) & 0x03);
+
+	epd.setFrameBuffer(fb);
+	epd.fillDisplay(c1);
+	shape.draw(epd);
+	epd.flush();
+	snapshot(panel, a);
+	epd.fillDisplay(c2);
+	shape.draw(epd);
+	epd.flush();
+	snapshot(panel, b);
+
+	for (uint16_t g = 0; g < WIDTH; g++) {
+		for (uint16_t s = 0; s < HEIGHT; s++)
+			mask[g][s] = a[g][s] == shape.color && b[g][s] == shape.color;
+	}
+}
+
+static void testOverContent(EPD::Orientation orientation)
+{
+	static const SPIConfig cfg = { false, NULL, 1 };
+	static Levels mask, expected, actual;
+
+	simReset();
+	SimSSD16xx panel(1, 2, 3, 4, HEIGHT, WIDTH);
+	simAttach(SPID1, panel);
+	SSD1606 ssd(SPID1, cfg, 2, 3, 4);
+	EPD epd(ssd, WIDTH, HEIGHT, Cambria_Bold_12x12, orientation);
+	epd.start();
+
+	int bad = 0;
+
+	for (int i = 0; i < SHAPES; i++) {
+		Shape shape;
+		EPD::Color bkgColor = EPD::Color(rand() % 4);
+
+		shape.random();
+		shapePixels(epd, panel, shape, mask);
+
+		drawContent(epd);
+		snapshot(panel, expected);
+
+		for (uint16_t g = 0; g < WIDTH; g++) {
+			for (uint16_t s = 0; s < HEIGHT; s += 4) {
+				if (!(mask[g][s] | mask[g][s + 1] | mask[g][s + 2] | mask[g][s + 3]))
+					continue;
+				for (uint16_t k = s; k < s + 4; k++)
+					expected[g][k] = mask[g][k] ? shape.color : bkgColor;
+			}
+		}
+
+		epd.setFrameBuffer(NULL);
+		epd.setBkgColor(bkgColor);
+		shape.draw(epd);
+		epd.setBkgColor(EPD::COLOR_WHITE);
+		snapshot(panel, actual);
+
+		if (memcmp(expected, actual, sizeof(actual)) != 0) {
+			if (bad++ < 5) {
+				printf("orientation %d shape %d: kind %d at %d,%d mismatch\n",
+						orientation, i, shape.kind, int16_t(shape.x), int16_t(shape.y));
+			}
+		}
+	}
+
+	CHECK(bad == 0);
+}
+
+/**
+ * @brief	SPI traffic of shapes in direct mode over existing content.
+ */
+static void testTraffic()
+{
+	static const SPIConfig cfg = { false, NULL, 1 };
+
+	simReset();
+	SimSSD16xx panel(1, 2, 3, 4, HEIGHT, WIDTH);
+	simAttach(SPID1, panel);
+	SSD1606 ssd(SPID1, cfg, 2, 3, 4);
+	EPD epd(ssd, WIDTH, HEIGHT, Cambria_Bold_12x12);
+	epd.start();
+
+	epd.fillDisplay(EPD::COLOR_WHITE);
+	epd.drawFilledRect(EPD::COLOR_BLACK, 100, 0, 72, 24);
+
+	SimSpiStats& stats = simSpi(SPID1).stats;
+
+	stats.reset();
+	epd.drawLine(EPD::COLOR_BLACK, 0, HEIGHT - 1, WIDTH - 1, 0);
+	printf("drawLine diagonal: %u calls, %u bytes\n", unsigned(stats.calls), unsigned(stats.bytes));
+	CHECK(stats.calls <= 315);
+	CHECK(stats.bytes <= 458);
+
+	// pixels of the filled rectangle away from the line are kept
+	CHECK(panel.level(2, WIDTH - 1 - 150) == EPD::COLOR_BLACK);
+	CHECK(panel.level(20, WIDTH - 1 - 110) == EPD::COLOR_BLACK);
+
+	stats.reset();
+	epd.drawRect(EPD::COLOR_BLACK, 10, 10, 60, 40);
+	printf("drawRect 60x40: %u calls, %u bytes\n", unsigned(stats.calls), unsigned(stats.bytes));
+	CHECK(stats.calls <= 87);
+	CHECK(stats.bytes <= 217);
+}
+
+int main()
+{
+	srand(1);
+
+	testOverContent(EPD::ORIENTATION_NORMAL);
+	testOverContent(EPD::ORIENTATION_MIRROR_X);
+	testOverContent(EPD::ORIENTATION_MIRROR_Y);
+	testOverContent(EPD::ORIENTATION_ROTATE_180);
+	testTraffic();
+
+	printf("shapes: %d failures\n", failures);
+
+	return failures > 0 ? 1 : 0;
+}
@@ -0,0 +1,77 @@
+/*
+ * Copyright (C) 2020 Daniel Igaz
+ *
+ * This file is part of the eINK-click project.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Display updates against a BUSY line that does not fall in time: the
+ * timeout is reported to the caller and no update command is sent to a
+ * device that would ignore it.
+ */
+
+#include "hal_sim.hpp"
+#include "ssd1606.hpp"
+#include "epd.hpp"
+#include "Cambria_Bold_12x12.hpp"
+#include <stdio.h>
+
+static int failures = 0;
+
+#define CHECK(cond) do { \
+	if (!(cond)) { \
+		printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+		failures++; \
+	} \
+} while (0)
+
+int main()
+{
+	static const SPIConfig cfg = { false, NULL, 1 };
+
+	simReset();
+	SimSSD16xx panel(1, 2, 3, 4, 72, 172);
+	simAttach(SPID1, panel);
+	SSD1606 ssd(SPID1, cfg, 2, 3, 4);
+	EPD epd(ssd, 172, 72, Cambria_Bold_12x12);
+	epd.start();
+
+	// a normal update
+	panel.setRefreshTime(500);
+	CHECK(epd.updateDisplay() == MSG_OK);
+	CHECK(panel.updates() == 1);
+
+	// an update outlasting SSD16XX_UPDATE_TIMEOUT
+	panel.setRefreshTime(3 * 5000);
+	CHECK(epd.startUpdateDisplay() == MSG_OK);
+	CHECK(panel.updates() == 2);
+
+	CHECK(epd.startUpdateDisplay() == MSG_TIMEOUT);
+	CHECK(panel.updates() == 2);
+
+	CHECK(epd.updateDisplay() == MSG_TIMEOUT);
+	CHECK(panel.updates() == 2);
+
+	// the device recovers once BUSY falls
+	chThdSleepMilliseconds(3 * 5000);
+	panel.setRefreshTime(500);
+	CHECK(epd.updateDisplay() == MSG_OK);
+	CHECK(panel.updates() == 3);
+
+	printf("update: %d failures\n", failures);
+
+	return failures > 0 ? 1 : 0;
+}
@@ -0,0 +1,193 @@
+/*
+ * Copyright (C) 2020 Daniel Igaz
+ *
+ * This file is part of the eINK-click project.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Asynchronous uploads and pipelined presenting against a panel driven
+ * with blocking calls: the RAM ends up the same, the display update
+ * queued behind an upload starts on its own, and a presented frame is
+ * sent as it was handed over, not as the drawing going on after it.
+ */
+
+#include "hal_sim.hpp"
+#include "ssd1606.hpp"
+#include "epd.hpp"
+#include "Cambria_Bold_12x12.hpp"
+#include <stdio.h>
+#include <stdlib.h>
+
+#define WIDTH		172
+#define HEIGHT		72
+
+static int failures = 0;
+
+#define CHECK(cond) do { \
+	if (!(cond)) { \
+		printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+		failures++; \
+	} \
+} while (0)
+
+static const SPIConfig cfgA = { false, NULL, 10 };
+static const SPIConfig cfgB = { false, NULL, 20 };
+
+static bool sameRam(const SimSSD16xx& a, const SimSSD16xx& b)
+{
+	for (uint16_t ya = 0; ya < a.gates(); ya++) {
+		for (uint16_t xa = 0; xa < a.sources() >> 2; xa++) {
+			if (a.ram(xa, ya) != b.ram(xa, ya))
+				return false;
+		}
+	}
+	return true;
+}
+
+static int uploads = 0;
+
+static void uploadEnd(SSD16xx*, void*)
+{
+	uploads++;
+}
+
+/**
+ * @brief	Upload an area with a queued update and draw meanwhile.
+ */
+static void testUpload()
+{
+	static uint8_t image[FrameBuffer::size(120, 48)];
+
+	simReset();
+	simSetTiming(SPID1, 4000000, 2000);
+	SimSSD16xx a(10, 11, 12, 13, HEIGHT, WIDTH), b(20, 21, 22, 23, HEIGHT, WIDTH);
+	simAttach(SPID1, a);
+	simAttach(SPID1, b);
+	SSD1606 ssdA(SPID1, cfgA, 11, 12, 13), ssdB(SPID1, cfgB, 21, 22, 23);
+	EPD epdA(ssdA, WIDTH, HEIGHT, Cambria_Bold_12x12), epdB(ssdB, WIDTH, HEIGHT, Cambria_Bold_12x12);
+	epdA.start();
+	epdB.start();
+
+	for (size_t i = 0; i < sizeof(image); i++)
+		image[i] = rand();
+
+	ssdA.setUploadCallback(uploadEnd, NULL);
+	simSpi(SPID1).stats.reset();
+
+	epdA.startUpload(30, 12, 120, 48, image, true);
+	CHECK(ssdA.uploading());
+	CHECK(uploads == 0);
+	CHECK(simSpi(SPID1).stats.asyncCalls == 1);
+
+	// waits for the upload, the update queued behind it runs on its own
+	epdA.drawFilledRect(EPD::COLOR_BLACK, 0, 0, 40, 20);
+	epdA.drawText(EPD::COLOR_DARG_GRAY, 100, 50, "42");
+	CHECK(!ssdA.uploading());
+	CHECK(uploads == 1);
+	CHECK(a.updates() == 1);
+	CHECK(epdA.waitUpload(TIME_INFINITE) == MSG_OK);
+
+	epdB.drawImage(30, 12, 120, 48, image);
+	CHECK(epdB.updateDisplay() == MSG_OK);
+	epdB.drawFilledRect(EPD::COLOR_BLACK, 0, 0, 40, 20);
+	epdB.drawText(EPD::COLOR_DARG_GRAY, 100, 50, "42");
+
+	CHECK(sameRam(a, b));
+	CHECK(epdA.waitUpdateDisplay(TIME_INFINITE) == MSG_OK);
+	CHECK(a.updates() == 1);
+}
+
+/**
+ * @brief	Draw frame @p n.
+ */
+static void drawFrame(EPD& epd, int n)
+{
+	char str[8];
+
+	snprintf(str, sizeof(str), "%d", n);
+	epd.fillDisplay(EPD::COLOR_WHITE);
+	epd.drawFilledRect(EPD::COLOR_LIGHT_GRAY, 10 * n, 8, 30, 30);
+	epd.drawText(EPD::COLOR_BLACK, 60, 40, str);
+}
+
+/**
+ * @brief	Present frames while the display updates and draw into the
+ * 			back buffer before the pending frame is sent.
+ */
+static void testPresent()
+{
+	static uint8_t fb0[FrameBuffer::size(WIDTH, HEIGHT)], fb1[FrameBuffer::size(WIDTH, HEIGHT)];
+	static uint8_t fb[FrameBuffer::size(WIDTH, HEIGHT)];
+
+	simReset();
+	SimSSD16xx a(10, 11, 12, 13, HEIGHT, WIDTH), b(20, 21, 22, 23, HEIGHT, WIDTH);
+	a.setRefreshTime(500);
+	simAttach(SPID1, a);
+	simAttach(SPID1, b);
+	SSD1606 ssdA(SPID1, cfgA, 11, 12, 13), ssdB(SPID1, cfgB, 21, 22, 23);
+	EPD epdA(ssdA, WIDTH, HEIGHT, Cambria_Bold_12x12), epdB(ssdB, WIDTH, HEIGHT, Cambria_Bold_12x12);
+	epdA.start();
+	epdB.start();
+	epdA.setFrameBuffers(fb0, fb1);
+	epdB.setFrameBuffer(fb);
+
+	// the display is idle, the first frame goes out right away
+	drawFrame(epdA, 1);
+	epdA.present();
+	CHECK(!epdA.presentPending());
+	CHECK(a.updates() == 1);
+	drawFrame(epdB, 1);
+	epdB.flush();
+	CHECK(sameRam(a, b));
+
+	for (int n = 2; n < 5; n++) {
+		drawFrame(epdA, n);
+		epdA.present();
+		CHECK(epdA.presentPending());
+		CHECK(a.updates() == uint32_t(n - 1));
+
+		// the back buffer is not sent with the handed over frame
+		epdA.fillDisplay(EPD::COLOR_BLACK);
+		epdA.drawText(EPD::COLOR_WHITE, 0, 0, "back");
+
+		CHECK(epdA.syncPresent(TIME_INFINITE) == MSG_OK);
+		CHECK(!epdA.presentPending());
+		CHECK(a.updates() == uint32_t(n));
+
+		drawFrame(epdB, n);
+		epdB.flush();
+		CHECK(sameRam(a, b));
+	}
+
+	// the back buffer drawing goes out with the next flush
+	epdA.flush();
+	epdB.fillDisplay(EPD::COLOR_BLACK);
+	epdB.drawText(EPD::COLOR_WHITE, 0, 0, "back");
+	epdB.flush();
+	CHECK(sameRam(a, b));
+}
+
+int main()
+{
+	srand(1);
+
+	testUpload();
+	testPresent();
+
+	printf("upload: %d failures\n", failures);
+
+	return failures > 0 ? 1 : 0;
+}
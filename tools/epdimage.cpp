@@ -0,0 +1,185 @@
+/*
+ * Copyright (C) 2020 Daniel Igaz
+ *
+ * This file is part of the eINK-click project.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Host tool converting a grayscale PGM image to an EPD::Image header.
+ *
+ * Build:	c++ -O2 -o epdimage epdimage.cpp
+ * Usage:	epdimage [-r] <name> <input.pgm> > <name>.hpp
+ *
+ * Gray levels are rounded to the 4 display colors, black being 0 and
+ * white 3. The pixels are packed column by column in the SSD16xx RAM
+ * layout, 4 vertical pixels per byte with the topmost pixel in the most
+ * significant bits, ready for EPD::drawImage(). With -r the packed bytes
+ * are run-length encoded into an EPD::RleImage, see RleDecoder.
+ */
+
+#include "rleencode.hpp"
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <ctype.h>
+#include <vector>
+
+/**
+ * @brief	Read the next PGM header number, skipping comments.
+ */
+static bool readNumber(FILE* fp, unsigned* value)
+{
+	int c = fgetc(fp);
+
+	for (;;) {
+		while (c != EOF && isspace(c))
+			c = fgetc(fp);
+		if (c != '#')
+			break;
+		while (c != EOF && c != '\n')
+			c = fgetc(fp);
+	}
+
+	if (c == EOF || !isdigit(c))
+		return false;
+
+	*value = 0;
+	while (c != EOF && isdigit(c)) {
+		*value = *value * 10 + (c - '0');
+		c = fgetc(fp);
+	}
+
+	// exactly one whitespace ends the header
+	return true;
+}
+
+/**
+ * @brief	Read a binary (P5) or plain (P2) PGM image.
+ *
+ * @returns	The gray levels row by row scaled to 0..255, empty on error.
+ */
+static std::vector<uint8_t> readPgm(FILE* fp, unsigned* width, unsigned* height)
+{
+	std::vector<uint8_t> pixels;
+	unsigned maxval;
+	char magic[2];
+
+	if (fread(magic, 1, 2, fp) != 2 || magic[0] != 'P' || (magic[1] != '2' && magic[1] != '5'))
+		return pixels;
+
+	if (!readNumber(fp, width) || !readNumber(fp, height) || !readNumber(fp, &maxval) ||
+			*width == 0 || *height == 0 || *width > 0xFFFF || *height > 0xFFFF ||
+			maxval == 0 || maxval > 0xFFFF)
+		return pixels;
+
+	pixels.resize(size_t(*width) * *height);
+
+	for (uint8_t& p : pixels) {
+		unsigned v;
+
+		if (magic[1] == '2') {
+			if (!readNumber(fp, &v))
+				return std::vector<uint8_t>();
+		}
+		else {
+			int hi = (maxval > 0xFF) ? fgetc(fp) : 0;
+			int lo = fgetc(fp);
+			if (hi == EOF || lo == EOF)
+				return std::vector<uint8_t>();
+			v = (unsigned(hi) << 8) | unsigned(lo);
+		}
+
+		p = uint8_t((v > maxval ? maxval : v) * 255 / maxval);
+	}
+
+	return pixels;
+}
+
+int main(int argc, char* argv[])
+{
+	bool rle = argc == 4 && argv[1][0] == '-' && argv[1][1] == 'r' && argv[1][2] == 0;
+
+	if (argc != 3 && !rle) {
+		fprintf(stderr, "usage: %s [-r] <name> <input.pgm>\n", argv[0]);
+		return 1;
+	}
+
+	const char* name = argv[argc - 2];
+	const char* input = argv[argc - 1];
+	FILE* fp = fopen(input, "rb");
+	if (fp == NULL) {
+		perror(input);
+		return 1;
+	}
+
+	unsigned width, height;
+	std::vector<uint8_t> pixels = readPgm(fp, &width, &height);
+	fclose(fp);
+
+	if (pixels.empty()) {
+		fprintf(stderr, "%s: not a valid PGM image\n", input);
+		return 1;
+	}
+
+	// pack 4 vertical pixels per byte, the padding rows are white
+	unsigned stride = (height + 3) >> 2;
+	std::vector<uint8_t> packed(size_t(width) * stride, 0);
+
+	for (unsigned x = 0; x < width; x++) {
+		for (unsigned y = 0; y < stride * 4; y++) {
+			unsigned level = 3;
+			if (y < height)
+				level = (pixels[size_t(y) * width + x] * 3 + 127) / 255;
+			packed[x * stride + (y >> 2)] |= level << ((3 - (y & 0x03)) << 1);
+		}
+	}
+
+	printf("/*\n * %ux%u 2bpp image generated by epdimage from %s\n */\n\n", width, height, input);
+	printf("#ifndef EINK_CLICK_IMAGE_%s_HPP_\n#define EINK_CLICK_IMAGE_%s_HPP_\n\n", name, name);
+	printf("#include \"epd.hpp\"\n\n");
+
+	if (rle) {
+		if (stride > 64) {
+			fprintf(stderr, "%s: too tall for run-length encoding\n", input);
+			return 1;
+		}
+
+		std::vector<uint8_t> encoded = rleEncode(packed, stride);
+
+		printf("constexpr uint8_t %s_data[] = {    // %zu -> %zu bytes\n", name, packed.size(), encoded.size());
+		for (size_t i = 0; i < encoded.size(); i++)
+			printf("%s0x%02X,%s", (i & 0x0F) ? "" : "    ", encoded[i],
+					((i & 0x0F) == 0x0F || i + 1 == encoded.size()) ? "\n" : "");
+		printf("};\n\n");
+		printf("constexpr EPD::RleImage %s = { %u, %u, sizeof(%s_data), %s_data };\n\n",
+				name, width, height, name, name);
+	}
+	else {
+		printf("constexpr uint8_t %s_data[] = {\n", name);
+		for (unsigned x = 0; x < width; x++) {
+			printf("    ");
+			for (unsigned i = 0; i < stride; i++)
+				printf("0x%02X,", packed[x * stride + i]);
+			printf("    // Column %u\n", x);
+		}
+		printf("};\n\n");
+		printf("constexpr EPD::Image %s = { %u, %u, %s_data };\n\n", name, width, height, name);
+	}
+
+	printf("#endif /* EINK_CLICK_IMAGE_%s_HPP_ */\n", name);
+
+	return 0;
+}
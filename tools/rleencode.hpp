@@ -0,0 +1,87 @@
+/*
+ * Copyright (C) 2020 Daniel Igaz
+ *
+ * This file is part of the eINK-click project.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef EINK_CLICK_TOOLS_RLEENCODE_HPP_
+#define EINK_CLICK_TOOLS_RLEENCODE_HPP_
+
+/*
+ * Host side encoder of the RleDecoder stream, shared by epdimage and the
+ * benchmark.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+/**
+ * @brief	Run-length encode RAM bytes.
+ * @details	Bytes matching the previous column become copy runs, repeats
+ * 			of 3 bytes and more become repeat runs, everything else goes
+ * 			to literal runs.
+ */
+static inline std::vector<uint8_t> rleEncode(const std::vector<uint8_t>& in, size_t stride)
+{
+	std::vector<uint8_t> out;
+	size_t start = 0;
+	size_t i = 0;
+
+	auto literal = [&](size_t end) {
+		while (start < end) {
+			size_t n = (end - start < 128) ? end - start : 128;
+			out.push_back(uint8_t(n - 1));
+			out.insert(out.end(), in.begin() + start, in.begin() + start + n);
+			start += n;
+		}
+	};
+
+	while (i < in.size()) {
+		size_t run = 1;
+		while (i + run < in.size() && in[i + run] == in[i] && run < 65)
+			run++;
+
+		size_t copy = 0;
+		if (i >= stride) {
+			while (i + copy < in.size() && in[i + copy] == in[i + copy - stride] && copy < 64)
+				copy++;
+		}
+
+		if (copy >= 2 && copy >= run) {
+			literal(i);
+			out.push_back(uint8_t(0xBF + copy));
+			i += copy;
+			start = i;
+		}
+		else if (run >= 3) {
+			literal(i);
+			out.push_back(uint8_t(0x7E + run));
+			out.push_back(in[i]);
+			i += run;
+			start = i;
+		}
+		else {
+			i++;
+		}
+	}
+
+	literal(in.size());
+
+	return out;
+}
+
+#endif /* EINK_CLICK_TOOLS_RLEENCODE_HPP_ */
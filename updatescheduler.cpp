@@ -0,0 +1,108 @@
+/*
+ * Copyright (C) 2020 Daniel Igaz
+ *
+ * This file is part of the eINK-click project.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "updatescheduler.hpp"
+
+UpdateScheduler::UpdateScheduler(EPD& epd, sysinterval_t window, sysinterval_t minInterval)
+: _epd(epd)
+, _window(window)
+, _minInterval(minInterval)
+, _pending(false)
+, _updated(false)
+, _priority(PRIORITY_COSMETIC)
+, _mode(SSD16xx::UPDATE_PARTIAL)
+, _first(0)
+, _last(0)
+, _stats()
+, _callback(NULL)
+, _arg(NULL)
+{
+}
+
+void UpdateScheduler::request(SSD16xx::UpdateMode mode, Priority priority)
+{
+	osalSysLock();
+
+	_stats.requests++;
+
+	if (_pending) {
+		_stats.saved++;
+	}
+	else {
+		_pending = true;
+		_priority = PRIORITY_COSMETIC;
+		_mode = SSD16xx::UPDATE_PARTIAL;
+		_first = chVTGetSystemTimeX();
+	}
+
+	if (priority > _priority)
+		_priority = priority;
+	if (mode == SSD16xx::UPDATE_FULL)
+		_mode = SSD16xx::UPDATE_FULL;
+
+	if (_callback != NULL)
+		_callback(_arg);
+
+	osalSysUnlock();
+}
+
+sysinterval_t UpdateScheduler::process()
+{
+	osalSysLock();
+
+	if (!_pending) {
+		osalSysUnlock();
+		return TIME_INFINITE;
+	}
+
+	// cosmetic requests wait for the window and the minimum interval
+	sysinterval_t wait = 0;
+
+	if (_priority == PRIORITY_COSMETIC) {
+		sysinterval_t elapsed = chVTTimeElapsedSinceX(_first);
+		if (elapsed < _window)
+			wait = _window - elapsed;
+
+		elapsed = chVTTimeElapsedSinceX(_last);
+		if (_updated && elapsed < _minInterval && _minInterval - elapsed > wait)
+			wait = _minInterval - elapsed;
+	}
+
+	osalSysUnlock();
+
+	if (wait > 0)
+		return wait;
+
+	// requests keep merging until the running update ends
+	_epd.waitUpdateDisplay(TIME_INFINITE);
+
+	osalSysLock();
+	SSD16xx::UpdateMode mode = _mode;
+	if (_priority == PRIORITY_URGENT)
+		_stats.urgent++;
+	_stats.updates++;
+	_pending = false;
+	_updated = true;
+	_last = chVTGetSystemTimeX();
+	osalSysUnlock();
+
+	_epd.startUpdateDisplay(mode);
+
+	return TIME_INFINITE;
+}
@@ -0,0 +1,139 @@
+/*
+ * Copyright (C) 2020 Daniel Igaz
+ *
+ * This file is part of the eINK-click project.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef EINK_CLICK_UPDATESCHEDULER_HPP_
+#define EINK_CLICK_UPDATESCHEDULER_HPP_
+
+#include "epd.hpp"
+
+/**
+ * @brief	Display update scheduler.
+ * @details	Merges the update requests of several subsystems into single
+ * 			display updates. A cosmetic request waits for the coalescing
+ * 			window to collect the requests following it and for the
+ * 			minimum interval since the last update. An urgent request
+ * 			skips both and only waits for the running update. Merged
+ * 			requests take the full waveform if any of them asks for it.
+ *
+ * 			Any thread may request updates, the thread drawing to the
+ * 			EPD calls process() and sleeps at most the returned time or
+ * 			until the request callback wakes it. RenderQueue registers
+ * 			the callback of its worker thread.
+ */
+class UpdateScheduler {
+public:
+	/**
+	 * @brief	Update request priority.
+	 */
+	typedef enum : uint8_t {
+		PRIORITY_COSMETIC = 0,	///< Coalesced and rate limited.
+		PRIORITY_URGENT = 1,	///< Started as soon as possible.
+	} Priority;
+
+	/**
+	 * @brief	Scheduler statistics.
+	 */
+	typedef struct {
+		uint32_t requests;		///< Update requests.
+		uint32_t updates;		///< Display updates started.
+		uint32_t saved;			///< Requests merged into another one.
+		uint32_t urgent;		///< Updates started by urgent requests.
+	} Stats;
+
+	/**
+	 * @brief	Request callback type.
+	 * @note	Called in locked state, only S-class and I-class
+	 * 			functions may be used.
+	 *
+	 * @param[in] arg		callback argument
+	 */
+	typedef void (*RequestCallback)(void* arg);
+
+private:
+	EPD& _epd;					///< Updated display.
+	sysinterval_t _window;		///< Coalescing window.
+	sysinterval_t _minInterval;	///< Minimum time between two update starts.
+	bool _pending;				///< Update requested.
+	bool _updated;				///< An update was started.
+	Priority _priority;			///< Highest pending priority.
+	SSD16xx::UpdateMode _mode;	///< Pending waveform.
+	systime_t _first;			///< Time of the first pending request.
+	systime_t _last;			///< Start time of the last update.
+	Stats _stats;				///< Statistics.
+	RequestCallback _callback;	///< Wakes the drawing thread or @p NULL.
+	void* _arg;					///< Request callback argument.
+
+public:
+	/**
+	 * @param[in] epd			updated display
+	 * @param[in] window		coalescing window of cosmetic requests
+	 * @param[in] minInterval	minimum time between two cosmetic update
+	 * 							starts
+	 */
+	UpdateScheduler(EPD& epd, sysinterval_t window, sysinterval_t minInterval);
+
+	/**
+	 * @brief	Request a display update.
+	 * @details	The request callback wakes the drawing thread.
+	 *
+	 * @param[in] mode		requested waveform
+	 * @param[in] priority	request priority
+	 */
+	void request(SSD16xx::UpdateMode mode = SSD16xx::UPDATE_FULL, Priority priority = PRIORITY_COSMETIC);
+
+	/**
+	 * @brief	Start the pending update when it is due.
+	 * @details	A due update waits for the running one to end, then it
+	 * 			is started without waiting for its end.
+	 * @note	To be called by the thread drawing to the EPD.
+	 *
+	 * @returns	The time until the next check, @p TIME_INFINITE if no
+	 * 			update is pending.
+	 */
+	sysinterval_t process();
+
+	/** @brief	Check whether an update is pending. */
+	bool pending() const { return _pending; }
+
+	/**
+	 * @brief	Set the request callback.
+	 * @note	To be set before requesting updates.
+	 *
+	 * @param[in] callback	callback or @p NULL
+	 * @param[in] arg		callback argument
+	 */
+	void setRequestCallback(RequestCallback callback, void* arg) {
+		_callback = callback;
+		_arg = arg;
+	}
+
+	/** @brief	Set the coalescing window. */
+	void setWindow(sysinterval_t window) { _window = window; }
+
+	/** @brief	Set the minimum time between two update starts. */
+	void setMinInterval(sysinterval_t interval) { _minInterval = interval; }
+
+	/** @brief	Get the statistics. */
+	const Stats& stats() const { return _stats; }
+
+	/** @brief	Reset the statistics. */
+	void resetStats() { _stats = Stats(); }
+};
+
+#endif /* EINK_CLICK_UPDATESCHEDULER_HPP_ */